@@ -0,0 +1,139 @@
+#include "Benchmarks.h"
+
+#include <chrono>
+#include <cmath>
+#include <cstring>
+#include <iostream>
+#include <random>
+
+#include <glm/gtc/matrix_transform.hpp>
+#include <glm/mat4x4.hpp>
+
+#include "Bvh.h"
+#include "FrustumCuller.h"
+#include "Globals.h"
+#include "RingBuffer.h"
+#include "Utilities/Vulkan.h"
+
+namespace Benchmarks
+{
+	void uniformUpdates(uint32_t frames)
+	{
+		// Same payload the renderer uploads every frame (projection + view)
+		glm::mat4 payload[2] = { glm::mat4(1.0f), glm::mat4(1.0f) };
+
+		// Old path: one buffer per frame in flight, mapped and unmapped on every update
+		VkBuffer buffers[MAX_FRAME_DRAWS];
+		VkDeviceMemory buffersMemory[MAX_FRAME_DRAWS];
+		for (int i = 0; i < MAX_FRAME_DRAWS; i++)
+		{
+			Utilities::Vulkan::createBuffer(Globals::vkContext->physicalDevice, Globals::vkContext->logicalDevice, sizeof(payload), VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
+			                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &buffers[i], &buffersMemory[i]);
+		}
+
+		auto start = std::chrono::high_resolution_clock::now();
+		for (uint32_t frame = 0; frame < frames; frame++)
+		{
+			void* data;
+			vkMapMemory(Globals::vkContext->logicalDevice, buffersMemory[frame % MAX_FRAME_DRAWS], 0, sizeof(payload), 0, &data);
+			memcpy(data, payload, sizeof(payload));
+			vkUnmapMemory(Globals::vkContext->logicalDevice, buffersMemory[frame % MAX_FRAME_DRAWS]);
+		}
+		auto mapUnmapTime = std::chrono::high_resolution_clock::now() - start;
+
+		for (int i = 0; i < MAX_FRAME_DRAWS; i++)
+		{
+			vkDestroyBuffer(Globals::vkContext->logicalDevice, buffers[i], nullptr);
+			vkFreeMemory(Globals::vkContext->logicalDevice, buffersMemory[i], nullptr);
+		}
+
+		// New path: mapped once, every frame writes into its own region
+		RingBuffer ringBuffer;
+		ringBuffer.create(sizeof(payload), MAX_FRAME_DRAWS, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t frame = 0; frame < frames; frame++)
+		{
+			memcpy(ringBuffer.getRegion(frame % MAX_FRAME_DRAWS), payload, sizeof(payload));
+		}
+		auto persistentTime = std::chrono::high_resolution_clock::now() - start;
+
+		ringBuffer.destroy();
+
+		double mapUnmapMicros = std::chrono::duration<double, std::micro>(mapUnmapTime).count() / frames;
+		double persistentMicros = std::chrono::duration<double, std::micro>(persistentTime).count() / frames;
+		std::cout << "Uniform update (map/memcpy/unmap): " << mapUnmapMicros << " us/frame" << std::endl;
+		std::cout << "Uniform update (persistently mapped): " << persistentMicros << " us/frame" << std::endl;
+	}
+	void frustumCulling(uint32_t objectCount, uint32_t frames)
+	{
+		// Same density at every scene size: the cube grows with the object count, the camera sits in the middle
+		float halfSize = 4.0f * std::cbrt(static_cast<float>(objectCount));
+		std::mt19937 random(1234);
+		std::uniform_real_distribution<float> position(-halfSize, halfSize);
+		std::uniform_real_distribution<float> size(0.1f, 2.0f);
+
+		FrustumCuller frustumCuller;
+		frustumCuller.resize(objectCount);
+		std::vector<Aabb> bounds(objectCount);
+		for (uint32_t i = 0; i < objectCount; i++)
+		{
+			glm::vec3 center(position(random), position(random), position(random));
+			glm::vec3 extents(size(random), size(random), size(random));
+			frustumCuller.setBounds(i, center, glm::length(extents), extents);
+			bounds[i] = { center - extents, center + extents };
+		}
+
+		glm::mat4 projection = glm::perspective(glm::radians(45.0f), 16.0f / 9.0f, 0.1f, halfSize * 2.0f);
+		std::vector<uint32_t> visible;
+		visible.reserve(objectCount);
+
+		auto start = std::chrono::high_resolution_clock::now();
+		Bvh bvh;
+		bvh.build(bounds);
+		auto buildTime = std::chrono::high_resolution_clock::now() - start;
+
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t frame = 0; frame < frames; frame++)
+		{
+			bvh.refit(bounds);
+		}
+		auto refitTime = std::chrono::high_resolution_clock::now() - start;
+
+		// The camera turns a full circle over the frames, both paths see the same views
+		auto viewProjection = [projection, frames](uint32_t frame)
+		{
+			float angle = glm::two_pi<float>() * frame / frames;
+			return projection * glm::lookAt(glm::vec3(0.0f), glm::vec3(std::sin(angle), 0.0f, std::cos(angle)), glm::vec3(0.0f, 1.0f, 0.0f));
+		};
+
+		size_t linearVisible = 0;
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t frame = 0; frame < frames; frame++)
+		{
+			visible.clear();
+			frustumCuller.cull(viewProjection(frame), visible);
+			linearVisible += visible.size();
+		}
+		auto linearTime = std::chrono::high_resolution_clock::now() - start;
+
+		size_t bvhVisible = 0;
+		start = std::chrono::high_resolution_clock::now();
+		for (uint32_t frame = 0; frame < frames; frame++)
+		{
+			visible.clear();
+			bvh.cullFrustum(FrustumCuller::extractPlanes(viewProjection(frame)), visible);
+			bvhVisible += visible.size();
+		}
+		auto bvhTime = std::chrono::high_resolution_clock::now() - start;
+
+		double linearMillis = std::chrono::duration<double, std::milli>(linearTime).count() / frames;
+		double bvhMillis = std::chrono::duration<double, std::milli>(bvhTime).count() / frames;
+		std::cout << "Frustum culling " << objectCount << " objects (linear SIMD): " << linearMillis << " ms/frame, "
+		          << linearVisible / frames << " visible" << std::endl;
+		std::cout << "Frustum culling " << objectCount << " objects (BVH, " << bvh.getNodeCount() << " nodes): " << bvhMillis << " ms/frame, "
+		          << bvhVisible / frames << " visible" << std::endl;
+		std::cout << "BVH " << objectCount << " objects: build " << std::chrono::duration<double, std::milli>(buildTime).count() << " ms, refit "
+		          << std::chrono::duration<double, std::milli>(refitTime).count() / frames << " ms" << std::endl;
+	}
+}
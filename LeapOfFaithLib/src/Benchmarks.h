@@ -0,0 +1,14 @@
+#pragma once
+
+#include <cstdint>
+
+// Micro benchmarks run at startup when "benchmark" is enabled in config.json
+namespace Benchmarks
+{
+	// Per-frame cost of updating a uniform buffer with vkMapMemory/memcpy/vkUnmapMemory vs. writing into a persistently mapped RingBuffer
+	void uniformUpdates(uint32_t frames);
+
+	// Per-frame cost of culling objectCount boxes scattered around the camera with a linear SIMD scan vs. the bounding volume hierarchy,
+	// plus what building and refitting the hierarchy cost
+	void frustumCulling(uint32_t objectCount, uint32_t frames);
+}
@@ -0,0 +1,75 @@
+#include "BufferPool.h"
+
+#include <assert.h>
+
+#include "Globals.h"
+#include "Utilities/Vulkan.h"
+
+BufferHandle BufferPool::create(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties)
+{
+	BufferHandle handle;
+	handle.value = handles.allocate();
+
+	// Grow the arrays when a brand new slot was handed out
+	uint32_t index = handle.getIndex();
+	if (index >= buffers.size())
+	{
+		buffers.resize(index + 1);
+		bufferMemory.resize(index + 1);
+		sizes.resize(index + 1);
+		mappedData.resize(index + 1);
+	}
+
+	Utilities::Vulkan::createBuffer(Globals::vkContext->physicalDevice, Globals::vkContext->logicalDevice, size, usage, properties,
+	                                &buffers[index], &bufferMemory[index]);
+	sizes[index] = size;
+	mappedData[index] = nullptr;
+
+	// Map once, the memory stays mapped until the buffer is destroyed
+	if (properties & VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT)
+	{
+		VkResult result = vkMapMemory(Globals::vkContext->logicalDevice, bufferMemory[index], 0, VK_WHOLE_SIZE, 0, &mappedData[index]);
+		assert(result == VK_SUCCESS && "Failed to map a Buffer!");
+	}
+
+	return handle;
+}
+
+void BufferPool::destroy(BufferHandle handle)
+{
+	assert(isValid(handle) && "Destroying an invalid Buffer handle!");
+
+	uint32_t index = handle.getIndex();
+	if (mappedData[index])
+	{
+		vkUnmapMemory(Globals::vkContext->logicalDevice, bufferMemory[index]);
+		mappedData[index] = nullptr;
+	}
+
+	vkDestroyBuffer(Globals::vkContext->logicalDevice, buffers[index], nullptr);
+	vkFreeMemory(Globals::vkContext->logicalDevice, bufferMemory[index], nullptr);
+	buffers[index] = VK_NULL_HANDLE;
+	bufferMemory[index] = VK_NULL_HANDLE;
+
+	handles.free(handle.value);
+}
+
+void BufferPool::destroyAll()
+{
+	for (uint32_t i = 0; i < handles.getCapacity(); i++)
+	{
+		if (!handles.isSlotUsed(i))
+		{
+			continue;
+		}
+
+		if (mappedData[i])
+		{
+			vkUnmapMemory(Globals::vkContext->logicalDevice, bufferMemory[i]);
+		}
+		vkDestroyBuffer(Globals::vkContext->logicalDevice, buffers[i], nullptr);
+		vkFreeMemory(Globals::vkContext->logicalDevice, bufferMemory[i], nullptr);
+	}
+
+	*this = BufferPool();
+}
@@ -0,0 +1,33 @@
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "Handle.h"
+
+typedef Handle<struct BufferTag> BufferHandle;
+
+// Every long-lived VkBuffer of the engine with its memory, host visible buffers stay mapped for their whole lifetime
+class BufferPool
+{
+public:
+	BufferHandle create(VkDeviceSize size, VkBufferUsageFlags usage, VkMemoryPropertyFlags properties);
+	void destroy(BufferHandle handle);
+	void destroyAll();
+
+	inline bool isValid(BufferHandle handle) const { return handles.isValid(handle.value); }
+
+	inline VkBuffer getBuffer(BufferHandle handle) const { return buffers[handle.getIndex()]; }
+	inline VkDeviceMemory getMemory(BufferHandle handle) const { return bufferMemory[handle.getIndex()]; }
+	inline VkDeviceSize getSize(BufferHandle handle) const { return sizes[handle.getIndex()]; }
+	// Persistent mapping of host visible buffers, nullptr for device local ones
+	inline void* getMapped(BufferHandle handle) const { return mappedData[handle.getIndex()]; }
+private:
+	HandleAllocator handles;
+
+	// Per buffer data, indexed by slot
+	std::vector<VkBuffer> buffers;
+	std::vector<VkDeviceMemory> bufferMemory;
+	std::vector<VkDeviceSize> sizes;
+	std::vector<void*> mappedData;
+};
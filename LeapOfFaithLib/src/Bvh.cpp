@@ -0,0 +1,376 @@
+#include "Bvh.h"
+
+#include <algorithm>
+#include <cfloat>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
+// Box that any union starts from
+static const Aabb EMPTY_AABB = { glm::vec3(FLT_MAX), glm::vec3(-FLT_MAX) };
+
+static inline void grow(Aabb& box, const Aabb& other)
+{
+	box.min = glm::min(box.min, other.min);
+	box.max = glm::max(box.max, other.max);
+}
+
+void Bvh::build(const std::vector<Aabb>& newBounds)
+{
+	primitiveBounds = newBounds;
+
+	uint32_t primitiveCount = static_cast<uint32_t>(primitiveBounds.size());
+	primitiveIndices.resize(primitiveCount);
+	std::vector<glm::vec3> centroids(primitiveCount);
+	for (uint32_t i = 0; i < primitiveCount; i++)
+	{
+		primitiveIndices[i] = i;
+		centroids[i] = (primitiveBounds[i].min + primitiveBounds[i].max) * 0.5f;
+	}
+
+	// A binary tree with one primitive per leaf at most has 2n - 1 nodes
+	nodes.clear();
+	nodes.reserve(std::max(1u, 2 * primitiveCount));
+
+	Node root = {};
+	root.bounds = EMPTY_AABB;
+	root.first = 0;
+	root.primitiveCount = primitiveCount;
+	nodes.push_back(root);
+
+	if (primitiveCount > 0)
+	{
+		subdivide(0, centroids);
+	}
+}
+
+void Bvh::refit(const std::vector<Aabb>& newBounds)
+{
+	primitiveBounds = newBounds;
+
+	// Children always come after their parent, so walking backwards sees both children of a node before the node itself
+	for (size_t i = nodes.size(); i-- > 0;)
+	{
+		Node& node = nodes[i];
+		node.bounds = EMPTY_AABB;
+
+		if (node.primitiveCount > 0)
+		{
+			for (uint32_t j = 0; j < node.primitiveCount; j++)
+			{
+				grow(node.bounds, primitiveBounds[primitiveIndices[node.first + j]]);
+			}
+		}
+		else if (!primitiveBounds.empty())
+		{
+			grow(node.bounds, nodes[node.first].bounds);
+			grow(node.bounds, nodes[node.first + 1].bounds);
+		}
+	}
+}
+
+void Bvh::cullFrustum(const std::array<glm::vec4, 6>& planes, std::vector<uint32_t>& results) const
+{
+	if (primitiveBounds.empty())
+	{
+		return;
+	}
+
+	// One bit per plane the subtree still has to be tested against
+	cullNode(0, planes, (1u << planes.size()) - 1, results);
+}
+
+void Bvh::querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& results) const
+{
+	if (primitiveBounds.empty())
+	{
+		return;
+	}
+
+	// Closest point of a box to the center, the box overlaps when it's within the radius
+	auto overlaps = [&center, radius](const Aabb& box)
+	{
+		glm::vec3 closest = glm::clamp(center, box.min, box.max);
+		glm::vec3 offset = closest - center;
+		return glm::dot(offset, offset) <= radius * radius;
+	};
+
+	// Nodes are visited depth first through an explicit stack
+	std::vector<uint32_t> stack = { 0 };
+	while (!stack.empty())
+	{
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!overlaps(node.bounds))
+		{
+			continue;
+		}
+
+		if (node.primitiveCount == 0)
+		{
+			stack.push_back(node.first);
+			stack.push_back(node.first + 1);
+			continue;
+		}
+
+		for (uint32_t j = 0; j < node.primitiveCount; j++)
+		{
+			uint32_t primitive = primitiveIndices[node.first + j];
+			if (overlaps(primitiveBounds[primitive]))
+			{
+				results.push_back(primitive);
+			}
+		}
+	}
+}
+
+void Bvh::queryBox(const Aabb& box, std::vector<uint32_t>& results) const
+{
+	if (primitiveBounds.empty())
+	{
+		return;
+	}
+
+	auto overlaps = [&box](const Aabb& other)
+	{
+		return glm::all(glm::lessThanEqual(box.min, other.max)) && glm::all(glm::lessThanEqual(other.min, box.max));
+	};
+
+	std::vector<uint32_t> stack = { 0 };
+	while (!stack.empty())
+	{
+		const Node& node = nodes[stack.back()];
+		stack.pop_back();
+
+		if (!overlaps(node.bounds))
+		{
+			continue;
+		}
+
+		if (node.primitiveCount == 0)
+		{
+			stack.push_back(node.first);
+			stack.push_back(node.first + 1);
+			continue;
+		}
+
+		for (uint32_t j = 0; j < node.primitiveCount; j++)
+		{
+			uint32_t primitive = primitiveIndices[node.first + j];
+			if (overlaps(primitiveBounds[primitive]))
+			{
+				results.push_back(primitive);
+			}
+		}
+	}
+}
+
+void Bvh::subdivide(uint32_t nodeIndex, const std::vector<glm::vec3>& centroids)
+{
+	uint32_t first = nodes[nodeIndex].first;
+	uint32_t count = nodes[nodeIndex].primitiveCount;
+
+	// Bounds of the primitives and of their centroids (splits happen along the centroids)
+	Aabb bounds = EMPTY_AABB;
+	Aabb centroidBounds = EMPTY_AABB;
+	for (uint32_t i = first; i < first + count; i++)
+	{
+		grow(bounds, primitiveBounds[primitiveIndices[i]]);
+		grow(centroidBounds, { centroids[primitiveIndices[i]], centroids[primitiveIndices[i]] });
+	}
+	nodes[nodeIndex].bounds = bounds;
+
+	if (count == 1)
+	{
+		return;
+	}
+
+	// Binned SAH: cost of a split is the primitives on each side weighted by the area of that side's box
+	struct Bin {
+		Aabb bounds;
+		uint32_t count;
+	};
+
+	float bestCost = FLT_MAX;
+	int bestAxis = -1;
+	uint32_t bestSplit = 0; // Bins below it go left
+
+	for (int axis = 0; axis < 3; axis++)
+	{
+		float extent = centroidBounds.max[axis] - centroidBounds.min[axis];
+		if (extent <= 0.0f)
+		{
+			continue;
+		}
+
+		std::array<Bin, SAH_BINS> bins;
+		bins.fill({ EMPTY_AABB, 0 });
+
+		float binScale = SAH_BINS / extent;
+		for (uint32_t i = first; i < first + count; i++)
+		{
+			uint32_t primitive = primitiveIndices[i];
+			uint32_t bin = std::min(SAH_BINS - 1, static_cast<uint32_t>((centroids[primitive][axis] - centroidBounds.min[axis]) * binScale));
+			grow(bins[bin].bounds, primitiveBounds[primitive]);
+			bins[bin].count++;
+		}
+
+		// Sweep from the left, then from the right, to get both sides of every split plane
+		std::array<float, SAH_BINS - 1> leftAreas;
+		std::array<uint32_t, SAH_BINS - 1> leftCounts;
+		Aabb leftBox = EMPTY_AABB;
+		uint32_t leftCount = 0;
+		for (uint32_t split = 0; split < SAH_BINS - 1; split++)
+		{
+			grow(leftBox, bins[split].bounds);
+			leftCount += bins[split].count;
+			leftAreas[split] = leftCount > 0 ? surfaceArea(leftBox) : 0.0f;
+			leftCounts[split] = leftCount;
+		}
+
+		Aabb rightBox = EMPTY_AABB;
+		uint32_t rightCount = 0;
+		for (uint32_t split = SAH_BINS - 1; split > 0; split--)
+		{
+			grow(rightBox, bins[split].bounds);
+			rightCount += bins[split].count;
+
+			if (leftCounts[split - 1] == 0 || rightCount == 0)
+			{
+				continue;
+			}
+
+			float cost = leftCounts[split - 1] * leftAreas[split - 1] + rightCount * surfaceArea(rightBox);
+			if (cost < bestCost)
+			{
+				bestCost = cost;
+				bestAxis = axis;
+				bestSplit = split;
+			}
+		}
+	}
+
+	// Splitting costs a traversal step, keep small nodes whole when that's cheaper than testing both children
+	float leafCost = count * surfaceArea(bounds);
+	float splitCost = bestCost + SAH_TRAVERSAL_COST * surfaceArea(bounds);
+	if (count <= MAX_LEAF_PRIMITIVES && (bestAxis < 0 || splitCost >= leafCost))
+	{
+		return;
+	}
+
+	uint32_t middle;
+	if (bestAxis >= 0)
+	{
+		float binScale = SAH_BINS / (centroidBounds.max[bestAxis] - centroidBounds.min[bestAxis]);
+		float axisMin = centroidBounds.min[bestAxis];
+		auto goesLeft = [&centroids, bestAxis, bestSplit, binScale, axisMin](uint32_t primitive)
+		{
+			return std::min(SAH_BINS - 1, static_cast<uint32_t>((centroids[primitive][bestAxis] - axisMin) * binScale)) < bestSplit;
+		};
+		middle = static_cast<uint32_t>(std::partition(primitiveIndices.begin() + first, primitiveIndices.begin() + first + count, goesLeft) -
+			primitiveIndices.begin());
+	}
+	else
+	{
+		// Every centroid in the same spot, no plane separates them: split the run in half so leaves stay small
+		middle = first + count / 2;
+	}
+
+	uint32_t leftChild = static_cast<uint32_t>(nodes.size());
+	Node left = {};
+	left.first = first;
+	left.primitiveCount = middle - first;
+	Node right = {};
+	right.first = middle;
+	right.primitiveCount = first + count - middle;
+	nodes.push_back(left);
+	nodes.push_back(right);
+
+	nodes[nodeIndex].first = leftChild;
+	nodes[nodeIndex].primitiveCount = 0;
+
+	subdivide(leftChild, centroids);
+	subdivide(leftChild + 1, centroids);
+}
+
+void Bvh::cullNode(uint32_t nodeIndex, const std::array<glm::vec4, 6>& planes, uint32_t planeMask, std::vector<uint32_t>& results) const
+{
+	const Node& node = nodes[nodeIndex];
+
+	// Classify the box against the planes the parent wasn't already fully inside of
+	glm::vec3 center = (node.bounds.min + node.bounds.max) * 0.5f;
+	glm::vec3 extents = (node.bounds.max - node.bounds.min) * 0.5f;
+	for (uint32_t i = 0; i < planes.size(); i++)
+	{
+		if (!(planeMask & (1u << i)))
+		{
+			continue;
+		}
+
+		float distance = glm::dot(glm::vec3(planes[i]), center) + planes[i].w;
+		float reach = glm::dot(glm::abs(glm::vec3(planes[i])), extents);
+		if (distance + reach < 0.0f)
+		{
+			return; // Whole subtree behind the plane
+		}
+		if (distance - reach >= 0.0f)
+		{
+			planeMask &= ~(1u << i); // Whole subtree in front, children don't need this plane
+		}
+	}
+
+	if (planeMask == 0)
+	{
+		appendSubtree(nodeIndex, results);
+		return;
+	}
+
+	if (node.primitiveCount == 0)
+	{
+		cullNode(node.first, planes, planeMask, results);
+		cullNode(node.first + 1, planes, planeMask, results);
+		return;
+	}
+
+	for (uint32_t j = 0; j < node.primitiveCount; j++)
+	{
+		uint32_t primitive = primitiveIndices[node.first + j];
+		const Aabb& box = primitiveBounds[primitive];
+		glm::vec3 primitiveCenter = (box.min + box.max) * 0.5f;
+		glm::vec3 primitiveExtents = (box.max - box.min) * 0.5f;
+
+		bool visible = true;
+		for (uint32_t i = 0; i < planes.size() && visible; i++)
+		{
+			if (planeMask & (1u << i))
+			{
+				visible = glm::dot(glm::vec3(planes[i]), primitiveCenter) + planes[i].w + glm::dot(glm::abs(glm::vec3(planes[i])), primitiveExtents) >= 0.0f;
+			}
+		}
+
+		if (visible)
+		{
+			results.push_back(primitive);
+		}
+	}
+}
+
+void Bvh::appendSubtree(uint32_t nodeIndex, std::vector<uint32_t>& results) const
+{
+	const Node& node = nodes[nodeIndex];
+	if (node.primitiveCount == 0)
+	{
+		appendSubtree(node.first, results);
+		appendSubtree(node.first + 1, results);
+		return;
+	}
+
+	results.insert(results.end(), primitiveIndices.begin() + node.first, primitiveIndices.begin() + node.first + node.primitiveCount);
+}
+
+float Bvh::surfaceArea(const Aabb& box)
+{
+	glm::vec3 size = box.max - box.min;
+	return 2.0f * (size.x * size.y + size.y * size.z + size.z * size.x);
+}
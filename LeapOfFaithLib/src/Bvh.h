@@ -0,0 +1,61 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+// Axis aligned box in world space
+struct Aabb {
+	glm::vec3 min;
+	glm::vec3 max;
+};
+
+// Bounding volume hierarchy over a set of boxes (primitive i is element i of the bounds given to build).
+// Built top-down with the surface area heuristic, then kept up to date with refits while the primitives move,
+// so the tree shape only gets rebuilt when primitives are added or removed.
+// Nodes live in one array, the children of a node sit next to each other after it
+class Bvh
+{
+public:
+	// Primitives per leaf above which a split is always made, even when the heuristic says it doesn't pay off
+	static const uint32_t MAX_LEAF_PRIMITIVES = 8;
+	// Centroid bins tested per axis when looking for the cheapest split
+	static const uint32_t SAH_BINS = 16;
+	// Cost of visiting a node relative to testing one primitive
+	static constexpr float SAH_TRAVERSAL_COST = 1.0f;
+
+	void build(const std::vector<Aabb>& newBounds);
+
+	// Same primitives with new bounds, grows every node to fit them again (the tree shape stays as built)
+	void refit(const std::vector<Aabb>& newBounds);
+
+	// Appends every primitive whose box isn't fully behind one of the planes (normals pointing inside),
+	// subtrees completely outside are skipped and subtrees completely inside are taken without further tests
+	void cullFrustum(const std::array<glm::vec4, 6>& planes, std::vector<uint32_t>& results) const;
+
+	// Appends every primitive whose box overlaps the sphere/box
+	void querySphere(const glm::vec3& center, float radius, std::vector<uint32_t>& results) const;
+	void queryBox(const Aabb& box, std::vector<uint32_t>& results) const;
+
+	inline uint32_t getPrimitiveCount() const { return static_cast<uint32_t>(primitiveBounds.size()); }
+	inline uint32_t getNodeCount() const { return static_cast<uint32_t>(nodes.size()); }
+private:
+	struct Node {
+		Aabb bounds;
+		uint32_t first; // Leaf: first element of primitiveIndices, interior: left child (right child is first + 1)
+		uint32_t primitiveCount; // 0 for interior nodes
+	};
+
+	std::vector<Node> nodes; // Root first
+	std::vector<uint32_t> primitiveIndices; // Leaves own consecutive runs of it
+	std::vector<Aabb> primitiveBounds;
+
+	void subdivide(uint32_t nodeIndex, const std::vector<glm::vec3>& centroids);
+	void cullNode(uint32_t nodeIndex, const std::array<glm::vec4, 6>& planes, uint32_t planeMask, std::vector<uint32_t>& results) const;
+	void appendSubtree(uint32_t nodeIndex, std::vector<uint32_t>& results) const;
+
+	static float surfaceArea(const Aabb& box);
+};
@@ -1,5 +1,9 @@
 #pragma once
 
+#include <cstdint>
+#include <string>
+#include <glm/mat4x4.hpp>
+#include <glm/vec4.hpp>
 #include <glm/vec2.hpp>
 #include <glm/vec3.hpp>
 
@@ -9,3 +13,62 @@ struct Vertex {
 	glm::vec3 col; // Vertex Color (r,g,b)
 	glm::vec2 tex; // Texture coords (u,v)
 };
+
+// Node of a model's hierarchy as the resource compiler writes it, parents always come before their children
+struct ModelNode {
+	int32_t parent; // -1 for the root
+	glm::mat4 localTransform; // Relative to the parent
+	uint32_t firstMesh; // The node's meshes are consecutive in the model's mesh list
+	uint32_t meshCount;
+	std::string name;
+};
+
+// Per-object data the vertex shader reads from the object buffer, rewritten every frame
+struct ObjectData {
+	glm::mat4 model;
+};
+
+// Per-instance data the vertex shader fetches through gl_InstanceIndex, written by the culling stage every frame:
+// the visible instances of a draw are packed from its firstInstance on, so one instanced command covers all of them
+struct InstanceData {
+	uint32_t objectIndex; // Element of the object buffer holding the instance's transform
+	uint32_t textureId; // Element of the bindless texture array
+};
+
+// Per-instance input of the culling compute pass, one element per instance of every draw (draws in queue order).
+// std430 rounds the struct to the 16 bytes of the vec4, hence the padding
+struct CullData {
+	glm::vec4 boundingSphere; // Center in object space (xyz) and radius (w)
+	uint32_t indexCount; // Command fields the pass copies into the indirect buffer for draws with a visible instance
+	uint32_t firstIndex;
+	int32_t vertexOffset;
+	uint32_t objectIndex; // Element of the object buffer holding the instance's transform
+	uint32_t drawIndex; // Command whose instance count the survivor increments
+	uint32_t firstInstance; // Where the draw's visible instances start in the instance data
+	uint32_t textureId;
+	uint32_t padding;
+};
+
+// Draws a culling dispatch handles
+enum CullPhase : uint32_t {
+	CULL_PHASE_ALL = 0, // Frustum only, no occlusion culling
+	CULL_PHASE_EARLY = 1, // Instances visible last frame, drawn first to fill the depth buffer
+	CULL_PHASE_LATE = 2 // Instances not hidden behind the depth pyramid of the early ones, records visibility for the next frame
+};
+
+// Push constants of the culling compute pass
+struct CullParams {
+	uint32_t instanceCount; // Instances of every draw in the queue, one invocation each
+	uint32_t phase; // CullPhase
+	uint32_t visibilityKey; // Value marking an instance visible in the visibility buffer, changes with the scene
+	uint32_t commandOffset; // First command and instance of this phase in the indirect and instance buffers
+	uint32_t instanceOffset;
+	uint32_t padding; // std430 puts the vec2 on an 8 byte boundary
+	glm::vec2 pyramidSize; // Size of the depth pyramid's first level in texels
+};
+
+// Push constants of the depth pyramid reduction
+struct DepthReduceParams {
+	glm::uvec2 inputSize;
+	glm::uvec2 outputSize;
+};
@@ -0,0 +1,46 @@
+#include "DeletionQueue.h"
+
+void DeletionQueue::push(std::function<void()>&& deleter)
+{
+	deleters[currentFrame].push_back(std::move(deleter));
+}
+
+void DeletionQueue::flush(uint32_t frameIndex)
+{
+	// Deleters may push more work (a model releasing its textures), that lands in this frame's fresh list
+	running.swap(deleters[frameIndex]);
+	currentFrame = frameIndex;
+
+	// Run in push order, so resources built on top of others can be released before them
+	for (std::function<void()>& deleter : running)
+	{
+		deleter();
+	}
+	running.clear();
+}
+
+void DeletionQueue::flushAll()
+{
+	// Keep going while deleters push more work, oldest frame first (the one after the latest recorded)
+	bool empty = false;
+	while (!empty)
+	{
+		empty = true;
+		for (int i = 1; i <= MAX_FRAME_DRAWS; i++)
+		{
+			uint32_t frameIndex = (currentFrame + i) % MAX_FRAME_DRAWS;
+			if (deleters[frameIndex].empty())
+			{
+				continue;
+			}
+
+			empty = false;
+			running.swap(deleters[frameIndex]);
+			for (std::function<void()>& deleter : running)
+			{
+				deleter();
+			}
+			running.clear();
+		}
+	}
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <array>
+#include <functional>
+#include <vector>
+
+#include "Utilities/Vulkan.h"
+
+// Resources the frames in flight may still reference, released once the GPU is done with them instead of waiting for the device to go idle.
+// Deleters are kept in one list per frame in flight: whatever gets pushed while a frame is the latest one recorded
+// runs the next time that frame's fence has been waited on, as every submission up to it has finished by then
+class DeletionQueue
+{
+public:
+	void push(std::function<void()>&& deleter);
+
+	// Called right after waiting on the fence of frameIndex: runs what was queued the last time it was recorded,
+	// pushes from now on belong to it
+	void flush(uint32_t frameIndex);
+
+	// Runs every deleter left, only once the device is idle
+	void flushAll();
+private:
+	uint32_t currentFrame = 0;
+	std::array<std::vector<std::function<void()>>, MAX_FRAME_DRAWS> deleters;
+	std::vector<std::function<void()>> running; // List being flushed
+};
@@ -5,11 +5,29 @@
 
 #include "Engine.h"
 
+#include <algorithm>
+#include <cmath>
 #include <fstream>
+#include <iostream>
+#include <vector>
 
+#include "Benchmarks.h"
 #include "VulkanRenderer.h"
+#include "Utilities/Allocations.h"
 #include "nlohmann/json.hpp"
 
+// Frames the allocation check lets through before expecting the loop to be allocation free (textures streaming in, first recordings, ...)
+const uint64_t ALLOCATION_CHECK_WARMUP_FRAMES = 600;
+
+// Copies of the model the allocation check runs with at least, enough for every per-entity pass to be split across the workers
+const int ALLOCATION_CHECK_MIN_INSTANCES = 4096;
+
+// Frames between two CPU culling reports
+const uint64_t CULLING_STATS_INTERVAL_FRAMES = 300;
+
+// Distance between two copies of the model when more instances are asked for
+const float INSTANCE_SPACING = 8.0f;
+
 GLFWwindow* window;
 VulkanRenderer vulkanRenderer;
 
@@ -22,40 +40,143 @@ int Engine::start()
 	// Create Window
 	initWindow("Leap Of Faith", config["width"], config["height"]);
 
+	// Renderer tunables
+	RendererSettings rendererSettings;
+	rendererSettings.textureBudget = config.value("textureBudgetMB", 0ull) * 1024 * 1024;
+	std::string culling = config.value("culling", std::string("gpu"));
+	rendererSettings.culling = culling == "cpu" ? CullingMode::Cpu : culling == "bvh" ? CullingMode::Bvh : CullingMode::Gpu;
+	rendererSettings.occlusionCulling = config.value("occlusionCulling", false);
+	rendererSettings.pipelineCacheFile = config.value("pipelineCache", rendererSettings.pipelineCacheFile);
+
 	// Create renderer instance
-	if (vulkanRenderer.init(window) == EXIT_FAILURE)
+	if (vulkanRenderer.init(window, rendererSettings) == EXIT_FAILURE)
 	{
 		return EXIT_FAILURE;
 	}
 
-	float angle = 0.0f;
+	// Optional micro benchmarks, need a live device so they run after the renderer is up
+	if (config.value("benchmark", false))
+	{
+		Benchmarks::uniformUpdates(100000);
+		Benchmarks::frustumCulling(1000, 100);
+		Benchmarks::frustumCulling(10000, 100);
+		Benchmarks::frustumCulling(100000, 100);
+	}
+
 	float deltaTime = 0.0f;
 	float lastTime = 0.0f;
 	
+	// Debug builds can verify the steady-state frame loop doesn't touch the heap, the run fails on the first frame that does
+	bool allocationCheck = config.value("allocationCheck", false) && Utilities::Allocations::isTracking();
+
 	int helicopter = vulkanRenderer.createMeshModel(config["model"].get<std::string>().c_str());
 
+	// Copies go on a square grid from the origin backwards, all of them drawn with one call per mesh.
+	// Each one spins upright around the vertical axis, the animation system rebuilds their transforms every frame
+	Scene& scene = vulkanRenderer.getScene();
+	int instanceCount = std::max(1, config.value("instances", 1));
+	if (allocationCheck)
+	{
+		instanceCount = std::max(instanceCount, ALLOCATION_CHECK_MIN_INSTANCES);
+	}
+	int gridSize = static_cast<int>(std::ceil(std::sqrt(static_cast<float>(instanceCount))));
+	std::vector<Entity> instances(instanceCount);
+	for (int i = 0; i < instanceCount; i++)
+	{
+		Entity entity = vulkanRenderer.createInstance(helicopter, glm::mat4(1.0f));
+		if (entity.isNull())
+		{
+			std::cerr << "Object buffer is full, only " << i << " instances were created" << std::endl;
+			instances.resize(i);
+			break;
+		}
+		instances[i] = entity;
+		scene.addComponents(entity, COMPONENT_SPIN);
+
+		Spin& spin = scene.getSpin(entity);
+		spin.base = glm::rotate(glm::mat4(1.0f), glm::radians(-90.f), glm::vec3(1.0f, 0.0f, 0.0f));
+		spin.position = glm::vec3((i % gridSize) * INSTANCE_SPACING, 0.0f, -(i / gridSize) * INSTANCE_SPACING);
+		spin.axis = glm::vec3(0.0f, 1.0f, 0.0f);
+		spin.degreesPerSecond = 10.0f;
+	}
+
+	// Nodes of the model turning on their own (rotor heads, ...), same angle on every copy
+	struct AnimatedNode {
+		uint32_t node;
+		glm::vec3 axis;
+		float degreesPerSecond;
+		float angle;
+	};
+	std::vector<AnimatedNode> animatedNodes;
+	for (const nlohmann::json& animatedNode : config.value("animatedNodes", nlohmann::json::array()))
+	{
+		uint32_t node = vulkanRenderer.getMeshModel(helicopter).findNode(animatedNode["name"].get<std::string>());
+		if (node == MeshModel::NO_NODE)
+		{
+			std::cerr << "Model has no node named " << animatedNode["name"] << std::endl;
+			continue;
+		}
+
+		std::vector<float> axis = animatedNode.value("axis", std::vector<float>{ 0.0f, 1.0f, 0.0f });
+		animatedNodes.push_back({ node, glm::vec3(axis[0], axis[1], axis[2]), animatedNode.value("degreesPerSecond", 360.0f), 0.0f });
+	}
+
+	uint64_t frameCount = 0;
+	int exitCode = EXIT_SUCCESS;
+
 	// Loop
 	while (!glfwWindowShouldClose(window))
 	{
+		Utilities::Allocations::Counters frameStart = Utilities::Allocations::getCounters();
+
 		glfwPollEvents();
 
 		float now = glfwGetTime();
 		deltaTime = now - lastTime;
 		lastTime = now;
 
-		angle += 10.0 * deltaTime;
-		if (angle > 360.0f) { angle -= 360.0f; }
+		scene.animate(deltaTime);
+
+		for (AnimatedNode& animatedNode : animatedNodes)
+		{
+			animatedNode.angle = std::fmod(animatedNode.angle + animatedNode.degreesPerSecond * deltaTime, 360.0f);
 
-		glm::mat4 testMat = glm::rotate(glm::mat4(1.0f), glm::radians(angle), glm::vec3(0.0f, 1.0f, 0.0f));
-		testMat = glm::rotate(testMat, glm::radians(-90.f), glm::vec3(1.0f, 0.0f, 0.0f));
-		vulkanRenderer.updateModel(helicopter, testMat);
+			// On top of the pose the node was loaded in
+			glm::mat4 local = vulkanRenderer.getMeshModel(helicopter).getNode(animatedNode.node).localTransform *
+				glm::rotate(glm::mat4(1.0f), glm::radians(animatedNode.angle), animatedNode.axis);
+			for (Entity entity : instances)
+			{
+				vulkanRenderer.setNodeTransform(entity, animatedNode.node, local);
+			}
+		}
 
 		vulkanRenderer.draw();
+
+		Utilities::Allocations::Counters frameEnd = Utilities::Allocations::getCounters();
+		uint64_t frameAllocations = frameEnd.count - frameStart.count;
+		frameCount++;
+
+		if (rendererSettings.culling != CullingMode::Gpu && frameCount % CULLING_STATS_INTERVAL_FRAMES == 0)
+		{
+			const CullingStats& cullingStats = vulkanRenderer.getCullingStats();
+			std::cout << "CPU culling: " << cullingStats.visible << " visible, " << cullingStats.culled << " culled, "
+			          << cullingStats.milliseconds << " ms" << std::endl;
+		}
+
+		if (allocationCheck && frameCount > ALLOCATION_CHECK_WARMUP_FRAMES && frameAllocations > 0)
+		{
+			std::cerr << "Allocation check failed: frame " << frameCount << " made " << frameAllocations << " heap allocations ("
+			          << frameEnd.bytes - frameStart.bytes << " bytes)" << std::endl;
+			exitCode = EXIT_FAILURE;
+			break;
+		}
 	}
 
 	vulkanRenderer.cleanup();
 	glfwDestroyWindow(window);
 	glfwTerminate();
+
+	return exitCode;
 }
 
 void Engine::initWindow(const char* wName, const int width, const int height)
@@ -65,7 +186,7 @@ void Engine::initWindow(const char* wName, const int width, const int height)
 
 	// Set GLFW to NOT work with OpenGL
 	glfwWindowHint(GLFW_CLIENT_API, GLFW_NO_API);
-	glfwWindowHint(GLFW_RESIZABLE, GLFW_FALSE);
+	glfwWindowHint(GLFW_RESIZABLE, GLFW_TRUE);
 
 	window = glfwCreateWindow(width, height, wName, nullptr, nullptr);
 }
@@ -0,0 +1,181 @@
+#include "FrustumCuller.h"
+
+#include <cmath>
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#endif
+
+#include <glm/geometric.hpp>
+
+// Volumes tested per iteration, the SSE path does them as two halves
+const uint32_t CULL_LANES = 8;
+
+// The library is built for any x64 CPU, only the AVX2 path itself is compiled for AVX2 and picked at runtime
+#ifdef _MSC_VER
+#define TARGET_AVX2
+#else
+#define TARGET_AVX2 __attribute__((target("avx2")))
+#endif
+
+namespace
+{
+	// Component arrays of the volumes, padded to CULL_LANES
+	struct VolumeArrays
+	{
+		const float* centersX;
+		const float* centersY;
+		const float* centersZ;
+		const float* radii;
+		const float* extentsX;
+		const float* extentsY;
+		const float* extentsZ;
+	};
+
+	// AVX2 needs the CPU to have it and the OS to save the ymm registers on context switches
+	bool hasAvx2()
+	{
+#ifdef _MSC_VER
+		int info[4];
+		__cpuid(info, 0);
+		if (info[0] < 7)
+		{
+			return false;
+		}
+		__cpuid(info, 1);
+		bool avx = (info[2] & (1 << 28)) != 0;
+		bool osSavesYmm = (info[2] & (1 << 27)) != 0 && (_xgetbv(0) & 0x6) == 0x6; // OSXSAVE, then xmm and ymm state enabled
+		__cpuidex(info, 7, 0);
+		return avx && osSavesYmm && (info[1] & (1 << 5)) != 0;
+#else
+		__builtin_cpu_init();
+		return __builtin_cpu_supports("avx2");
+#endif
+	}
+
+	// Bit per volume of the block starting at first that is in front of every plane
+	TARGET_AVX2 uint32_t cullBlockAvx2(const VolumeArrays& volumes, uint32_t first, const std::array<glm::vec4, 6>& planes)
+	{
+		__m256 centerX = _mm256_loadu_ps(&volumes.centersX[first]);
+		__m256 centerY = _mm256_loadu_ps(&volumes.centersY[first]);
+		__m256 centerZ = _mm256_loadu_ps(&volumes.centersZ[first]);
+		__m256 radius = _mm256_loadu_ps(&volumes.radii[first]);
+		__m256 extentX = _mm256_loadu_ps(&volumes.extentsX[first]);
+		__m256 extentY = _mm256_loadu_ps(&volumes.extentsY[first]);
+		__m256 extentZ = _mm256_loadu_ps(&volumes.extentsZ[first]);
+
+		__m256 inside = _mm256_castsi256_ps(_mm256_set1_epi32(-1));
+		for (const glm::vec4& plane : planes)
+		{
+			__m256 distance = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(centerX, _mm256_set1_ps(plane.x)), _mm256_mul_ps(centerY, _mm256_set1_ps(plane.y))),
+			                                _mm256_add_ps(_mm256_mul_ps(centerZ, _mm256_set1_ps(plane.z)), _mm256_set1_ps(plane.w)));
+			__m256 boxExtent = _mm256_add_ps(_mm256_add_ps(_mm256_mul_ps(extentX, _mm256_set1_ps(std::abs(plane.x))), _mm256_mul_ps(extentY, _mm256_set1_ps(std::abs(plane.y)))),
+			                                 _mm256_mul_ps(extentZ, _mm256_set1_ps(std::abs(plane.z))));
+			__m256 reach = _mm256_min_ps(radius, boxExtent);
+			inside = _mm256_and_ps(inside, _mm256_cmp_ps(_mm256_add_ps(distance, reach), _mm256_setzero_ps(), _CMP_GE_OQ));
+		}
+		return static_cast<uint32_t>(_mm256_movemask_ps(inside));
+	}
+
+	// Same as cullBlockAvx2 for the 4 volumes starting at first
+	uint32_t cullHalfBlockSse(const VolumeArrays& volumes, uint32_t first, const std::array<glm::vec4, 6>& planes)
+	{
+		__m128 centerX = _mm_loadu_ps(&volumes.centersX[first]);
+		__m128 centerY = _mm_loadu_ps(&volumes.centersY[first]);
+		__m128 centerZ = _mm_loadu_ps(&volumes.centersZ[first]);
+		__m128 radius = _mm_loadu_ps(&volumes.radii[first]);
+		__m128 extentX = _mm_loadu_ps(&volumes.extentsX[first]);
+		__m128 extentY = _mm_loadu_ps(&volumes.extentsY[first]);
+		__m128 extentZ = _mm_loadu_ps(&volumes.extentsZ[first]);
+
+		__m128 inside = _mm_castsi128_ps(_mm_set1_epi32(-1));
+		for (const glm::vec4& plane : planes)
+		{
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(centerX, _mm_set1_ps(plane.x)), _mm_mul_ps(centerY, _mm_set1_ps(plane.y))),
+			                             _mm_add_ps(_mm_mul_ps(centerZ, _mm_set1_ps(plane.z)), _mm_set1_ps(plane.w)));
+			__m128 boxExtent = _mm_add_ps(_mm_add_ps(_mm_mul_ps(extentX, _mm_set1_ps(std::abs(plane.x))), _mm_mul_ps(extentY, _mm_set1_ps(std::abs(plane.y)))),
+			                              _mm_mul_ps(extentZ, _mm_set1_ps(std::abs(plane.z))));
+			__m128 reach = _mm_min_ps(radius, boxExtent);
+			inside = _mm_and_ps(inside, _mm_cmpge_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+		}
+		return static_cast<uint32_t>(_mm_movemask_ps(inside));
+	}
+}
+
+void FrustumCuller::resize(uint32_t newCount)
+{
+	count = newCount;
+
+	size_t paddedCount = (static_cast<size_t>(count) + CULL_LANES - 1) / CULL_LANES * CULL_LANES;
+	centersX.assign(paddedCount, 0.0f);
+	centersY.assign(paddedCount, 0.0f);
+	centersZ.assign(paddedCount, 0.0f);
+	radii.assign(paddedCount, 0.0f);
+	extentsX.assign(paddedCount, 0.0f);
+	extentsY.assign(paddedCount, 0.0f);
+	extentsZ.assign(paddedCount, 0.0f);
+}
+
+void FrustumCuller::setBounds(uint32_t index, const glm::vec3& center, float radius, const glm::vec3& extents)
+{
+	centersX[index] = center.x;
+	centersY[index] = center.y;
+	centersZ[index] = center.z;
+	radii[index] = radius;
+	extentsX[index] = extents.x;
+	extentsY[index] = extents.y;
+	extentsZ[index] = extents.z;
+}
+
+void FrustumCuller::cull(const glm::mat4& viewProjection, std::vector<uint32_t>& visibleList) const
+{
+	std::array<glm::vec4, 6> planes = extractPlanes(viewProjection);
+	VolumeArrays volumes = { centersX.data(), centersY.data(), centersZ.data(), radii.data(), extentsX.data(), extentsY.data(), extentsZ.data() };
+	static const bool useAvx2 = hasAvx2();
+
+	// For a volume in front of a plane its center is at least min(radius, box extent along the normal) away from it,
+	// the box extent along the normal is |nx| * ex + |ny| * ey + |nz| * ez
+	for (uint32_t first = 0; first < count; first += CULL_LANES)
+	{
+		uint32_t mask = useAvx2 ? cullBlockAvx2(volumes, first, planes) :
+			cullHalfBlockSse(volumes, first, planes) | (cullHalfBlockSse(volumes, first + 4, planes) << 4);
+
+		// Padding lanes past the last volume never count as visible
+		if (count - first < CULL_LANES)
+		{
+			mask &= (1u << (count - first)) - 1;
+		}
+
+		for (uint32_t lane = 0; mask != 0; lane++, mask >>= 1)
+		{
+			if (mask & 1)
+			{
+				visibleList.push_back(first + lane);
+			}
+		}
+	}
+}
+
+std::array<glm::vec4, 6> FrustumCuller::extractPlanes(const glm::mat4& viewProjection)
+{
+	// Rows of the matrix (glm is column major), clip space x, y, z against w gives each plane.
+	// The near plane is w + z, which also holds the whole frustum with a 0 to 1 depth range (just a bit further out)
+	glm::mat4 rows = glm::transpose(viewProjection);
+
+	std::array<glm::vec4, 6> planes = {
+		rows[3] + rows[0], // Left
+		rows[3] - rows[0], // Right
+		rows[3] + rows[1], // Bottom
+		rows[3] - rows[1], // Top
+		rows[3] + rows[2], // Near
+		rows[3] - rows[2]  // Far
+	};
+
+	// Normalised so distances come out in world units and compare with the radii
+	for (glm::vec4& plane : planes)
+	{
+		plane /= glm::length(glm::vec3(plane));
+	}
+
+	return planes;
+}
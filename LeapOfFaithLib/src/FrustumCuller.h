@@ -0,0 +1,48 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+#include <glm/vec4.hpp>
+
+// What the last culling pass did
+struct CullingStats {
+	uint32_t visible = 0;
+	uint32_t culled = 0;
+	double milliseconds = 0.0; // Bounds update plus the frustum test
+};
+
+// World space bounding volumes (sphere and box around the same center) kept one array per component,
+// so the frustum test loads the same component of 8 volumes at once (two halves of 4 on CPUs without AVX2).
+// A volume is visible unless one of the frustum planes has the whole sphere or the whole box behind it
+class FrustumCuller
+{
+public:
+	// Number of volumes, their bounds have to be set again afterwards
+	void resize(uint32_t newCount);
+
+	// Bounds of volume i, extents are the half size of the box along each world axis
+	void setBounds(uint32_t index, const glm::vec3& center, float radius, const glm::vec3& extents);
+
+	// Appends the index of every volume inside the frustum of viewProjection to visibleList (in increasing order)
+	void cull(const glm::mat4& viewProjection, std::vector<uint32_t>& visibleList) const;
+
+	// The six planes of the frustum (left, right, bottom, top, near, far), normalised with the normals pointing inside
+	static std::array<glm::vec4, 6> extractPlanes(const glm::mat4& viewProjection);
+
+	inline uint32_t size() const { return count; }
+private:
+	uint32_t count = 0;
+
+	// Arrays are padded to a multiple of the SIMD width, the padding lanes are masked out
+	std::vector<float> centersX;
+	std::vector<float> centersY;
+	std::vector<float> centersZ;
+	std::vector<float> radii;
+	std::vector<float> extentsX;
+	std::vector<float> extentsY;
+	std::vector<float> extentsZ;
+};
@@ -0,0 +1,174 @@
+#include "GeometryBuffer.h"
+
+#include <cstring>
+#include <stdexcept>
+
+#include "BufferPool.h"
+#include "Globals.h"
+#include "Utilities/Vulkan.h"
+
+void GeometryBuffer::create(uint32_t maxVertices, uint32_t maxIndices)
+{
+	vertexCapacity = maxVertices;
+	indexCapacity = maxIndices;
+	vertexCount = 0;
+	indexCount = 0;
+	freeVertexBlocks.clear();
+	freeIndexBlocks.clear();
+
+	// Both buffers live on the GPU only and are filled through staging copies
+	vertexBuffer = Globals::bufferPool->create(sizeof(Vertex) * vertexCapacity, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
+	                                          VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+
+	indexBuffer = Globals::bufferPool->create(sizeof(uint32_t) * indexCapacity, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
+	                                         VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
+}
+
+GeometryRange GeometryBuffer::upload(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices)
+{
+	// Reserve a free region of both buffers for this mesh
+	GeometryRange range = {};
+	range.vertexCount = static_cast<uint32_t>(vertices.size());
+	range.indexCount = static_cast<uint32_t>(indices.size());
+	uint32_t vertexOffset = allocateBlock(freeVertexBlocks, &vertexCount, vertexCapacity, range.vertexCount);
+	uint32_t firstIndex = vertexOffset == NO_SPACE ? NO_SPACE : allocateBlock(freeIndexBlocks, &indexCount, indexCapacity, range.indexCount);
+	if (firstIndex == NO_SPACE)
+	{
+		// Hand back the vertices taken already, the buffers stay as they were before the call
+		if (vertexOffset != NO_SPACE)
+		{
+			freeBlock(freeVertexBlocks, &vertexCount, vertexOffset, range.vertexCount);
+		}
+		throw std::runtime_error("Geometry buffer is out of space!");
+	}
+	range.vertexOffset = static_cast<int32_t>(vertexOffset);
+	range.firstIndex = firstIndex;
+
+	VkDeviceSize vertexDataSize = sizeof(Vertex) * vertices.size();
+	VkDeviceSize indexDataSize = sizeof(uint32_t) * indices.size();
+
+	// Single staging buffer holding vertices followed by indices
+	VkBuffer stagingBuffer;
+	VkDeviceMemory stagingBufferMemory;
+	Utilities::Vulkan::createBuffer(Globals::vkContext->physicalDevice, Globals::vkContext->logicalDevice, vertexDataSize + indexDataSize,
+	                                VK_BUFFER_USAGE_TRANSFER_SRC_BIT, VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT,
+	                                &stagingBuffer, &stagingBufferMemory);
+
+	void* data;
+	vkMapMemory(Globals::vkContext->logicalDevice, stagingBufferMemory, 0, vertexDataSize + indexDataSize, 0, &data);
+	memcpy(data, vertices.data(), static_cast<size_t>(vertexDataSize));
+	memcpy(static_cast<char*>(data) + vertexDataSize, indices.data(), static_cast<size_t>(indexDataSize));
+	vkUnmapMemory(Globals::vkContext->logicalDevice, stagingBufferMemory);
+
+	// Copy both regions in one submission
+	VkCommandBuffer transferCommandBuffer = Utilities::Vulkan::beginCommandBuffer(Globals::vkContext->logicalDevice, Globals::vkContext->graphicsCommandPool);
+
+	VkBufferCopy vertexCopyRegion = {};
+	vertexCopyRegion.srcOffset = 0;
+	vertexCopyRegion.dstOffset = sizeof(Vertex) * static_cast<VkDeviceSize>(range.vertexOffset);
+	vertexCopyRegion.size = vertexDataSize;
+	vkCmdCopyBuffer(transferCommandBuffer, stagingBuffer, Globals::bufferPool->getBuffer(vertexBuffer), 1, &vertexCopyRegion);
+
+	VkBufferCopy indexCopyRegion = {};
+	indexCopyRegion.srcOffset = vertexDataSize;
+	indexCopyRegion.dstOffset = sizeof(uint32_t) * static_cast<VkDeviceSize>(range.firstIndex);
+	indexCopyRegion.size = indexDataSize;
+	vkCmdCopyBuffer(transferCommandBuffer, stagingBuffer, Globals::bufferPool->getBuffer(indexBuffer), 1, &indexCopyRegion);
+
+	Utilities::Vulkan::endAndSubmitCommandBuffer(Globals::vkContext->logicalDevice, Globals::vkContext->graphicsCommandPool,
+	                                             Globals::vkContext->graphicsQueue, transferCommandBuffer);
+
+	// Destroy + release staging buffer resources
+	vkDestroyBuffer(Globals::vkContext->logicalDevice, stagingBuffer, nullptr);
+	vkFreeMemory(Globals::vkContext->logicalDevice, stagingBufferMemory, nullptr);
+
+	return range;
+}
+
+void GeometryBuffer::free(const GeometryRange& range)
+{
+	freeBlock(freeVertexBlocks, &vertexCount, static_cast<uint32_t>(range.vertexOffset), range.vertexCount);
+	freeBlock(freeIndexBlocks, &indexCount, range.firstIndex, range.indexCount);
+}
+
+void GeometryBuffer::bind(VkCommandBuffer commandBuffer) const
+{
+	VkBuffer vertexBuffers[] = { Globals::bufferPool->getBuffer(vertexBuffer) }; // Buffers to bind
+	VkDeviceSize offsets[] = { 0 }; // Meshes are addressed through vertexOffset/firstIndex, so always bind from the start
+	vkCmdBindVertexBuffers(commandBuffer, 0, 1, vertexBuffers, offsets);
+	vkCmdBindIndexBuffer(commandBuffer, Globals::bufferPool->getBuffer(indexBuffer), 0, VK_INDEX_TYPE_UINT32);
+}
+
+void GeometryBuffer::destroy()
+{
+	Globals::bufferPool->destroy(vertexBuffer);
+	Globals::bufferPool->destroy(indexBuffer);
+}
+
+uint32_t GeometryBuffer::allocateBlock(std::vector<FreeBlock>& freeBlocks, uint32_t* usedCount, uint32_t capacity, uint32_t count)
+{
+	for (size_t i = 0; i < freeBlocks.size(); i++)
+	{
+		if (freeBlocks[i].count < count)
+		{
+			continue;
+		}
+
+		// Take the front of the block, drop it once it's used up
+		uint32_t offset = freeBlocks[i].offset;
+		freeBlocks[i].offset += count;
+		freeBlocks[i].count -= count;
+		if (freeBlocks[i].count == 0)
+		{
+			freeBlocks.erase(freeBlocks.begin() + i);
+		}
+
+		return offset;
+	}
+
+	if (count > capacity - *usedCount)
+	{
+		return NO_SPACE;
+	}
+
+	uint32_t offset = *usedCount;
+	*usedCount += count;
+
+	return offset;
+}
+
+void GeometryBuffer::freeBlock(std::vector<FreeBlock>& freeBlocks, uint32_t* usedCount, uint32_t offset, uint32_t count)
+{
+	if (count == 0)
+	{
+		return;
+	}
+
+	// Keep the blocks sorted so neighbours sit next to each other
+	size_t i = 0;
+	while (i < freeBlocks.size() && freeBlocks[i].offset < offset)
+	{
+		i++;
+	}
+	freeBlocks.insert(freeBlocks.begin() + i, { offset, count });
+
+	// Merge with the next block, then with the previous one
+	if (i + 1 < freeBlocks.size() && freeBlocks[i].offset + freeBlocks[i].count == freeBlocks[i + 1].offset)
+	{
+		freeBlocks[i].count += freeBlocks[i + 1].count;
+		freeBlocks.erase(freeBlocks.begin() + i + 1);
+	}
+	if (i > 0 && freeBlocks[i - 1].offset + freeBlocks[i - 1].count == freeBlocks[i].offset)
+	{
+		freeBlocks[i - 1].count += freeBlocks[i].count;
+		freeBlocks.erase(freeBlocks.begin() + i);
+		i--;
+	}
+
+	// The last block touching the never used tail joins it
+	if (freeBlocks[i].offset + freeBlocks[i].count == *usedCount)
+	{
+		*usedCount = freeBlocks[i].offset;
+		freeBlocks.erase(freeBlocks.begin() + i);
+	}
+}
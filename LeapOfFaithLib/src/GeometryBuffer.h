@@ -0,0 +1,56 @@
+#pragma once
+
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "BufferPool.h"
+#include "DataStructures.h"
+
+// Location of a mesh's data inside the shared geometry buffers
+struct GeometryRange {
+	int32_t vertexOffset; // Value added to every index of the mesh (first vertex of the mesh)
+	uint32_t firstIndex; // First index of the mesh inside the index buffer
+	uint32_t indexCount; // Number of indices of the mesh
+	uint32_t vertexCount; // Number of vertices of the mesh
+};
+
+// One big vertex buffer and one big index buffer all static geometry is sub-allocated from,
+// so the renderer can bind them once and draw every mesh using offsets
+class GeometryBuffer
+{
+public:
+	void create(uint32_t maxVertices, uint32_t maxIndices);
+
+	// Throws when either buffer has no room left for the mesh
+	GeometryRange upload(const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices);
+
+	// Gives the space of a mesh back for later uploads, no frame in flight may be drawing it anymore
+	void free(const GeometryRange& range);
+
+	void bind(VkCommandBuffer commandBuffer) const;
+
+	void destroy();
+private:
+	// Unused run of elements inside one of the buffers
+	struct FreeBlock {
+		uint32_t offset;
+		uint32_t count;
+	};
+
+	BufferHandle vertexBuffer;
+	uint32_t vertexCapacity = 0;
+	uint32_t vertexCount = 0; // Elements below this were handed out at some point, the rest was never used
+	std::vector<FreeBlock> freeVertexBlocks; // Freed space below vertexCount, sorted by offset
+
+	BufferHandle indexBuffer;
+	uint32_t indexCapacity = 0;
+	uint32_t indexCount = 0;
+	std::vector<FreeBlock> freeIndexBlocks;
+
+	static const uint32_t NO_SPACE = UINT32_MAX;
+
+	// First fit in the freed blocks, else from the never used tail, NO_SPACE if neither has room
+	static uint32_t allocateBlock(std::vector<FreeBlock>& freeBlocks, uint32_t* usedCount, uint32_t capacity, uint32_t count);
+	// Merges with the neighbouring blocks, a block ending at the used count shrinks it instead
+	static void freeBlock(std::vector<FreeBlock>& freeBlocks, uint32_t* usedCount, uint32_t offset, uint32_t count);
+};
@@ -2,4 +2,7 @@
 
 namespace Globals {
 	VkContext* vkContext = new VkContext{};
+	Utilities::ThreadPool* threadPool = nullptr;
+	Utilities::ThreadPool* backgroundPool = nullptr;
+	BufferPool* bufferPool = nullptr;
 }
\ No newline at end of file
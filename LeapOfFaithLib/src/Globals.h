@@ -9,6 +9,13 @@ typedef VkQueue_T* VkQueue;
 struct VkCommandPool_T;
 typedef VkCommandPool_T* VkCommandPool;
 
+class BufferPool;
+
+namespace Utilities
+{
+	class ThreadPool;
+}
+
 namespace Globals
 {
 	struct VkContext {
@@ -19,4 +26,13 @@ namespace Globals
 	};
 
 	extern VkContext* vkContext;
+
+	// Worker threads splitting the frame's work (parallelFor), created by the renderer on init
+	extern Utilities::ThreadPool* threadPool;
+
+	// Threads for long running tasks (pipeline compiles, texture decoding, ...) so they never hold back the frame's work
+	extern Utilities::ThreadPool* backgroundPool;
+
+	// Long-lived buffers of the engine (geometry, per-frame data, ...), created by the renderer on init
+	extern BufferPool* bufferPool;
 }
\ No newline at end of file
@@ -0,0 +1,68 @@
+#include "Handle.h"
+
+#include <assert.h>
+
+// Handles of every pool share the same layout
+typedef Handle<void> AnyHandle;
+
+const uint32_t GENERATION_MASK = (1u << (32 - AnyHandle::INDEX_BITS)) - 1;
+
+uint32_t HandleAllocator::allocate()
+{
+	uint32_t index;
+	if (!freeIndices.empty())
+	{
+		// Reuse the most recently freed slot, its data is likely still in cache
+		index = freeIndices.back();
+		freeIndices.pop_back();
+	}
+	else
+	{
+		index = static_cast<uint32_t>(generations.size());
+		assert(index <= AnyHandle::INDEX_MASK && "Handle allocator is out of slots!");
+
+		generations.push_back(1);
+		slotUsed.push_back(0);
+	}
+
+	slotUsed[index] = 1;
+
+	return (generations[index] << AnyHandle::INDEX_BITS) | index;
+}
+
+void HandleAllocator::free(uint32_t handleValue)
+{
+	retire(handleValue);
+	recycle(handleValue & AnyHandle::INDEX_MASK);
+}
+
+void HandleAllocator::retire(uint32_t handleValue)
+{
+	assert(isValid(handleValue) && "Freeing an invalid handle!");
+
+	uint32_t index = handleValue & AnyHandle::INDEX_MASK;
+
+	// Every handle to the old contents of the slot goes stale, skip 0 when wrapping so no live handle is ever null
+	generations[index] = (generations[index] + 1) & GENERATION_MASK;
+	if (generations[index] == 0)
+	{
+		generations[index] = 1;
+	}
+
+	slotUsed[index] = 0;
+}
+
+void HandleAllocator::recycle(uint32_t index)
+{
+	assert(!slotUsed[index] && "Recycling a slot still in use!");
+
+	freeIndices.push_back(index);
+}
+
+bool HandleAllocator::isValid(uint32_t handleValue) const
+{
+	uint32_t index = handleValue & AnyHandle::INDEX_MASK;
+	uint32_t generation = handleValue >> AnyHandle::INDEX_BITS;
+
+	return index < generations.size() && slotUsed[index] && generations[index] == generation;
+}
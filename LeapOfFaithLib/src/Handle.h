@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+// 32-bit reference to a pooled resource: the low bits select the slot, the high bits hold the generation the slot
+// had when the handle was made, so handles to a freed (and maybe reused) slot can be told apart from live ones
+template <typename Tag>
+struct Handle {
+	static const uint32_t INDEX_BITS = 20;
+	static const uint32_t INDEX_MASK = (1u << INDEX_BITS) - 1;
+
+	uint32_t value = 0; // 0 is the null handle, generations start at 1
+
+	inline uint32_t getIndex() const { return value & INDEX_MASK; }
+	inline uint32_t getGeneration() const { return value >> INDEX_BITS; }
+	inline bool isNull() const { return value == 0; }
+
+	inline bool operator==(const Handle& other) const { return value == other.value; }
+	inline bool operator!=(const Handle& other) const { return value != other.value; }
+};
+
+// Hands out slots and keeps their generations, freed slots are reused in O(1) through a free list.
+// Pools keep their data in one array per field (SoA) indexed by the slot index of the handle.
+class HandleAllocator
+{
+public:
+	// Returns the value of a new handle, the slot index may be one past the current capacity (pools grow their arrays then)
+	uint32_t allocate();
+	void free(uint32_t handleValue);
+
+	// Two step free for slots the GPU may still reference: handles go stale right away, the slot is reused once recycled
+	void retire(uint32_t handleValue);
+	void recycle(uint32_t index);
+
+	bool isValid(uint32_t handleValue) const;
+	inline bool isSlotUsed(uint32_t index) const { return slotUsed[index] != 0; }
+
+	// Slots ever created, live or free
+	inline uint32_t getCapacity() const { return static_cast<uint32_t>(generations.size()); }
+private:
+	std::vector<uint32_t> generations;
+	std::vector<uint8_t> slotUsed;
+	std::vector<uint32_t> freeIndices;
+};
@@ -1,102 +0,0 @@
-#include "Mesh.h"
-#include "Utilities/Vulkan.h"
-
-Mesh::Mesh(VkPhysicalDevice newPhysicalDevice, VkDevice newDevice,
-           VkQueue transferQueue, VkCommandPool transferCommandPool,
-           std::vector<Vertex>* vertices, std::vector<uint32_t>* indices,
-           int newTexId)
-{
-	vertexCount = vertices->size();
-	indexCount = indices->size();
-	physicalDevice = newPhysicalDevice;
-	device = newDevice;
-	createVertexBuffer(transferQueue, transferCommandPool, vertices);
-	createIndexBuffer(transferQueue, transferCommandPool, indices);
-
-	model.model = glm::mat4(1.0f);
-	texId = newTexId;
-}
-
-void Mesh::setModel(glm::mat4 newModel)
-{
-	model.model = newModel;
-}
-
-VkBuffer Mesh::getVertexBuffer() const
-{
-	return vertexBuffer;
-}
-
-VkBuffer Mesh::getIndexBuffer() const
-{
-	return indexBuffer;
-}
-
-void Mesh::destroyBuffers()
-{
-	vkDestroyBuffer(device, vertexBuffer, nullptr);
-	vkFreeMemory(device, vertexBufferMemory, nullptr);
-	vkDestroyBuffer(device, indexBuffer, nullptr);
-	vkFreeMemory(device, indexBufferMemory, nullptr);
-}
-
-void Mesh::createVertexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<Vertex>* vertices)
-{
-	// Get size of buffer needed for vertices
-	VkDeviceSize bufferSize = sizeof(Vertex) * vertices->size();
-
-	// Temporary buffer to "state" vertex data before transferring to GPU
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-
-	// Create buffer and allocate memory to it
-	Utilities::Vulkan::createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-	                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
-
-	// MAP MEMORY TO VERTEX BUFFER
-	void* data;																// 1. Create pointer to a point in normal memory
-	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);		// 2. "Map" the vertex buffer memory to that point
-	memcpy(data, vertices->data(), (size_t)bufferSize);					// 3. Copy memory from vertices vector to the point
-	vkUnmapMemory(device, stagingBufferMemory);									// 4. Unmap the vertex buffer memory
-
-	// Create buffer with TRANSFER_DST_BIT to mark as recipient of transfer data (also VERTEX_BUFFER)
-	// Buffer memory is to be DEVICE_LOCAL_BIT meaning memory is on the GPU and only accesible by it and not CPU (host)
-	Utilities::Vulkan::createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_VERTEX_BUFFER_BIT,
-	                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &vertexBuffer, &vertexBufferMemory);
-
-	// Copy staging buffer to vertex buffer on GPU
-	Utilities::Vulkan::copyBuffer(device, transferQueue, transferCommandPool, stagingBuffer, vertexBuffer, bufferSize);
-
-	// Clean up staging buffer parts
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
-}
-
-void Mesh::createIndexBuffer(VkQueue transferQueue, VkCommandPool transferCommandPool, std::vector<uint32_t>* indices)
-{
-	// Get size of buffer needed for indices
-	VkDeviceSize bufferSize = sizeof(uint32_t) * indices->size();
-
-	// Temporary buffer to stage index data before transferring to GPU
-	VkBuffer stagingBuffer;
-	VkDeviceMemory stagingBufferMemory;
-	Utilities::Vulkan::createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_SRC_BIT,
-	                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &stagingBuffer, &stagingBufferMemory);
-
-	// MAP MEMORY TO INDEX BUFFER
-	void* data;															
-	vkMapMemory(device, stagingBufferMemory, 0, bufferSize, 0, &data);	
-	memcpy(data, indices->data(), (size_t)bufferSize);					
-	vkUnmapMemory(device, stagingBufferMemory);
-
-	// Create buffer for INDEX data on GPU access only area
-	Utilities::Vulkan::createBuffer(physicalDevice, device, bufferSize, VK_BUFFER_USAGE_TRANSFER_DST_BIT | VK_BUFFER_USAGE_INDEX_BUFFER_BIT,
-	                                VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &indexBuffer, &indexBufferMemory);
-
-	// Copy from staging buffer to GPU access buffer
-	Utilities::Vulkan::copyBuffer(device, transferQueue, transferCommandPool, stagingBuffer, indexBuffer, bufferSize);
-
-	// Destroy + release staging buffer resources
-	vkDestroyBuffer(device, stagingBuffer, nullptr);
-	vkFreeMemory(device, stagingBufferMemory, nullptr);
-}
@@ -1,39 +1,133 @@
 #include "MeshModel.h"
 #include "MeshReader.h"
 
+#include <algorithm>
+#include <cfloat>
+
+#include <glm/common.hpp>
+#include <glm/geometric.hpp>
+
 MeshModel::MeshModel()
 {
-	model = glm::mat4(1.0f);
 }
 
-void MeshModel::LoadFile(const char* modelFile,
-	std::vector<VkImage>& textureImages, std::vector<VkDeviceMemory>& textureImageMemory, std::vector<VkImageView>& textureImageViews,
-	VkDescriptorPool& samplerDescriptorPool, VkDescriptorSetLayout& samplerSetLayout, VkSampler& textureSampler, std::vector<VkDescriptorSet>& samplerDescriptorSets)
+void MeshModel::LoadFile(const char* modelFile, GeometryBuffer& geometryBuffer, MeshPool& meshPool, TextureManager& textureManager)
 {
 	// Load in all our meshes
-	std::vector<Mesh> meshList;
-	MeshReader::loadFromBinary(modelFile, meshList,
-		textureImages, textureImageMemory, textureImageViews, samplerDescriptorPool, samplerSetLayout, textureSampler, samplerDescriptorSets);
+	std::vector<MeshHandle> meshList;
+	std::vector<TextureHandle> textureList;
+	std::vector<ModelNode> nodeList;
+	try
+	{
+		MeshReader::loadFromBinary(modelFile, geometryBuffer, meshPool, meshList, textureList, nodeList, textureManager);
+	}
+	catch (...)
+	{
+		// Nothing draws the meshes and textures loaded before the error yet, give them back right away
+		for (MeshHandle mesh : meshList)
+		{
+			meshPool.destroy(mesh, geometryBuffer);
+		}
+		for (TextureHandle texture : textureList)
+		{
+			textureManager.removeTexture(texture);
+		}
+		throw;
+	}
 
 	this->meshList = meshList;
+	this->textureList = textureList;
+	this->nodeList = nodeList;
+
+	// Pose the file was loaded in, every node's transform relative to the model
+	std::vector<glm::mat4> nodeWorlds(nodeList.size());
+	meshNodes.assign(meshList.size(), 0);
+	for (size_t i = 0; i < nodeList.size(); i++)
+	{
+		const ModelNode& node = nodeList[i];
+		nodeWorlds[i] = node.parent < 0 ? node.localTransform : nodeWorlds[node.parent] * node.localTransform;
+
+		for (uint32_t k = node.firstMesh; k < node.firstMesh + node.meshCount; k++)
+		{
+			meshNodes[k] = static_cast<uint32_t>(i);
+		}
+	}
+
+	if (meshList.empty())
+	{
+		return;
+	}
+
+	// Box around the meshes' boxes, then a sphere around that center reaching every mesh's sphere
+	std::vector<glm::vec3> meshCenters(meshList.size());
+	std::vector<float> meshRadii(meshList.size());
+	glm::vec3 boundsMin = glm::vec3(FLT_MAX);
+	glm::vec3 boundsMax = glm::vec3(-FLT_MAX);
+	for (size_t k = 0; k < meshList.size(); k++)
+	{
+		const glm::mat4& world = nodeWorlds[meshNodes[k]];
+		MeshHandle mesh = meshList[k];
+
+		meshCenters[k] = glm::vec3(world * glm::vec4(meshPool.getBoundsCenter(mesh), 1.0f));
+		meshRadii[k] = meshPool.getBoundsRadius(mesh) * std::max({ glm::length(glm::vec3(world[0])), glm::length(glm::vec3(world[1])), glm::length(glm::vec3(world[2])) });
+		glm::vec3 objectExtents = meshPool.getBoundsExtents(mesh);
+		glm::vec3 extents = glm::abs(glm::vec3(world[0])) * objectExtents.x + glm::abs(glm::vec3(world[1])) * objectExtents.y +
+			glm::abs(glm::vec3(world[2])) * objectExtents.z;
+
+		boundsMin = glm::min(boundsMin, meshCenters[k] - extents);
+		boundsMax = glm::max(boundsMax, meshCenters[k] + extents);
+	}
+	boundsCenter = (boundsMin + boundsMax) * 0.5f;
+	boundsExtents = (boundsMax - boundsMin) * 0.5f;
+
+	boundsRadius = 0.0f;
+	for (size_t k = 0; k < meshList.size(); k++)
+	{
+		boundsRadius = std::max(boundsRadius, glm::distance(boundsCenter, meshCenters[k]) + meshRadii[k]);
+	}
 }
 
-Mesh* MeshModel::getMesh(size_t index)
+const ModelNode& MeshModel::getNode(size_t index) const
 {
-	assert(index < meshList.size() && "Attempted to access invalid Mesh Index!");
+	assert(index < nodeList.size() && "Attempted to access invalid Node Index!");
+
+	return nodeList[index];
+}
+
+uint32_t MeshModel::findNode(const std::string& name) const
+{
+	for (size_t i = 0; i < nodeList.size(); i++)
+	{
+		if (nodeList[i].name == name)
+		{
+			return static_cast<uint32_t>(i);
+		}
+	}
 
-	return &meshList[index];
+	return NO_NODE;
 }
 
-void MeshModel::setModel(glm::mat4 newModel)
+MeshHandle MeshModel::getMesh(size_t index) const
 {
-	model = newModel;
+	assert(index < meshList.size() && "Attempted to access invalid Mesh Index!");
+
+	return meshList[index];
 }
 
-void MeshModel::destroyMeshModel()
+void MeshModel::destroyMeshModel(MeshPool& meshPool, GeometryBuffer& geometryBuffer, TextureManager& textureManager)
 {
-	for (auto& mesh : meshList)
+	// Mesh geometry lives in the shared geometry buffer, only its space goes back
+	for (MeshHandle mesh : meshList)
+	{
+		meshPool.destroy(mesh, geometryBuffer);
+	}
+	meshList.clear();
+
+	for (TextureHandle texture : textureList)
 	{
-		mesh.destroyBuffers();
+		textureManager.removeTexture(texture);
 	}
+	textureList.clear();
+	nodeList.clear();
+	meshNodes.clear();
 }
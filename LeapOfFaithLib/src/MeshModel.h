@@ -1,28 +1,45 @@
 #pragma once
 
+#include <string>
 #include <vector>
 
 #include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
 
-#include "Mesh.h"
+#include "MeshPool.h"
+#include "TextureManager.h"
 
 class MeshModel
 {
 public:
 	MeshModel();
-	void LoadFile(const char* modelFile,
-		std::vector<VkImage>& textureImages, std::vector<VkDeviceMemory>& textureImageMemory, std::vector<VkImageView>& textureImageViews,
-		VkDescriptorPool& samplerDescriptorPool, VkDescriptorSetLayout& samplerSetLayout, VkSampler& textureSampler, std::vector<VkDescriptorSet>& samplerDescriptorSets);
+	void LoadFile(const char* modelFile, GeometryBuffer& geometryBuffer, MeshPool& meshPool, TextureManager& textureManager);
 
 	inline size_t getMeshCount() const { return meshList.size(); }
-	Mesh* getMesh(size_t index);
-
-	inline glm::mat4 getModel() const { return model; }
-	void setModel(glm::mat4 newModel);
-
-	void destroyMeshModel();
+	MeshHandle getMesh(size_t index) const;
+
+	// Node hierarchy of the model, parents come before their children. Meshes are drawn with the world transform of their node
+	static const uint32_t NO_NODE = UINT32_MAX;
+	inline size_t getNodeCount() const { return nodeList.size(); }
+	const ModelNode& getNode(size_t index) const;
+	// First node with the name, NO_NODE when there's none
+	uint32_t findNode(const std::string& name) const;
+	inline uint32_t getMeshNode(size_t index) const { return meshNodes[index]; }
+
+	// Bounding sphere and box around all the meshes in object space (nodes in their loaded pose), the box shares the sphere's center
+	inline glm::vec3 getBoundsCenter() const { return boundsCenter; }
+	inline float getBoundsRadius() const { return boundsRadius; }
+	inline glm::vec3 getBoundsExtents() const { return boundsExtents; }
+
+	// Releases the meshes and the textures the model loaded, no frame in flight may be drawing it anymore
+	void destroyMeshModel(MeshPool& meshPool, GeometryBuffer& geometryBuffer, TextureManager& textureManager);
 private:
-	std::vector<Mesh> meshList;
-	glm::mat4 model;
+	std::vector<MeshHandle> meshList;
+	std::vector<TextureHandle> textureList; // Textures loaded for this model's materials
+	std::vector<ModelNode> nodeList;
+	std::vector<uint32_t> meshNodes; // Node owning each mesh
+	glm::vec3 boundsCenter = glm::vec3(0.0f);
+	float boundsRadius = 0.0f;
+	glm::vec3 boundsExtents = glm::vec3(0.0f);
 };
 
@@ -0,0 +1,82 @@
+#include "MeshPool.h"
+
+#include <algorithm>
+#include <assert.h>
+#include <cfloat>
+#include <cmath>
+#include <glm/geometric.hpp>
+
+MeshHandle MeshPool::create(GeometryBuffer& geometryBuffer, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+	TextureHandle texture)
+{
+	// Upload first, a full geometry buffer throws before a handle was taken
+	GeometryRange geometry = geometryBuffer.upload(vertices, indices);
+
+	MeshHandle handle;
+	handle.value = handles.allocate();
+
+	// Grow the arrays when a brand new slot was handed out
+	uint32_t index = handle.getIndex();
+	if (index >= geometries.size())
+	{
+		geometries.resize(index + 1);
+		textures.resize(index + 1);
+		boundsCenters.resize(index + 1);
+		boundsRadii.resize(index + 1);
+		boundsExtents.resize(index + 1);
+		uvDensities.resize(index + 1);
+	}
+
+	geometries[index] = geometry;
+	textures[index] = texture;
+
+	// Sphere around the center of the bounding box
+	glm::vec3 minPos(FLT_MAX);
+	glm::vec3 maxPos(-FLT_MAX);
+	for (const Vertex& vertex : vertices)
+	{
+		minPos = glm::min(minPos, vertex.pos);
+		maxPos = glm::max(maxPos, vertex.pos);
+	}
+
+	glm::vec3 boundsCenter = vertices.empty() ? glm::vec3(0.0f) : (minPos + maxPos) * 0.5f;
+	float boundsRadius = 0.0f;
+	for (const Vertex& vertex : vertices)
+	{
+		boundsRadius = std::max(boundsRadius, glm::length(vertex.pos - boundsCenter));
+	}
+
+	boundsCenters[index] = boundsCenter;
+	boundsRadii[index] = boundsRadius;
+	boundsExtents[index] = vertices.empty() ? glm::vec3(0.0f) : (maxPos - minPos) * 0.5f;
+
+	// Ratio between the area the triangles cover in UV space and in object space
+	float surfaceArea = 0.0f;
+	float uvArea = 0.0f;
+	for (size_t i = 0; i + 2 < indices.size(); i += 3)
+	{
+		const Vertex& v0 = vertices[indices[i]];
+		const Vertex& v1 = vertices[indices[i + 1]];
+		const Vertex& v2 = vertices[indices[i + 2]];
+
+		surfaceArea += 0.5f * glm::length(glm::cross(v1.pos - v0.pos, v2.pos - v0.pos));
+
+		glm::vec2 uvEdge1 = v1.tex - v0.tex;
+		glm::vec2 uvEdge2 = v2.tex - v0.tex;
+		uvArea += 0.5f * std::abs(uvEdge1.x * uvEdge2.y - uvEdge1.y * uvEdge2.x);
+	}
+
+	uvDensities[index] = surfaceArea > 0.0f ? std::sqrt(uvArea / surfaceArea) : 0.0f;
+
+	return handle;
+}
+
+void MeshPool::destroy(MeshHandle handle, GeometryBuffer& geometryBuffer)
+{
+	assert(isValid(handle) && "Destroying an invalid Mesh handle!");
+
+	geometryBuffer.free(geometries[handle.getIndex()]);
+
+	// The slot only holds plain data, it can be reused right away
+	handles.free(handle.value);
+}
@@ -0,0 +1,43 @@
+#pragma once
+
+#include <glm/vec3.hpp>
+
+#include <vector>
+
+#include "DataStructures.h"
+#include "GeometryBuffer.h"
+#include "Handle.h"
+#include "TextureManager.h"
+
+typedef Handle<struct MeshHandleTag> MeshHandle;
+
+// Every mesh loaded by the engine, one compact array per field so per-draw loops only touch what they read
+class MeshPool
+{
+public:
+	// Sub-allocates the mesh's data from the shared geometry buffers
+	MeshHandle create(GeometryBuffer& geometryBuffer, const std::vector<Vertex>& vertices, const std::vector<uint32_t>& indices,
+		TextureHandle texture);
+	// Returns the mesh's space to the geometry buffers, no frame in flight may be drawing it anymore
+	void destroy(MeshHandle handle, GeometryBuffer& geometryBuffer);
+
+	inline bool isValid(MeshHandle handle) const { return handles.isValid(handle.value); }
+
+	inline const GeometryRange& getGeometry(MeshHandle handle) const { return geometries[handle.getIndex()]; }
+	inline TextureHandle getTexture(MeshHandle handle) const { return textures[handle.getIndex()]; }
+
+	inline glm::vec3 getBoundsCenter(MeshHandle handle) const { return boundsCenters[handle.getIndex()]; }
+	inline float getBoundsRadius(MeshHandle handle) const { return boundsRadii[handle.getIndex()]; }
+	inline glm::vec3 getBoundsExtents(MeshHandle handle) const { return boundsExtents[handle.getIndex()]; }
+	inline float getUvDensity(MeshHandle handle) const { return uvDensities[handle.getIndex()]; }
+private:
+	HandleAllocator handles;
+
+	// Per mesh data, indexed by slot
+	std::vector<GeometryRange> geometries; // Where the mesh lives inside the shared geometry buffers
+	std::vector<TextureHandle> textures;
+	std::vector<glm::vec3> boundsCenters; // Bounding sphere in object space
+	std::vector<float> boundsRadii;
+	std::vector<glm::vec3> boundsExtents; // Half size of the bounding box in object space, the box shares the sphere's center
+	std::vector<float> uvDensities; // Average UV units per object space unit over the surface, used to pick the texture mips a draw needs
+};
@@ -9,9 +9,8 @@
 
 namespace MeshReader
 {
-	void loadFromBinary(const char* inputFile, std::vector<Mesh>& meshList,
-		std::vector<VkImage>& textureImages, std::vector<VkDeviceMemory>& textureImageMemory, std::vector<VkImageView>& textureImageViews,
-		VkDescriptorPool& samplerDescriptorPool, VkDescriptorSetLayout& samplerSetLayout, VkSampler& textureSampler, std::vector<VkDescriptorSet>& samplerDescriptorSets)
+	void loadFromBinary(const char* inputFile, GeometryBuffer& geometryBuffer, MeshPool& meshPool, std::vector<MeshHandle>& meshList,
+		std::vector<TextureHandle>& textureList, std::vector<ModelNode>& nodeList, TextureManager& textureManager)
 	{
 		std::ifstream file(inputFile, std::ios::in | std::ios::binary);
 
@@ -28,25 +27,30 @@ namespace MeshReader
 			textureNames.push_back(texture);
 		}
 
-		// Conversion from the materials list IDs to our Descriptor Array IDs
-		std::vector<int> matToTex(textureNames.size());
+		// Conversion from the materials list IDs to our textures
+		// If material had no texture, use the default texture
+		std::vector<TextureHandle> matToTex(textureNames.size(), textureManager.getDefaultTexture());
 
-		//Loop over textureNames and create textures for them
+		// Gather the materials that do have a texture so they can all be decoded in parallel
+		std::vector<std::string> textureFiles;
+		std::vector<size_t> textureMaterials;
 		for (size_t i = 0; i < textureNames.size(); i++)
 		{
-			// If material had no texture, set '0' to indicate no texture, texture 0 will be reserved for a default texture
-			if (textureNames[i].empty())
+			if (!textureNames[i].empty())
 			{
-				matToTex[i] = 0;
-			}
-			else
-			{
-				// Otherwise, create texture and set value to index of new texture
-				matToTex[i] = Utilities::Texture::createTexture(textureNames[i].c_str(), textureImages, textureImageMemory, textureImageViews,
-				                                                samplerDescriptorPool, samplerSetLayout, textureSampler, samplerDescriptorSets);
+				textureFiles.push_back(textureNames[i]);
+				textureMaterials.push_back(i);
 			}
 		}
 
+		// Create textures and map each material to its new texture
+		std::vector<TextureHandle> textures = Utilities::Texture::createTextures(textureFiles, textureManager);
+		for (size_t i = 0; i < textures.size(); i++)
+		{
+			matToTex[textureMaterials[i]] = textures[i];
+		}
+		textureList.insert(textureList.end(), textures.begin(), textures.end());
+
 		// Read how many meshes we have
 		size_t meshSize;
 		file.read((char*)&meshSize, sizeof(size_t));
@@ -81,7 +85,34 @@ namespace MeshReader
 
 			file.read((char*)&materialIndex, sizeof(unsigned int));
 
-			meshList.push_back(Mesh(Globals::vkContext->physicalDevice, Globals::vkContext->logicalDevice, Globals::vkContext->graphicsQueue, Globals::vkContext->graphicsCommandPool, &vertices, &indices, matToTex[materialIndex]));
+			meshList.push_back(meshPool.create(geometryBuffer, vertices, indices, matToTex[materialIndex]));
+		}
+
+		// Node hierarchy, older files end right after the meshes
+		size_t nodeSize;
+		if (!file.read((char*)&nodeSize, sizeof(size_t)))
+		{
+			ModelNode root = {};
+			root.parent = -1;
+			root.localTransform = glm::mat4(1.0f);
+			root.firstMesh = 0;
+			root.meshCount = static_cast<uint32_t>(meshSize);
+			nodeList.push_back(root);
+
+			file.close();
+			return;
+		}
+
+		for (size_t i = 0; i < nodeSize; i++)
+		{
+			ModelNode node;
+			file.read((char*)&node.parent, sizeof(int32_t));
+			file.read((char*)&node.localTransform, sizeof(glm::mat4));
+			file.read((char*)&node.firstMesh, sizeof(uint32_t));
+			file.read((char*)&node.meshCount, sizeof(uint32_t));
+			std::getline(file, node.name, '\0');
+
+			nodeList.push_back(node);
 		}
 
 		file.close();
@@ -1,12 +1,13 @@
 #pragma once
 #include <vector>
 
-#include "Mesh.h"
+#include "MeshPool.h"
+#include "TextureManager.h"
 
 namespace MeshReader
 {
-	void loadFromBinary(const char* inputFile, std::vector<Mesh>& meshList,
-		std::vector<VkImage>& textureImages, std::vector<VkDeviceMemory>& textureImageMemory, std::vector<VkImageView>& textureImageViews,
-		VkDescriptorPool& samplerDescriptorPool, VkDescriptorSetLayout& samplerSetLayout, VkSampler& textureSampler, std::vector<VkDescriptorSet>& samplerDescriptorSets);
+	// Files without a node hierarchy get a single root node owning every mesh
+	void loadFromBinary(const char* inputFile, GeometryBuffer& geometryBuffer, MeshPool& meshPool, std::vector<MeshHandle>& meshList,
+		std::vector<TextureHandle>& textureList, std::vector<ModelNode>& nodeList, TextureManager& textureManager);
 };
 
@@ -0,0 +1,98 @@
+#include "PipelineCache.h"
+
+#include <assert.h>
+#include <cstring>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+#include "Globals.h"
+#include "Utilities/IO.h"
+
+// Size of the header version one: header size, header version, vendor ID and device ID, then the cache UUID
+const uint32_t CACHE_HEADER_SIZE = 4 * sizeof(uint32_t) + VK_UUID_SIZE;
+
+void PipelineCache::create(const std::string& newFileName)
+{
+	fileName = newFileName;
+	warm = false;
+
+	// No file yet on the first run
+	std::vector<char> data;
+	if (std::ifstream(fileName, std::ios::binary).good())
+	{
+		data = Utilities::IO::readFile(fileName);
+	}
+
+	if (!data.empty())
+	{
+		warm = isCompatible(data);
+		if (!warm)
+		{
+			std::cout << "Pipeline cache " << fileName << " was written by another device or driver, starting from an empty cache" << std::endl;
+			data.clear();
+		}
+	}
+
+	VkPipelineCacheCreateInfo cacheCreateInfo = {};
+	cacheCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_CACHE_CREATE_INFO;
+	cacheCreateInfo.initialDataSize = data.size();
+	cacheCreateInfo.pInitialData = data.empty() ? nullptr : data.data();
+
+	VkResult result = vkCreatePipelineCache(Globals::vkContext->logicalDevice, &cacheCreateInfo, nullptr, &cache);
+	assert(result == VK_SUCCESS && "Failed to create a Pipeline Cache!");
+}
+
+void PipelineCache::save() const
+{
+	// Query the size first, then get the data itself
+	size_t dataSize = 0;
+	VkResult result = vkGetPipelineCacheData(Globals::vkContext->logicalDevice, cache, &dataSize, nullptr);
+	assert(result == VK_SUCCESS && "Failed to get the Pipeline Cache size!");
+
+	std::vector<char> data(dataSize);
+	result = vkGetPipelineCacheData(Globals::vkContext->logicalDevice, cache, &dataSize, data.data());
+	assert(result == VK_SUCCESS && "Failed to get the Pipeline Cache data!");
+
+	// Written to the side and swapped in, so a crash halfway never leaves a truncated cache behind
+	std::string tempFileName = fileName + ".tmp";
+	std::ofstream file(tempFileName, std::ios::binary | std::ios::trunc);
+	if (!file.is_open())
+	{
+		std::cout << "Failed to write the pipeline cache to " << fileName << std::endl;
+		return;
+	}
+	file.write(data.data(), dataSize);
+	file.close();
+
+	std::remove(fileName.c_str());
+	std::rename(tempFileName.c_str(), fileName.c_str());
+}
+
+void PipelineCache::destroy()
+{
+	vkDestroyPipelineCache(Globals::vkContext->logicalDevice, cache, nullptr);
+	cache = VK_NULL_HANDLE;
+}
+
+bool PipelineCache::isCompatible(const std::vector<char>& data)
+{
+	if (data.size() < CACHE_HEADER_SIZE)
+	{
+		return false;
+	}
+
+	uint32_t header[4];
+	memcpy(header, data.data(), sizeof(header));
+	uint32_t headerSize = header[0], headerVersion = header[1], vendorID = header[2], deviceID = header[3];
+
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(Globals::vkContext->physicalDevice, &deviceProperties);
+
+	// A different GPU or driver version changes the UUID, the driver would reject (or worse, misread) the data
+	return headerSize >= CACHE_HEADER_SIZE && headerSize <= data.size()
+		&& headerVersion == VK_PIPELINE_CACHE_HEADER_VERSION_ONE
+		&& vendorID == deviceProperties.vendorID
+		&& deviceID == deviceProperties.deviceID
+		&& memcmp(data.data() + sizeof(header), deviceProperties.pipelineCacheUUID, VK_UUID_SIZE) == 0;
+}
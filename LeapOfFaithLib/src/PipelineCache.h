@@ -0,0 +1,29 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+// Pipeline cache kept in a file between runs, so the driver can skip compiling the pipelines it has already seen.
+// The data is only reused when it was written by the same device and driver, anything else starts from an empty cache
+class PipelineCache
+{
+public:
+	void create(const std::string& newFileName);
+
+	inline VkPipelineCache get() const { return cache; }
+	// The cache started from the file's data (pipelines may come out of it instead of being compiled)
+	inline bool isWarm() const { return warm; }
+
+	// Writes everything the cache holds (what was loaded plus what was compiled since) back to the file
+	void save() const;
+
+	void destroy();
+private:
+	VkPipelineCache cache = VK_NULL_HANDLE;
+	std::string fileName;
+	bool warm = false;
+
+	// Checks the header the driver puts in front of the data against the current device
+	static bool isCompatible(const std::vector<char>& data);
+};
@@ -0,0 +1,148 @@
+#include "RenderQueue.h"
+
+#include <algorithm>
+#include <array>
+
+void RecordingStats::add(const RecordingStats& other)
+{
+	draws += other.draws;
+	indirectDraws += other.indirectDraws;
+	pipelineBinds += other.pipelineBinds;
+	pipelineBindsSkipped += other.pipelineBindsSkipped;
+	descriptorSetBinds += other.descriptorSetBinds;
+	descriptorSetBindsSkipped += other.descriptorSetBindsSkipped;
+	geometryBinds += other.geometryBinds;
+	geometryBindsSkipped += other.geometryBindsSkipped;
+}
+
+uint64_t RenderQueue::makeSortKey(uint32_t pipelineId, uint32_t textureId, uint32_t geometryBufferId, float depth, float farPlane)
+{
+	// View depth mapped to [0, 1] over the visible range, then to the integer range of the depth bits
+	float normalizedDepth = std::min(std::max(depth / farPlane, 0.0f), 1.0f);
+	uint64_t quantizedDepth = static_cast<uint64_t>(normalizedDepth * static_cast<float>((1u << DEPTH_BITS) - 1));
+
+	return (static_cast<uint64_t>(pipelineId & PIPELINE_MASK) << PIPELINE_SHIFT) |
+		(static_cast<uint64_t>(textureId & TEXTURE_MASK) << TEXTURE_SHIFT) |
+		(static_cast<uint64_t>(geometryBufferId & GEOMETRY_MASK) << GEOMETRY_SHIFT) |
+		quantizedDepth;
+}
+
+void RenderQueue::clear()
+{
+	items.clear();
+	keys.clear();
+	itemIndices.clear();
+	buckets.clear();
+	firstInstances.clear();
+	totalInstanceCount = 0;
+}
+
+void RenderQueue::push(uint64_t sortKey, const DrawItem& item)
+{
+	itemIndices.push_back(static_cast<uint32_t>(items.size()));
+	items.push_back(item);
+	keys.push_back(sortKey);
+}
+
+void RenderQueue::sort()
+{
+	size_t count = keys.size();
+	scratchKeys.resize(count);
+	scratchIndices.resize(count);
+
+	for (uint32_t shift = 0; shift < 64; shift += 8)
+	{
+		// How many keys fall in each bucket of this digit
+		std::array<uint32_t, 256> counts = {};
+		for (uint64_t key : keys)
+		{
+			counts[(key >> shift) & 0xFF]++;
+		}
+
+		// Every key shares this digit (e.g. the single pipeline), the pass wouldn't move anything
+		if (counts[(keys.empty() ? 0 : keys[0] >> shift) & 0xFF] == count)
+		{
+			continue;
+		}
+
+		// Start of each bucket in the output
+		uint32_t offset = 0;
+		for (uint32_t& bucket : counts)
+		{
+			uint32_t bucketCount = bucket;
+			bucket = offset;
+			offset += bucketCount;
+		}
+
+		// Scatter in input order, which keeps the sort stable across passes
+		for (size_t i = 0; i < count; i++)
+		{
+			uint32_t destination = counts[(keys[i] >> shift) & 0xFF]++;
+			scratchKeys[destination] = keys[i];
+			scratchIndices[destination] = itemIndices[i];
+		}
+
+		keys.swap(scratchKeys);
+		itemIndices.swap(scratchIndices);
+	}
+
+	// Textures are picked in the shader, so only a pipeline or geometry buffer change needs a new bucket
+	buckets.clear();
+	firstInstances.resize(count);
+	totalInstanceCount = 0;
+	for (uint32_t i = 0; i < static_cast<uint32_t>(count); i++)
+	{
+		firstInstances[i] = totalInstanceCount;
+		totalInstanceCount += getItem(i).instanceCount;
+
+		uint32_t pipelineId = getPipelineId(keys[i]);
+		uint32_t geometryBufferId = getGeometryBufferId(keys[i]);
+
+		if (buckets.empty() || buckets.back().pipelineId != pipelineId || buckets.back().geometryBufferId != geometryBufferId)
+		{
+			buckets.push_back({ pipelineId, geometryBufferId, i, 0 });
+		}
+		buckets.back().drawCount++;
+	}
+}
+
+uint32_t RenderQueue::limit(uint32_t maxDraws, uint32_t maxInstances, uint32_t maxBuckets)
+{
+	// Buckets cover the sorted draws in order, so the first bucket over the limit starts the dropped draws
+	uint32_t keptDraws = std::min(size(), maxDraws);
+	if (buckets.size() > maxBuckets)
+	{
+		keptDraws = std::min(keptDraws, buckets[maxBuckets].firstDraw);
+	}
+	for (uint32_t i = 0; i < keptDraws; i++)
+	{
+		if (firstInstances[i] + getItem(i).instanceCount > maxInstances)
+		{
+			keptDraws = i;
+			break;
+		}
+	}
+
+	uint32_t droppedDraws = size() - keptDraws;
+	if (droppedDraws == 0)
+	{
+		return 0;
+	}
+
+	keys.resize(keptDraws);
+	itemIndices.resize(keptDraws);
+	firstInstances.resize(keptDraws);
+	totalInstanceCount = keptDraws == 0 ? 0 : firstInstances[keptDraws - 1] + getItem(keptDraws - 1).instanceCount;
+
+	// The last bucket left may lose some of its draws
+	while (!buckets.empty() && buckets.back().firstDraw >= keptDraws)
+	{
+		buckets.pop_back();
+	}
+	if (!buckets.empty())
+	{
+		buckets.back().drawCount = keptDraws - buckets.back().firstDraw;
+	}
+
+	return droppedDraws;
+}
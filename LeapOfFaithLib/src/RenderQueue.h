@@ -0,0 +1,90 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include "MeshPool.h"
+
+// One mesh of a model, drawn once per instance of the model with a single instanced command
+struct DrawItem {
+	MeshHandle mesh;
+	uint32_t modelId;
+	uint32_t modelNode; // Node of the model the mesh hangs from
+	uint32_t firstModelInstance; // First of the model's instances in the renderer's instance list, the others follow it
+	uint32_t instanceCount;
+};
+
+// Run of sorted draws sharing everything that needs a bind, submitted with a single indirect call
+struct DrawBucket {
+	uint32_t pipelineId;
+	uint32_t geometryBufferId;
+	uint32_t firstDraw; // Position of its first draw in the sorted queue
+	uint32_t drawCount;
+};
+
+// State changes made and avoided while recording the buckets, in the order the recorder checks them
+struct RecordingStats {
+	uint32_t draws = 0; // Mesh draws covered by the indirect calls
+	uint32_t indirectDraws = 0;
+	uint32_t pipelineBinds = 0;
+	uint32_t pipelineBindsSkipped = 0;
+	uint32_t descriptorSetBinds = 0;
+	uint32_t descriptorSetBindsSkipped = 0;
+	uint32_t geometryBinds = 0;
+	uint32_t geometryBindsSkipped = 0;
+
+	void add(const RecordingStats& other);
+};
+
+// Draws of a frame keyed by the state they need, packed into 64 bits from most to least expensive to change:
+// pipeline (8 bits) | texture id (20 bits) | geometry buffer (8 bits) | depth (28 bits, front to back).
+// Once sorted, draws sharing state sit next to each other so the recorder can skip binding it again.
+class RenderQueue
+{
+public:
+	static uint64_t makeSortKey(uint32_t pipelineId, uint32_t textureId, uint32_t geometryBufferId, float depth, float farPlane);
+
+	static inline uint32_t getPipelineId(uint64_t sortKey) { return static_cast<uint32_t>(sortKey >> PIPELINE_SHIFT) & PIPELINE_MASK; }
+	static inline uint32_t getTextureId(uint64_t sortKey) { return static_cast<uint32_t>(sortKey >> TEXTURE_SHIFT) & TEXTURE_MASK; }
+	static inline uint32_t getGeometryBufferId(uint64_t sortKey) { return static_cast<uint32_t>(sortKey >> GEOMETRY_SHIFT) & GEOMETRY_MASK; }
+
+	void clear();
+	void push(uint64_t sortKey, const DrawItem& item);
+
+	// Least significant digit radix sort (8 bits per pass), stable and linear in the number of draws.
+	// Groups the sorted draws in buckets and lays out their instances afterwards
+	void sort();
+
+	// Drops the sorted draws from the first one that doesn't fit the limits on, returns how many were dropped
+	uint32_t limit(uint32_t maxDraws, uint32_t maxInstances, uint32_t maxBuckets);
+
+	inline uint32_t size() const { return static_cast<uint32_t>(keys.size()); }
+	// Draws in sorted order once sort ran
+	inline uint64_t getSortKey(uint32_t index) const { return keys[index]; }
+	inline const DrawItem& getItem(uint32_t index) const { return items[itemIndices[index]]; }
+	// Instances of the sorted draws one after the other: draw i owns getItem(i).instanceCount of them from here on
+	inline uint32_t getFirstInstance(uint32_t index) const { return firstInstances[index]; }
+	inline uint32_t getTotalInstanceCount() const { return totalInstanceCount; }
+
+	inline uint32_t getBucketCount() const { return static_cast<uint32_t>(buckets.size()); }
+	inline const DrawBucket& getBucket(uint32_t index) const { return buckets[index]; }
+private:
+	static const uint32_t DEPTH_BITS = 28;
+	static const uint32_t GEOMETRY_SHIFT = DEPTH_BITS;
+	static const uint32_t GEOMETRY_MASK = 0xFF;
+	static const uint32_t TEXTURE_SHIFT = GEOMETRY_SHIFT + 8;
+	static const uint32_t TEXTURE_MASK = (1u << 20) - 1;
+	static const uint32_t PIPELINE_SHIFT = TEXTURE_SHIFT + 20;
+	static const uint32_t PIPELINE_MASK = 0xFF;
+
+	std::vector<DrawItem> items; // In push order
+	std::vector<uint64_t> keys; // Sorted together with itemIndices
+	std::vector<uint32_t> itemIndices;
+	std::vector<DrawBucket> buckets;
+	std::vector<uint32_t> firstInstances; // Per sorted draw
+	uint32_t totalInstanceCount = 0;
+
+	// Scratch of the sort, kept to avoid reallocating every time
+	std::vector<uint64_t> scratchKeys;
+	std::vector<uint32_t> scratchIndices;
+};
@@ -0,0 +1,43 @@
+#include "RingBuffer.h"
+
+#include <algorithm>
+
+#include "Globals.h"
+#include "Utilities/Vulkan.h"
+
+void RingBuffer::create(VkDeviceSize newRegionSize, uint32_t newRegionCount, VkBufferUsageFlags usage)
+{
+	// Regions are bound with dynamic offsets, so each one must start at an offset the device accepts
+	VkPhysicalDeviceProperties deviceProperties;
+	vkGetPhysicalDeviceProperties(Globals::vkContext->physicalDevice, &deviceProperties);
+
+	VkDeviceSize alignment = 1;
+	if (usage & VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT)
+	{
+		alignment = std::max(alignment, deviceProperties.limits.minUniformBufferOffsetAlignment);
+	}
+	if (usage & VK_BUFFER_USAGE_STORAGE_BUFFER_BIT)
+	{
+		alignment = std::max(alignment, deviceProperties.limits.minStorageBufferOffsetAlignment);
+	}
+
+	regionSize = newRegionSize;
+	regionStride = (regionSize + alignment - 1) & ~(alignment - 1);
+
+	// HOST_COHERENT so writes through the mapped pointer are visible to the GPU without flushing,
+	// the pool maps it once and it stays mapped until the buffer is destroyed
+	buffer = Globals::bufferPool->create(regionStride * newRegionCount, usage,
+	                                     VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT);
+	mapped = static_cast<char*>(Globals::bufferPool->getMapped(buffer));
+}
+
+VkBuffer RingBuffer::getBuffer() const
+{
+	return Globals::bufferPool->getBuffer(buffer);
+}
+
+void RingBuffer::destroy()
+{
+	Globals::bufferPool->destroy(buffer);
+	mapped = nullptr;
+}
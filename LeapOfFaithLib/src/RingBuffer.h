@@ -0,0 +1,29 @@
+#pragma once
+
+#include <vulkan/vulkan_core.h>
+
+#include "BufferPool.h"
+
+// Host visible buffer that stays mapped for its whole lifetime, split in one region per frame in flight.
+// Each frame writes straight into its own region, so there is no map/unmap and no copy between frames.
+class RingBuffer
+{
+public:
+	void create(VkDeviceSize newRegionSize, uint32_t newRegionCount, VkBufferUsageFlags usage);
+
+	// Pointer to the start of the region owned by the given frame
+	inline void* getRegion(uint32_t frame) const { return mapped + regionStride * frame; }
+	// Offset of the region owned by the given frame (used as dynamic offset when binding)
+	inline uint32_t getRegionOffset(uint32_t frame) const { return static_cast<uint32_t>(regionStride * frame); }
+
+	VkBuffer getBuffer() const;
+	inline VkDeviceSize getRegionSize() const { return regionSize; }
+
+	void destroy();
+private:
+	BufferHandle buffer;
+	char* mapped = nullptr;
+
+	VkDeviceSize regionSize = 0; // Bytes usable by a frame
+	VkDeviceSize regionStride = 0; // Region size rounded up to the device offset alignment
+};
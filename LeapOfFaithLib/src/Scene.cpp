@@ -0,0 +1,267 @@
+#include "Scene.h"
+
+#include <assert.h>
+#include <cmath>
+
+#include <glm/gtc/matrix_transform.hpp>
+
+#include "Globals.h"
+#include "Utilities/ThreadPool.h"
+
+Entity Scene::createEntity(uint32_t components)
+{
+	uint32_t archetypeIndex = findArchetype(components);
+
+	Entity entity;
+	entity.value = handles.allocate();
+
+	// Slot index may be one past what the arrays hold
+	uint32_t index = entity.getIndex();
+	if (index >= entityArchetypes.size())
+	{
+		entityArchetypes.resize(index + 1);
+		entityRows.resize(index + 1);
+	}
+
+	entityArchetypes[index] = archetypeIndex;
+	entityRows[index] = addRow(archetypeIndex, entity);
+	entityCount++;
+
+	updateFirstIndices();
+	structureVersion++;
+
+	return entity;
+}
+
+void Scene::destroyEntity(Entity entity)
+{
+	assert(isValid(entity) && "Destroying an invalid Entity!");
+
+	uint32_t index = entity.getIndex();
+	removeRow(entityArchetypes[index], entityRows[index]);
+	handles.free(entity.value);
+	entityCount--;
+
+	updateFirstIndices();
+	structureVersion++;
+}
+
+void Scene::addComponents(Entity entity, uint32_t components)
+{
+	assert(isValid(entity) && "Adding components to an invalid Entity!");
+
+	uint32_t index = entity.getIndex();
+	uint32_t oldArchetypeIndex = entityArchetypes[index];
+	uint32_t newComponents = archetypes[oldArchetypeIndex].components | components;
+	if (newComponents == archetypes[oldArchetypeIndex].components)
+	{
+		return;
+	}
+
+	// May add an archetype, only hold on to them once it's there
+	uint32_t newArchetypeIndex = findArchetype(newComponents);
+	uint32_t oldRow = entityRows[index];
+	uint32_t newRow = addRow(newArchetypeIndex, entity);
+
+	Archetype& oldArchetype = archetypes[oldArchetypeIndex];
+	Archetype& newArchetype = archetypes[newArchetypeIndex];
+	if (oldArchetype.hasComponents(COMPONENT_TRANSFORM)) newArchetype.transforms[newRow] = oldArchetype.transforms[oldRow];
+	if (oldArchetype.hasComponents(COMPONENT_RENDERABLE)) newArchetype.renderables[newRow] = oldArchetype.renderables[oldRow];
+	if (oldArchetype.hasComponents(COMPONENT_BOUNDS)) newArchetype.bounds[newRow] = oldArchetype.bounds[oldRow];
+	if (oldArchetype.hasComponents(COMPONENT_SPIN)) newArchetype.spins[newRow] = oldArchetype.spins[oldRow];
+
+	removeRow(oldArchetypeIndex, oldRow);
+	entityArchetypes[index] = newArchetypeIndex;
+	entityRows[index] = newRow;
+
+	updateFirstIndices();
+	structureVersion++;
+}
+
+void Scene::removeComponents(Entity entity, uint32_t components)
+{
+	assert(isValid(entity) && "Removing components from an invalid Entity!");
+
+	uint32_t index = entity.getIndex();
+	uint32_t oldArchetypeIndex = entityArchetypes[index];
+	uint32_t newComponents = archetypes[oldArchetypeIndex].components & ~components;
+	if (newComponents == archetypes[oldArchetypeIndex].components)
+	{
+		return;
+	}
+
+	uint32_t newArchetypeIndex = findArchetype(newComponents);
+	uint32_t oldRow = entityRows[index];
+	uint32_t newRow = addRow(newArchetypeIndex, entity);
+
+	Archetype& oldArchetype = archetypes[oldArchetypeIndex];
+	Archetype& newArchetype = archetypes[newArchetypeIndex];
+	if (newArchetype.hasComponents(COMPONENT_TRANSFORM)) newArchetype.transforms[newRow] = oldArchetype.transforms[oldRow];
+	if (newArchetype.hasComponents(COMPONENT_RENDERABLE)) newArchetype.renderables[newRow] = oldArchetype.renderables[oldRow];
+	if (newArchetype.hasComponents(COMPONENT_BOUNDS)) newArchetype.bounds[newRow] = oldArchetype.bounds[oldRow];
+	if (newArchetype.hasComponents(COMPONENT_SPIN)) newArchetype.spins[newRow] = oldArchetype.spins[oldRow];
+
+	removeRow(oldArchetypeIndex, oldRow);
+	entityArchetypes[index] = newArchetypeIndex;
+	entityRows[index] = newRow;
+
+	updateFirstIndices();
+	structureVersion++;
+}
+
+bool Scene::hasComponents(Entity entity, uint32_t components) const
+{
+	assert(isValid(entity) && "Attempted to access an invalid Entity!");
+
+	return archetypes[entityArchetypes[entity.getIndex()]].hasComponents(components);
+}
+
+const glm::mat4& Scene::getTransform(Entity entity) const
+{
+	assert(hasComponents(entity, COMPONENT_TRANSFORM) && "Entity has no Transform!");
+
+	return archetypes[entityArchetypes[entity.getIndex()]].transforms[entityRows[entity.getIndex()]];
+}
+
+void Scene::setTransform(Entity entity, const glm::mat4& transform)
+{
+	assert(hasComponents(entity, COMPONENT_TRANSFORM) && "Entity has no Transform!");
+
+	archetypes[entityArchetypes[entity.getIndex()]].transforms[entityRows[entity.getIndex()]] = transform;
+	transformVersion++;
+}
+
+const Renderable& Scene::getRenderable(Entity entity) const
+{
+	assert(hasComponents(entity, COMPONENT_RENDERABLE) && "Entity has no Renderable!");
+
+	return archetypes[entityArchetypes[entity.getIndex()]].renderables[entityRows[entity.getIndex()]];
+}
+
+void Scene::setRenderable(Entity entity, const Renderable& renderable)
+{
+	assert(hasComponents(entity, COMPONENT_RENDERABLE) && "Entity has no Renderable!");
+
+	Renderable& stored = archetypes[entityArchetypes[entity.getIndex()]].renderables[entityRows[entity.getIndex()]];
+	stored = renderable;
+	stored.firstNode = UINT32_MAX;
+	structureVersion++;
+}
+
+const Bounds& Scene::getBounds(Entity entity) const
+{
+	assert(hasComponents(entity, COMPONENT_BOUNDS) && "Entity has no Bounds!");
+
+	return archetypes[entityArchetypes[entity.getIndex()]].bounds[entityRows[entity.getIndex()]];
+}
+
+Spin& Scene::getSpin(Entity entity)
+{
+	assert(hasComponents(entity, COMPONENT_SPIN) && "Entity has no Spin!");
+
+	return archetypes[entityArchetypes[entity.getIndex()]].spins[entityRows[entity.getIndex()]];
+}
+
+uint32_t Scene::getIndex(Entity entity) const
+{
+	assert(isValid(entity) && "Attempted to access an invalid Entity!");
+
+	return archetypes[entityArchetypes[entity.getIndex()]].firstIndex + entityRows[entity.getIndex()];
+}
+
+void Scene::forEach(uint32_t components, const std::function<void(Archetype&, uint32_t, uint32_t)>& body)
+{
+	for (Archetype& archetype : archetypes)
+	{
+		if (!archetype.hasComponents(components) || archetype.size() == 0)
+		{
+			continue;
+		}
+
+		Globals::threadPool->parallelFor(archetype.size(), ROWS_PER_TASK, [&body, &archetype](uint32_t begin, uint32_t end)
+		{
+			body(archetype, begin, end);
+		});
+	}
+}
+
+void Scene::animate(float deltaTime)
+{
+	forEach(COMPONENT_TRANSFORM | COMPONENT_SPIN, [deltaTime](Archetype& archetype, uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			Spin& spin = archetype.spins[i];
+			spin.angle = std::fmod(spin.angle + spin.degreesPerSecond * deltaTime, 360.0f);
+
+			archetype.transforms[i] = glm::translate(glm::mat4(1.0f), spin.position) * glm::rotate(glm::mat4(1.0f), glm::radians(spin.angle), spin.axis) * spin.base;
+		}
+	});
+
+	transformVersion++;
+}
+
+uint32_t Scene::findArchetype(uint32_t components)
+{
+	for (uint32_t i = 0; i < archetypes.size(); i++)
+	{
+		if (archetypes[i].components == components)
+		{
+			return i;
+		}
+	}
+
+	Archetype archetype = {};
+	archetype.components = components;
+	archetype.firstIndex = entityCount;
+	archetypes.push_back(archetype);
+
+	return static_cast<uint32_t>(archetypes.size() - 1);
+}
+
+uint32_t Scene::addRow(uint32_t archetypeIndex, Entity entity)
+{
+	Archetype& archetype = archetypes[archetypeIndex];
+	archetype.entities.push_back(entity);
+
+	if (archetype.hasComponents(COMPONENT_TRANSFORM)) archetype.transforms.push_back(glm::mat4(1.0f));
+	if (archetype.hasComponents(COMPONENT_RENDERABLE)) archetype.renderables.push_back({});
+	if (archetype.hasComponents(COMPONENT_BOUNDS)) archetype.bounds.push_back({});
+	if (archetype.hasComponents(COMPONENT_SPIN)) archetype.spins.push_back({});
+
+	return archetype.size() - 1;
+}
+
+void Scene::removeRow(uint32_t archetypeIndex, uint32_t row)
+{
+	Archetype& archetype = archetypes[archetypeIndex];
+
+	// Last row fills the hole so the arrays stay packed
+	uint32_t last = archetype.size() - 1;
+	if (row != last)
+	{
+		archetype.entities[row] = archetype.entities[last];
+		if (archetype.hasComponents(COMPONENT_TRANSFORM)) archetype.transforms[row] = archetype.transforms[last];
+		if (archetype.hasComponents(COMPONENT_RENDERABLE)) archetype.renderables[row] = archetype.renderables[last];
+		if (archetype.hasComponents(COMPONENT_BOUNDS)) archetype.bounds[row] = archetype.bounds[last];
+		if (archetype.hasComponents(COMPONENT_SPIN)) archetype.spins[row] = archetype.spins[last];
+
+		entityRows[archetype.entities[row].getIndex()] = row;
+	}
+
+	archetype.entities.pop_back();
+	if (archetype.hasComponents(COMPONENT_TRANSFORM)) archetype.transforms.pop_back();
+	if (archetype.hasComponents(COMPONENT_RENDERABLE)) archetype.renderables.pop_back();
+	if (archetype.hasComponents(COMPONENT_BOUNDS)) archetype.bounds.pop_back();
+	if (archetype.hasComponents(COMPONENT_SPIN)) archetype.spins.pop_back();
+}
+
+void Scene::updateFirstIndices()
+{
+	uint32_t firstIndex = 0;
+	for (Archetype& archetype : archetypes)
+	{
+		archetype.firstIndex = firstIndex;
+		firstIndex += archetype.size();
+	}
+}
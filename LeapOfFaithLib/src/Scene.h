@@ -0,0 +1,119 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+#include <glm/vec3.hpp>
+
+#include "Handle.h"
+
+typedef Handle<struct EntityTag> Entity;
+
+// Components an entity can have, an archetype is one combination of them
+enum ComponentFlags : uint32_t {
+	COMPONENT_TRANSFORM = 1 << 0, // glm::mat4 from object to world space
+	COMPONENT_RENDERABLE = 1 << 1,
+	COMPONENT_BOUNDS = 1 << 2,
+	COMPONENT_SPIN = 1 << 3
+};
+
+// What the entity draws
+struct Renderable {
+	uint32_t modelId; // Element of the renderer's model list
+	uint32_t firstNode = UINT32_MAX; // Set by the renderer: the entity's node in its transform hierarchy, the model's nodes follow it
+};
+
+// World space bounding volumes of the whole entity (sphere and box around the same center), kept up to date by the renderer
+struct Bounds {
+	glm::vec3 center;
+	float radius;
+	glm::vec3 extents; // Half size of the box along each world axis
+};
+
+// Keeps turning the entity around an axis through position, its transform is rebuilt from this every frame
+struct Spin {
+	glm::mat4 base; // Applied before the rotation
+	glm::vec3 position;
+	glm::vec3 axis;
+	float degreesPerSecond;
+	float angle; // Degrees
+};
+
+// Every entity with the same components, one array per component so a system only streams through what it reads.
+// Row i of every array belongs to entities[i], arrays of components the archetype doesn't have stay empty
+struct Archetype {
+	uint32_t components; // ComponentFlags
+	uint32_t firstIndex; // Dense index of row 0: entities are numbered archetype after archetype, row after row
+
+	std::vector<Entity> entities;
+	std::vector<glm::mat4> transforms;
+	std::vector<Renderable> renderables;
+	std::vector<Bounds> bounds;
+	std::vector<Spin> spins;
+
+	inline uint32_t size() const { return static_cast<uint32_t>(entities.size()); }
+	inline bool hasComponents(uint32_t wanted) const { return (components & wanted) == wanted; }
+};
+
+// Entities of the world, grouped by archetype. Adding or removing an entity or component (a structural change) moves rows around,
+// so dense indices and rows are only stable until the next one, getStructureVersion tells when that happened
+class Scene
+{
+public:
+	// Rows a single task of forEach works on, smaller archetypes run on the calling thread
+	static const uint32_t ROWS_PER_TASK = 1024;
+
+	// The components start zeroed apart from the transform (identity)
+	Entity createEntity(uint32_t components);
+	void destroyEntity(Entity entity);
+	inline bool isValid(Entity entity) const { return handles.isValid(entity.value); }
+
+	// Moves the entity to the archetype with the new set of components, the ones it keeps keep their values
+	void addComponents(Entity entity, uint32_t components);
+	void removeComponents(Entity entity, uint32_t components);
+	bool hasComponents(Entity entity, uint32_t components) const;
+
+	const glm::mat4& getTransform(Entity entity) const;
+	void setTransform(Entity entity, const glm::mat4& transform);
+	const Renderable& getRenderable(Entity entity) const;
+	// Changes what gets drawn, counts as a structural change (the renderer places the entity's nodes again)
+	void setRenderable(Entity entity, const Renderable& renderable);
+	const Bounds& getBounds(Entity entity) const;
+	Spin& getSpin(Entity entity);
+
+	// Position of the entity when counting every archetype's rows in order (0 to getEntityCount() - 1)
+	uint32_t getIndex(Entity entity) const;
+
+	// Runs body(archetype, begin, end) over the rows of every archetype having all the components, split across the thread pool.
+	// Returns once every row has been visited, the body may only write to its own rows (and what they index)
+	void forEach(uint32_t components, const std::function<void(Archetype&, uint32_t, uint32_t)>& body);
+
+	// Animation system: advances every Spin and writes the transform it gives
+	void animate(float deltaTime);
+
+	inline const std::vector<Archetype>& getArchetypes() const { return archetypes; }
+	// Rows may be written through it, never added or removed
+	inline std::vector<Archetype>& getArchetypes() { return archetypes; }
+	inline uint32_t getEntityCount() const { return entityCount; }
+	inline uint64_t getStructureVersion() const { return structureVersion; }
+	// Changes whenever a transform may have changed
+	inline uint64_t getTransformVersion() const { return transformVersion; }
+private:
+	HandleAllocator handles;
+
+	// Per entity slot, indexed by the slot index of the handle
+	std::vector<uint32_t> entityArchetypes;
+	std::vector<uint32_t> entityRows;
+
+	std::vector<Archetype> archetypes; // Never removed, so an archetype keeps its element
+	uint32_t entityCount = 0;
+	uint64_t structureVersion = 1;
+	uint64_t transformVersion = 1;
+
+	uint32_t findArchetype(uint32_t components);
+	uint32_t addRow(uint32_t archetypeIndex, Entity entity);
+	void removeRow(uint32_t archetypeIndex, uint32_t row);
+	void updateFirstIndices();
+};
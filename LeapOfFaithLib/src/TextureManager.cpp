@@ -0,0 +1,634 @@
+#include "TextureManager.h"
+
+#include <stb_image.h>
+
+#include <algorithm>
+#include <assert.h>
+#include <chrono>
+#include <cmath>
+
+#include "Globals.h"
+#include "Utilities/Texture.h"
+#include "Utilities/ThreadPool.h"
+
+void TextureManager::init(VkSampler newSampler, const std::array<VkDescriptorSet, MAX_FRAME_DRAWS>& newDescriptorSets,
+	DeletionQueue* newDeletionQueue, bool newMemoryBudgetSupported, VkDeviceSize newBudgetOverride)
+{
+	sampler = newSampler;
+	descriptorSets = newDescriptorSets;
+	deletionQueue = newDeletionQueue;
+	memoryBudgetSupported = newMemoryBudgetSupported;
+	budgetOverride = newBudgetOverride;
+
+	budget = queryBudget();
+}
+
+TextureHandle TextureManager::addTexture(const std::string& fileName, stbi_uc* imageData, int width, int height, uint32_t baseMip)
+{
+	// Create Texture Image from the base level (takes ownership of the decoded pixels), levels below it get generated
+	int baseWidth = std::max(1, width >> baseMip);
+	int baseHeight = std::max(1, height >> baseMip);
+	VkDeviceSize imageSize = static_cast<VkDeviceSize>(baseWidth) * baseHeight * 4;
+
+	// Look for transparent texels while the pixels are still here (alpha is every fourth byte), they decide the shader variant
+	bool transparent = false;
+	for (VkDeviceSize i = 3; i < imageSize && !transparent; i += 4)
+	{
+		transparent = imageData[i] < 255;
+	}
+
+	uint32_t levels;
+	VkDeviceMemory imageMemory;
+	VkImage image = Utilities::Texture::createTextureImage(imageData, baseWidth, baseHeight, imageSize, &levels, &imageMemory);
+
+	// Create image view covering the whole resident chain
+	VkImageView imageView = Utilities::Texture::createImageView(image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, levels);
+
+	TextureHandle handle;
+	handle.value = handles.allocate();
+
+	// Texture id is its element in the bindless texture array, grow the arrays when a brand new slot was handed out
+	int textureId = static_cast<int>(handle.getIndex());
+	if (static_cast<size_t>(textureId) >= textureImages.size())
+	{
+		size_t slotCount = textureId + 1;
+		textureImages.resize(slotCount);
+		textureImageMemory.resize(slotCount);
+		textureImageViews.resize(slotCount);
+		fileNames.resize(slotCount);
+		widths.resize(slotCount);
+		heights.resize(slotCount);
+		mipLevels.resize(slotCount);
+		residentBaseMips.resize(slotCount);
+		requestedBaseMips.resize(slotCount);
+		lastUsedFrames.resize(slotCount);
+		streamRequested.resize(slotCount);
+		transparencies.resize(slotCount);
+	}
+
+	textureImages[textureId] = image;
+	textureImageMemory[textureId] = imageMemory;
+	textureImageViews[textureId] = imageView;
+	fileNames[textureId] = fileName;
+	widths[textureId] = static_cast<uint32_t>(width);
+	heights[textureId] = static_cast<uint32_t>(height);
+	mipLevels[textureId] = baseMip + levels;
+	residentBaseMips[textureId] = baseMip;
+	requestedBaseMips[textureId] = baseMip + levels;
+	lastUsedFrames[textureId] = frameNumber;
+	streamRequested[textureId] = false;
+	transparencies[textureId] = transparent;
+
+	// No frame can be using a brand new (or recycled) element
+	writeSlotNow(textureId, imageView);
+
+	residentBytes += getChainBytes(textureId, baseMip);
+
+	if (defaultTexture.isNull())
+	{
+		defaultTexture = handle;
+	}
+
+	return handle;
+}
+
+void TextureManager::removeTexture(TextureHandle handle)
+{
+	assert(isValid(handle) && "Removing an invalid Texture handle!");
+	assert(handle != defaultTexture && "The default texture can't be removed!");
+
+	int textureId = static_cast<int>(handle.getIndex());
+
+	// Frames in flight may still sample it, the image and the slot go once they're done
+	residentBytes -= getChainBytes(textureId, residentBaseMips[textureId]);
+	retireImage(textureId);
+
+	textureImages[textureId] = VK_NULL_HANDLE;
+	textureImageMemory[textureId] = VK_NULL_HANDLE;
+	textureImageViews[textureId] = VK_NULL_HANDLE;
+	residentBaseMips[textureId] = mipLevels[textureId];
+
+	handles.retire(handle.value);
+	deletionQueue->push([this, textureId]() { handles.recycle(static_cast<uint32_t>(textureId)); });
+}
+
+void TextureManager::touch(TextureHandle handle, float pixelsPerUv)
+{
+	assert(isValid(handle) && "Touching an invalid Texture handle!");
+
+	int textureId = static_cast<int>(handle.getIndex());
+	lastUsedFrames[textureId] = frameNumber;
+
+	uint32_t wantedMip = getWantedMip(textureId, pixelsPerUv);
+	requestedBaseMips[textureId] = std::min(requestedBaseMips[textureId], wantedMip);
+
+	if (wantedMip >= residentBaseMips[textureId] || streamRequested[textureId])
+	{
+		return;
+	}
+
+	// Don't bother decoding if the chain can't fit next to the textures currently being drawn
+	if (hotBytes + getChainBytes(textureId, wantedMip) - getChainBytes(textureId, residentBaseMips[textureId]) > budget)
+	{
+		return;
+	}
+
+	// Decode and shrink to the wanted level on the background threads (never in the way of the frame's parallel work),
+	// the upload happens on a later update once the pixels are ready
+	streamRequested[textureId] = true;
+
+	std::string fileName = fileNames[textureId];
+	PendingStream stream;
+	stream.handle = handle;
+	stream.baseMip = wantedMip;
+	stream.decoded = Globals::backgroundPool->submit([fileName, wantedMip]()
+	{
+		DecodedTexture decoded;
+		decoded.imageData = Utilities::Texture::loadTextureFile(fileName.c_str(), &decoded.width, &decoded.height, &decoded.imageSize);
+		Utilities::Texture::downsampleTexture(decoded.imageData, &decoded.width, &decoded.height, &decoded.imageSize, wantedMip);
+		return decoded;
+	});
+
+	pendingStreams.push_back(std::move(stream));
+}
+
+void TextureManager::update(uint64_t newFrameNumber, uint32_t newFrameIndex)
+{
+	frameNumber = newFrameNumber;
+	frameIndex = newFrameIndex;
+
+	// This frame's previous submission has finished, so its table can catch up with the slots replaced meanwhile
+	for (const PendingWrite& pendingWrite : pendingWrites[frameIndex])
+	{
+		Utilities::Texture::writeTextureDescriptor(pendingWrite.textureId, pendingWrite.imageView, Globals::vkContext->logicalDevice,
+		                                           sampler, descriptorSets[frameIndex]);
+	}
+	pendingWrites[frameIndex].clear();
+
+	budget = queryBudget();
+
+	// Bytes of the textures drawn by the frames that may still be in flight
+	hotBytes = 0;
+	for (size_t i = 0; i < textureImages.size(); i++)
+	{
+		if (handles.isSlotUsed(static_cast<uint32_t>(i)) && lastUsedFrames[i] + MAX_FRAME_DRAWS > frameNumber)
+		{
+			hotBytes += getChainBytes(static_cast<int>(i), residentBaseMips[i]);
+		}
+	}
+
+	finishStreams();
+
+	// Streams may have pushed us over, as may anything else allocating VRAM
+	makeRoom(0);
+
+	// Start collecting what this frame's draws need
+	for (size_t i = 0; i < textureImages.size(); i++)
+	{
+		requestedBaseMips[i] = mipLevels[i];
+	}
+}
+
+void TextureManager::destroy()
+{
+	// Let in-flight decodes finish so their pixels can be released
+	for (PendingStream& stream : pendingStreams)
+	{
+		DecodedTexture decoded = stream.decoded.get();
+		stbi_image_free(decoded.imageData);
+	}
+	pendingStreams.clear();
+
+	for (size_t i = 0; i < textureImages.size(); i++)
+	{
+		// Free slots and evicted textures have nothing left to destroy
+		if (!handles.isSlotUsed(static_cast<uint32_t>(i)) || textureImages[i] == VK_NULL_HANDLE)
+		{
+			continue;
+		}
+
+		vkDestroyImageView(Globals::vkContext->logicalDevice, textureImageViews[i], nullptr);
+		vkDestroyImage(Globals::vkContext->logicalDevice, textureImages[i], nullptr);
+		vkFreeMemory(Globals::vkContext->logicalDevice, textureImageMemory[i], nullptr);
+	}
+}
+
+VkDeviceSize TextureManager::getTextureBytes(TextureHandle handle) const
+{
+	return getChainBytes(static_cast<int>(handle.getIndex()), 0);
+}
+
+VkDeviceSize TextureManager::getMipBytes(TextureHandle handle, uint32_t mipLevel) const
+{
+	return getMipBytes(static_cast<int>(handle.getIndex()), mipLevel);
+}
+
+VkDeviceSize TextureManager::getMipBytes(int textureId, uint32_t mipLevel) const
+{
+	// RGBA8, every level halves both sides down to 1
+	VkDeviceSize width = std::max(1u, widths[textureId] >> mipLevel);
+	VkDeviceSize height = std::max(1u, heights[textureId] >> mipLevel);
+
+	return width * height * 4;
+}
+
+VkDeviceSize TextureManager::getChainBytes(int textureId, uint32_t baseMip) const
+{
+	VkDeviceSize bytes = 0;
+	for (uint32_t level = baseMip; level < mipLevels[textureId]; level++)
+	{
+		bytes += getMipBytes(textureId, level);
+	}
+
+	return bytes;
+}
+
+VkDeviceSize TextureManager::queryBudget() const
+{
+	if (budgetOverride != 0)
+	{
+		return budgetOverride;
+	}
+
+	// Heap budgets/usage come chained to the memory properties when VK_EXT_memory_budget is enabled
+	VkPhysicalDeviceMemoryBudgetPropertiesEXT budgetProperties = {};
+	budgetProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_BUDGET_PROPERTIES_EXT;
+
+	VkPhysicalDeviceMemoryProperties2 memoryProperties = {};
+	memoryProperties.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_MEMORY_PROPERTIES_2;
+	memoryProperties.pNext = memoryBudgetSupported ? &budgetProperties : nullptr;
+	vkGetPhysicalDeviceMemoryProperties2(Globals::vkContext->physicalDevice, &memoryProperties);
+
+	// Textures live in device local memory, add up every heap of that kind
+	VkDeviceSize heapSize = 0;
+	VkDeviceSize heapBudget = 0;
+	VkDeviceSize heapUsage = 0;
+	for (uint32_t i = 0; i < memoryProperties.memoryProperties.memoryHeapCount; i++)
+	{
+		if (memoryProperties.memoryProperties.memoryHeaps[i].flags & VK_MEMORY_HEAP_DEVICE_LOCAL_BIT)
+		{
+			heapSize += memoryProperties.memoryProperties.memoryHeaps[i].size;
+			heapBudget += budgetProperties.heapBudget[i];
+			heapUsage += budgetProperties.heapUsage[i];
+		}
+	}
+
+	// Without live numbers just allow textures most of the VRAM
+	if (!memoryBudgetSupported)
+	{
+		return heapSize / 10 * 8;
+	}
+
+	// Whatever else uses the heap (buffers, swapchain, other applications) comes off the top, keep 10% headroom
+	VkDeviceSize otherUsage = heapUsage > residentBytes ? heapUsage - residentBytes : 0;
+	VkDeviceSize usableBudget = heapBudget / 10 * 9;
+
+	return usableBudget > otherUsage ? usableBudget - otherUsage : 0;
+}
+
+bool TextureManager::makeRoom(VkDeviceSize extraBytes)
+{
+	while (residentBytes + extraBytes > budget)
+	{
+		// Textures drawn smaller than what they have resident give their top mips back first
+		int textureId = findOverResident();
+		if (textureId >= 0)
+		{
+			dropTopMip(textureId);
+			continue;
+		}
+
+		// Then lower the resolution of textures nobody looked at lately, evict them only once they're down to small mips
+		textureId = findLeastRecentlyUsed(true);
+		if (textureId >= 0)
+		{
+			dropTopMip(textureId);
+			continue;
+		}
+
+		textureId = findLeastRecentlyUsed(false);
+		if (textureId >= 0)
+		{
+			evict(textureId);
+			continue;
+		}
+
+		// Everything left is being drawn
+		return false;
+	}
+
+	return true;
+}
+
+void TextureManager::finishStreams()
+{
+	for (size_t i = 0; i < pendingStreams.size();)
+	{
+		if (pendingStreams[i].decoded.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			i++;
+			continue;
+		}
+
+		TextureHandle handle = pendingStreams[i].handle;
+		uint32_t baseMip = pendingStreams[i].baseMip;
+		DecodedTexture decoded = pendingStreams[i].decoded.get();
+
+		pendingStreams[i] = std::move(pendingStreams.back());
+		pendingStreams.pop_back();
+
+		// Texture got removed while decoding
+		if (!isValid(handle))
+		{
+			stbi_image_free(decoded.imageData);
+			continue;
+		}
+
+		int textureId = static_cast<int>(handle.getIndex());
+
+		// Colder textures make room for it (still flagged as streaming so it can't be picked itself),
+		// if they can't it stays as it is until touched again
+		VkDeviceSize extraBytes = getChainBytes(textureId, baseMip) - getChainBytes(textureId, residentBaseMips[textureId]);
+		bool fits = makeRoom(extraBytes);
+
+		streamRequested[textureId] = false;
+
+		if (!fits)
+		{
+			stbi_image_free(decoded.imageData);
+			continue;
+		}
+
+		// Recorded and submitted ahead of this frame's draws without waiting, the queue runs it before them
+		VkCommandBuffer commandBuffer = Utilities::Vulkan::beginCommandBuffer(Globals::vkContext->logicalDevice, Globals::vkContext->graphicsCommandPool);
+
+		uint32_t levels;
+		VkDeviceMemory imageMemory;
+		VkBuffer stagingBuffer;
+		VkDeviceMemory stagingBufferMemory;
+		VkImage image = Utilities::Texture::recordTextureUpload(commandBuffer, decoded.imageData, decoded.width, decoded.height, decoded.imageSize,
+			&levels, &imageMemory, &stagingBuffer, &stagingBufferMemory);
+		submitUpload(commandBuffer, stagingBuffer, stagingBufferMemory);
+
+		VkImageView imageView = Utilities::Texture::createImageView(image, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, levels);
+
+		// Frames in flight may still sample the smaller image, keep it until they're done
+		retireImage(textureId);
+
+		textureImages[textureId] = image;
+		textureImageMemory[textureId] = imageMemory;
+		textureImageViews[textureId] = imageView;
+		residentBaseMips[textureId] = baseMip;
+		residentBytes += extraBytes;
+
+		writeSlotDeferred(textureId, imageView);
+	}
+}
+
+uint32_t TextureManager::getWantedMip(int textureId, float pixelsPerUv) const
+{
+	uint32_t lastMip = mipLevels[textureId] - 1;
+	if (pixelsPerUv <= 0.0f)
+	{
+		return lastMip;
+	}
+
+	// Aim for one texel per pixel: every time the texture is twice as big as its footprint, one level finer isn't needed
+	float texelsPerPixel = std::max(widths[textureId], heights[textureId]) / pixelsPerUv;
+	if (texelsPerPixel <= 1.0f)
+	{
+		return 0;
+	}
+
+	return std::min(static_cast<uint32_t>(std::log2(texelsPerPixel)), lastMip);
+}
+
+int TextureManager::findOverResident() const
+{
+	int overResident = -1;
+	uint32_t mostExtraLevels = 0;
+
+	// Only textures drawn last frame, cold ones are handled by the LRU
+	for (size_t i = 0; i < textureImages.size(); i++)
+	{
+		// Evicted slots point at the default texture's view, replacing it would leave them pointing at a destroyed one
+		if (i == defaultTexture.getIndex())
+		{
+			continue;
+		}
+
+		if (!handles.isSlotUsed(static_cast<uint32_t>(i)) || streamRequested[i] || lastUsedFrames[i] + 1 != frameNumber || residentBaseMips[i] >= requestedBaseMips[i])
+		{
+			continue;
+		}
+
+		uint32_t extraLevels = requestedBaseMips[i] - residentBaseMips[i];
+		if (extraLevels > mostExtraLevels)
+		{
+			overResident = static_cast<int>(i);
+			mostExtraLevels = extraLevels;
+		}
+	}
+
+	return overResident;
+}
+
+int TextureManager::findLeastRecentlyUsed(bool droppableOnly) const
+{
+	int leastRecentlyUsed = -1;
+
+	for (size_t i = 0; i < textureImages.size(); i++)
+	{
+		// The default texture is what evicted slots fall back to, it always stays
+		if (i == defaultTexture.getIndex())
+		{
+			continue;
+		}
+
+		// Only textures no frame in flight can be sampling are candidates
+		if (!handles.isSlotUsed(static_cast<uint32_t>(i)) || residentBaseMips[i] == mipLevels[i] || streamRequested[i] || lastUsedFrames[i] + MAX_FRAME_DRAWS > frameNumber)
+		{
+			continue;
+		}
+
+		if (droppableOnly)
+		{
+			uint32_t baseMip = residentBaseMips[i];
+			uint32_t topSize = std::max(widths[i] >> baseMip, heights[i] >> baseMip);
+			if (mipLevels[i] - baseMip < 2 || topSize <= MIN_RESIDENT_MIP_SIZE)
+			{
+				continue;
+			}
+		}
+
+		if (leastRecentlyUsed < 0 || lastUsedFrames[i] < lastUsedFrames[leastRecentlyUsed])
+		{
+			leastRecentlyUsed = static_cast<int>(i);
+		}
+	}
+
+	return leastRecentlyUsed;
+}
+
+void TextureManager::dropTopMip(int textureId)
+{
+	uint32_t baseMip = residentBaseMips[textureId];
+	uint32_t newLevels = mipLevels[textureId] - baseMip - 1;
+	uint32_t newWidth = std::max(1u, widths[textureId] >> (baseMip + 1));
+	uint32_t newHeight = std::max(1u, heights[textureId] >> (baseMip + 1));
+
+	// Smaller image holding every resident level but the top one
+	VkDeviceMemory newImageMemory;
+	VkImage newImage = Utilities::Texture::createImage(newWidth, newHeight, newLevels, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
+		VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &newImageMemory);
+
+	VkCommandBuffer commandBuffer = Utilities::Vulkan::beginCommandBuffer(Globals::vkContext->logicalDevice, Globals::vkContext->graphicsCommandPool);
+
+	// Levels we keep become copy sources, the new image a copy destination
+	// (draws already submitted that sample them are ahead in the queue, so covered by the barrier)
+	Utilities::Vulkan::recordImageBarrier(commandBuffer, textureImages[textureId], 1, newLevels,
+	                                      VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+	                                      VK_ACCESS_SHADER_READ_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+	                                      VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+	Utilities::Vulkan::recordImageBarrier(commandBuffer, newImage, 0, newLevels,
+	                                      VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+	                                      0, VK_ACCESS_TRANSFER_WRITE_BIT,
+	                                      VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+	// Level N+1 of the old image is level N of the new one, same size so a plain copy does it
+	std::vector<VkImageCopy> copyRegions(newLevels);
+	for (uint32_t level = 0; level < newLevels; level++)
+	{
+		VkImageCopy& copyRegion = copyRegions[level];
+		copyRegion = {};
+		copyRegion.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		copyRegion.srcSubresource.mipLevel = level + 1;
+		copyRegion.srcSubresource.baseArrayLayer = 0;
+		copyRegion.srcSubresource.layerCount = 1;
+		copyRegion.dstSubresource = copyRegion.srcSubresource;
+		copyRegion.dstSubresource.mipLevel = level;
+		copyRegion.extent = { std::max(1u, newWidth >> level), std::max(1u, newHeight >> level), 1 };
+	}
+
+	vkCmdCopyImage(commandBuffer,
+		textureImages[textureId], VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+		newImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		newLevels, copyRegions.data());
+
+	Utilities::Vulkan::recordImageBarrier(commandBuffer, newImage, 0, newLevels,
+	                                      VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+	                                      VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+	                                      VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+	submitUpload(commandBuffer, VK_NULL_HANDLE, VK_NULL_HANDLE);
+
+	// The copy still reads the old image, it goes once this frame is done (frames in flight may also be sampling it)
+	retireImage(textureId);
+
+	textureImages[textureId] = newImage;
+	textureImageMemory[textureId] = newImageMemory;
+	textureImageViews[textureId] = Utilities::Texture::createImageView(newImage, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT, newLevels);
+
+	residentBytes -= getMipBytes(textureId, baseMip);
+	residentBaseMips[textureId] = baseMip + 1;
+
+	// Over resident textures can still be in use by frames in flight, the tables of cold ones can change right away
+	bool inFlight = lastUsedFrames[textureId] + MAX_FRAME_DRAWS > frameNumber;
+	if (inFlight)
+	{
+		writeSlotDeferred(textureId, textureImageViews[textureId]);
+	}
+	else
+	{
+		writeSlotNow(textureId, textureImageViews[textureId]);
+	}
+}
+
+void TextureManager::evict(int textureId)
+{
+	residentBytes -= getChainBytes(textureId, residentBaseMips[textureId]);
+
+	// No frame in flight samples this texture, but a mip drop submitted this frame may still copy into it.
+	// Release it once this frame is done and show the default texture until it's reloaded
+	retireImage(textureId);
+
+	textureImages[textureId] = VK_NULL_HANDLE;
+	textureImageMemory[textureId] = VK_NULL_HANDLE;
+	textureImageViews[textureId] = VK_NULL_HANDLE;
+	residentBaseMips[textureId] = mipLevels[textureId];
+
+	writeSlotNow(textureId, textureImageViews[defaultTexture.getIndex()]);
+}
+
+void TextureManager::submitUpload(VkCommandBuffer commandBuffer, VkBuffer stagingBuffer, VkDeviceMemory stagingBufferMemory)
+{
+	// Submitted before this frame's draws on the same queue, so its final barrier covers them and the frame's fence covers it
+	Utilities::Vulkan::endAndSubmitCommandBufferNoWait(Globals::vkContext->graphicsQueue, commandBuffer);
+
+	deletionQueue->push([commandBuffer, stagingBuffer, stagingBufferMemory]()
+	{
+		vkFreeCommandBuffers(Globals::vkContext->logicalDevice, Globals::vkContext->graphicsCommandPool, 1, &commandBuffer);
+		vkDestroyBuffer(Globals::vkContext->logicalDevice, stagingBuffer, nullptr);
+		vkFreeMemory(Globals::vkContext->logicalDevice, stagingBufferMemory, nullptr);
+	});
+}
+
+void TextureManager::writeSlotNow(int textureId, VkImageView imageView)
+{
+	discardPendingWrites(textureId);
+
+	for (uint32_t i = 0; i < MAX_FRAME_DRAWS; i++)
+	{
+		Utilities::Texture::writeTextureDescriptor(static_cast<uint32_t>(textureId), imageView, Globals::vkContext->logicalDevice,
+		                                           sampler, descriptorSets[i]);
+	}
+}
+
+void TextureManager::writeSlotDeferred(int textureId, VkImageView imageView)
+{
+	discardPendingWrites(textureId);
+
+	// The slot is in use, only this frame's table is idle (its fence was just waited on), others get it on their turn
+	for (uint32_t i = 0; i < MAX_FRAME_DRAWS; i++)
+	{
+		if (i == frameIndex)
+		{
+			Utilities::Texture::writeTextureDescriptor(static_cast<uint32_t>(textureId), imageView, Globals::vkContext->logicalDevice,
+			                                           sampler, descriptorSets[i]);
+		}
+		else
+		{
+			pendingWrites[i].push_back({ static_cast<uint32_t>(textureId), imageView });
+		}
+	}
+}
+
+void TextureManager::discardPendingWrites(int textureId)
+{
+	// Older writes to this slot would point it back at a view that is about to be destroyed
+	for (std::vector<PendingWrite>& frameWrites : pendingWrites)
+	{
+		frameWrites.erase(std::remove_if(frameWrites.begin(), frameWrites.end(),
+			[textureId](const PendingWrite& pendingWrite) { return pendingWrite.textureId == static_cast<uint32_t>(textureId); }),
+			frameWrites.end());
+	}
+}
+
+void TextureManager::retireImage(int textureId)
+{
+	// Evicted textures have nothing to retire
+	if (textureImages[textureId] == VK_NULL_HANDLE)
+	{
+		return;
+	}
+
+	VkImage image = textureImages[textureId];
+	VkDeviceMemory memory = textureImageMemory[textureId];
+	VkImageView imageView = textureImageViews[textureId];
+	deletionQueue->push([image, memory, imageView]()
+	{
+		vkDestroyImageView(Globals::vkContext->logicalDevice, imageView, nullptr);
+		vkDestroyImage(Globals::vkContext->logicalDevice, image, nullptr);
+		vkFreeMemory(Globals::vkContext->logicalDevice, memory, nullptr);
+	});
+}
@@ -0,0 +1,131 @@
+#pragma once
+
+#include <array>
+#include <future>
+#include <string>
+#include <vector>
+#include <vulkan/vulkan_core.h>
+
+#include "DeletionQueue.h"
+#include "Handle.h"
+#include "Utilities/Vulkan.h"
+
+typedef unsigned char stbi_uc;
+
+typedef Handle<struct TextureTag> TextureHandle;
+
+// Owns every texture of the bindless texture table and keeps them within the VRAM budget:
+// textures start with their low mips only and stream higher ones from disk in the background as draws need them,
+// textures that haven't been drawn lately lose their top mips or get evicted (their slot shows the default texture).
+// Textures are referenced through handles, the slot of a handle is the texture id (element of the texture table)
+class TextureManager
+{
+public:
+	// Replaced images and removed slots go through the renderer's deletion queue
+	void init(VkSampler newSampler, const std::array<VkDescriptorSet, MAX_FRAME_DRAWS>& newDescriptorSets,
+		DeletionQueue* newDeletionQueue, bool newMemoryBudgetSupported, VkDeviceSize newBudgetOverride);
+
+	// Uploads the pixels of mip baseMip of a width x height texture (takes ownership of them),
+	// the first texture added is the default texture
+	TextureHandle addTexture(const std::string& fileName, stbi_uc* imageData, int width, int height, uint32_t baseMip);
+
+	// Frees the texture, its slot is reused once no frame in flight can sample it
+	void removeTexture(TextureHandle handle);
+
+	// Mark texture as used by the frame being recorded, drawn with pixelsPerUv screen pixels per UV unit,
+	// requests the mips that draw needs if they aren't resident
+	void touch(TextureHandle handle, float pixelsPerUv);
+
+	// Called once per frame right after waiting on the frame's fence, before recording
+	void update(uint64_t frameNumber, uint32_t frameIndex);
+
+	void destroy();
+
+	inline bool isValid(TextureHandle handle) const { return handles.isValid(handle.value); }
+	inline TextureHandle getDefaultTexture() const { return defaultTexture; }
+	// Element of the bindless texture table the shaders index
+	inline uint32_t getTextureId(TextureHandle handle) const { return handle.getIndex(); }
+	// Some texel of the loaded mips isn't fully opaque
+	inline bool hasTransparency(TextureHandle handle) const { return transparencies[handle.getIndex()]; }
+
+	inline VkDeviceSize getResidentBytes() const { return residentBytes; }
+	inline VkDeviceSize getBudget() const { return budget; }
+	VkDeviceSize getTextureBytes(TextureHandle handle) const;
+	VkDeviceSize getMipBytes(TextureHandle handle, uint32_t mipLevel) const;
+private:
+	// Descriptor write that still has to reach the table of a frame that was in flight when it happened
+	struct PendingWrite {
+		uint32_t textureId;
+		VkImageView imageView;
+	};
+
+	struct DecodedTexture {
+		stbi_uc* imageData;
+		int width;
+		int height;
+		VkDeviceSize imageSize;
+	};
+
+	struct PendingStream {
+		TextureHandle handle;
+		uint32_t baseMip; // First level the decoded pixels hold
+		std::future<DecodedTexture> decoded;
+	};
+
+	VkSampler sampler;
+	std::array<VkDescriptorSet, MAX_FRAME_DRAWS> descriptorSets;
+	std::array<std::vector<PendingWrite>, MAX_FRAME_DRAWS> pendingWrites;
+	DeletionQueue* deletionQueue = nullptr;
+
+	bool memoryBudgetSupported = false;
+	VkDeviceSize budgetOverride = 0; // Fixed texture budget, 0 to follow the driver's budget
+	VkDeviceSize budget = 0; // Bytes textures may use this frame
+	VkDeviceSize residentBytes = 0; // Bytes used by every resident mip level of every texture
+	VkDeviceSize hotBytes = 0; // Resident bytes of the textures drawn by the frames that may be in flight
+
+	uint64_t frameNumber = 0;
+	uint32_t frameIndex = 0;
+
+	HandleAllocator handles;
+	TextureHandle defaultTexture;
+
+	// Per texture data, indexed by texture id (slot of the handle)
+	std::vector<VkImage> textureImages;
+	std::vector<VkDeviceMemory> textureImageMemory;
+	std::vector<VkImageView> textureImageViews;
+	std::vector<std::string> fileNames; // Source file to reload from
+	std::vector<uint32_t> widths; // Size of mip 0
+	std::vector<uint32_t> heights;
+	std::vector<uint32_t> mipLevels; // Levels of the full chain
+	std::vector<uint32_t> residentBaseMips; // First resident level, mipLevels when evicted
+	std::vector<uint32_t> requestedBaseMips; // Finest level the draws of the last frame needed, mipLevels when not drawn
+	std::vector<uint64_t> lastUsedFrames;
+	std::vector<bool> streamRequested;
+	std::vector<bool> transparencies;
+
+	std::vector<PendingStream> pendingStreams;
+
+	VkDeviceSize queryBudget() const;
+	bool makeRoom(VkDeviceSize extraBytes);
+	void finishStreams();
+
+	uint32_t getWantedMip(int textureId, float pixelsPerUv) const;
+	int findOverResident() const;
+	int findLeastRecentlyUsed(bool droppableOnly) const;
+	void dropTopMip(int textureId);
+	void evict(int textureId);
+
+	// Submits a streaming upload or mip drop without waiting on the queue, the command buffer and staging buffer
+	// (if any) are freed once this frame has finished
+	void submitUpload(VkCommandBuffer commandBuffer, VkBuffer stagingBuffer, VkDeviceMemory stagingBufferMemory);
+
+	// Point a slot at a new view, either right away in every table (slot unused by frames in flight) or frame by frame
+	void writeSlotNow(int textureId, VkImageView imageView);
+	void writeSlotDeferred(int textureId, VkImageView imageView);
+	void discardPendingWrites(int textureId);
+	// Hand the current image of a slot to the deletion queue, frames in flight may still sample it
+	void retireImage(int textureId);
+
+	VkDeviceSize getMipBytes(int textureId, uint32_t mipLevel) const;
+	VkDeviceSize getChainBytes(int textureId, uint32_t baseMip) const;
+};
@@ -0,0 +1,188 @@
+#include "TransformHierarchy.h"
+
+#include <algorithm>
+#include <assert.h>
+
+#include "Globals.h"
+#include "Utilities/ThreadPool.h"
+
+uint32_t TransformHierarchy::addNode(uint32_t parent, const glm::mat4& local)
+{
+	uint32_t node = static_cast<uint32_t>(slots.size());
+	assert((parent == NO_PARENT || parent < node) && "Parent node has to be added first!");
+
+	nodeParents.push_back(parent);
+	nodeDepths.push_back(parent == NO_PARENT ? 0 : nodeDepths[parent] + 1);
+
+	// Goes at the end until the next update sorts it into its level
+	slots.push_back(node);
+	parentSlots.push_back(parent == NO_PARENT ? NO_PARENT : slots[parent]);
+	locals.push_back(local);
+	worlds.push_back(local);
+	dirty.push_back(1);
+
+	layoutChanged = true;
+
+	return node;
+}
+
+void TransformHierarchy::clear()
+{
+	nodeParents.clear();
+	nodeDepths.clear();
+	slots.clear();
+	parentSlots.clear();
+	locals.clear();
+	worlds.clear();
+	dirty.clear();
+	childBegins.clear();
+	childEnds.clear();
+	levelStarts.clear();
+	dirtyBegins.clear();
+	dirtyEnds.clear();
+	layoutChanged = false;
+}
+
+void TransformHierarchy::setLocal(uint32_t node, const glm::mat4& local)
+{
+	assert(node < slots.size() && "Attempted to access invalid Node!");
+
+	uint32_t slot = slots[node];
+	locals[slot] = local;
+	dirty[slot] = 1;
+
+	// New nodes aren't in their level yet, the next update walks everything anyway
+	if (!layoutChanged)
+	{
+		markDirty(nodeDepths[node], slot, slot + 1);
+	}
+}
+
+void TransformHierarchy::update()
+{
+	if (layoutChanged)
+	{
+		sortByDepth();
+	}
+
+	// A node is dirty when its own local changed or its parent's world did, parents sit one level up and are final by then
+	uint32_t levelCount = static_cast<uint32_t>(dirtyBegins.size());
+	for (uint32_t level = 0; level < levelCount; level++)
+	{
+		uint32_t dirtyBegin = dirtyBegins[level];
+		uint32_t dirtyEnd = dirtyEnds[level];
+		if (dirtyBegin >= dirtyEnd)
+		{
+			continue;
+		}
+
+		Globals::threadPool->parallelFor(dirtyEnd - dirtyBegin, NODES_PER_TASK, [this, dirtyBegin](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t slot = dirtyBegin + begin; slot < dirtyBegin + end; slot++)
+			{
+				uint32_t parentSlot = parentSlots[slot];
+				if (parentSlot != NO_PARENT)
+				{
+					dirty[slot] |= dirty[parentSlot];
+				}
+
+				if (dirty[slot])
+				{
+					worlds[slot] = parentSlot == NO_PARENT ? locals[slot] : worlds[parentSlot] * locals[slot];
+				}
+			}
+		});
+
+		// The children of what ended up dirty are what the next level has to look at
+		if (level + 1 < levelCount)
+		{
+			for (uint32_t slot = dirtyBegin; slot < dirtyEnd; slot++)
+			{
+				if (dirty[slot] && childBegins[slot] < childEnds[slot])
+				{
+					markDirty(level + 1, childBegins[slot], childEnds[slot]);
+				}
+			}
+		}
+	}
+
+	// Only the ranges visited can hold dirty flags
+	for (uint32_t level = 0; level < levelCount; level++)
+	{
+		if (dirtyBegins[level] < dirtyEnds[level])
+		{
+			std::fill(dirty.begin() + dirtyBegins[level], dirty.begin() + dirtyEnds[level], static_cast<uint8_t>(0));
+		}
+		dirtyBegins[level] = UINT32_MAX;
+		dirtyEnds[level] = 0;
+	}
+}
+
+void TransformHierarchy::markDirty(uint32_t level, uint32_t begin, uint32_t end)
+{
+	dirtyBegins[level] = std::min(dirtyBegins[level], begin);
+	dirtyEnds[level] = std::max(dirtyEnds[level], end);
+}
+
+void TransformHierarchy::sortByDepth()
+{
+	uint32_t nodeCount = size();
+
+	// Counting sort on the depth, stable so the nodes of a level keep the order they were added in
+	uint32_t levelCount = nodeCount > 0 ? *std::max_element(nodeDepths.begin(), nodeDepths.end()) + 1 : 0;
+	levelStarts.assign(levelCount + 1, 0);
+	for (uint32_t node = 0; node < nodeCount; node++)
+	{
+		levelStarts[nodeDepths[node] + 1]++;
+	}
+	for (uint32_t level = 0; level < levelCount; level++)
+	{
+		levelStarts[level + 1] += levelStarts[level];
+	}
+
+	std::vector<uint32_t> newSlots(nodeCount);
+	std::vector<uint32_t> nextSlots(levelStarts.begin(), levelStarts.end() - 1);
+	for (uint32_t node = 0; node < nodeCount; node++)
+	{
+		newSlots[node] = nextSlots[nodeDepths[node]]++;
+	}
+
+	std::vector<glm::mat4> newLocals(nodeCount);
+	std::vector<glm::mat4> newWorlds(nodeCount);
+	std::vector<uint8_t> newDirty(nodeCount);
+	for (uint32_t node = 0; node < nodeCount; node++)
+	{
+		uint32_t slot = newSlots[node];
+		newLocals[slot] = locals[slots[node]];
+		newWorlds[slot] = worlds[slots[node]];
+		newDirty[slot] = dirty[slots[node]];
+	}
+
+	childBegins.assign(nodeCount, UINT32_MAX);
+	childEnds.assign(nodeCount, 0);
+	for (uint32_t node = 0; node < nodeCount; node++)
+	{
+		uint32_t slot = newSlots[node];
+		if (nodeParents[node] == NO_PARENT)
+		{
+			parentSlots[slot] = NO_PARENT;
+			continue;
+		}
+
+		uint32_t parentSlot = newSlots[nodeParents[node]];
+		parentSlots[slot] = parentSlot;
+		childBegins[parentSlot] = std::min(childBegins[parentSlot], slot);
+		childEnds[parentSlot] = std::max(childEnds[parentSlot], slot + 1);
+	}
+
+	// Slots moved, so the whole of every level gets visited once
+	dirtyBegins.assign(levelStarts.begin(), levelStarts.end() - 1);
+	dirtyEnds.assign(levelStarts.begin() + 1, levelStarts.end());
+
+	slots = std::move(newSlots);
+	locals = std::move(newLocals);
+	worlds = std::move(newWorlds);
+	dirty = std::move(newDirty);
+
+	layoutChanged = false;
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+#include <vector>
+
+#include <glm/mat4x4.hpp>
+
+// Local and world matrices of a forest of nodes, one array per field ordered by depth: every root first, then every node one level
+// down, and so on. A level only reads the level above it, so its nodes are updated in parallel once that one is done.
+// Nodes are numbered in the order they were added (ids), their position in the arrays (slot) changes when nodes are added
+class TransformHierarchy
+{
+public:
+	static const uint32_t NO_PARENT = UINT32_MAX;
+	// Nodes of a level a single task updates, smaller levels run on the calling thread
+	static const uint32_t NODES_PER_TASK = 1024;
+
+	// The parent has to be added before its children. Returns the node's id
+	uint32_t addNode(uint32_t parent, const glm::mat4& local);
+	void clear();
+
+	// Marks the node dirty, update recomputes its world matrix and the ones of its whole subtree
+	void setLocal(uint32_t node, const glm::mat4& local);
+
+	inline const glm::mat4& getLocal(uint32_t node) const { return locals[slots[node]]; }
+	// Valid after update
+	inline const glm::mat4& getWorld(uint32_t node) const { return worlds[slots[node]]; }
+	inline uint32_t getSlot(uint32_t node) const { return slots[node]; }
+
+	// Sorts newly added nodes into their level, then walks the levels top down recomputing the dirty subtrees only.
+	// Every level keeps the slot range its dirty nodes fall in, levels without any are skipped, so a static hierarchy costs nothing
+	void update();
+
+	// World matrices by slot
+	inline const std::vector<glm::mat4>& getWorlds() const { return worlds; }
+	inline uint32_t size() const { return static_cast<uint32_t>(slots.size()); }
+private:
+	// Per id
+	std::vector<uint32_t> nodeParents;
+	std::vector<uint32_t> nodeDepths;
+	std::vector<uint32_t> slots;
+
+	// Per slot
+	std::vector<uint32_t> parentSlots; // NO_PARENT for roots
+	std::vector<glm::mat4> locals;
+	std::vector<glm::mat4> worlds;
+	std::vector<uint8_t> dirty; // Local changed since the last update, spreads down to the children during it
+	std::vector<uint32_t> childBegins; // Slot range covering every child (the next level), empty for leaves
+	std::vector<uint32_t> childEnds;
+
+	std::vector<uint32_t> levelStarts; // First slot of every depth, plus one past the last slot
+	std::vector<uint32_t> dirtyBegins; // Per level, slot range holding its dirty nodes (empty when begin >= end)
+	std::vector<uint32_t> dirtyEnds;
+	bool layoutChanged = false;
+
+	void sortByDepth();
+	void markDirty(uint32_t level, uint32_t begin, uint32_t end);
+};
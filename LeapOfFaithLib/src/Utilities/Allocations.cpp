@@ -0,0 +1,51 @@
+#include "Allocations.h"
+
+#include <atomic>
+#include <cstdlib>
+#include <new>
+
+#ifdef _DEBUG
+namespace
+{
+	// Constant initialized, so allocations made before main are counted too
+	std::atomic<uint64_t> allocationCount{ 0 };
+	std::atomic<uint64_t> allocationBytes{ 0 };
+}
+
+// Array and nothrow forms of the standard library forward to these
+void* operator new(std::size_t size)
+{
+	allocationCount.fetch_add(1, std::memory_order_relaxed);
+	allocationBytes.fetch_add(size, std::memory_order_relaxed);
+
+	if (void* memory = std::malloc(size > 0 ? size : 1))
+	{
+		return memory;
+	}
+
+	throw std::bad_alloc();
+}
+
+void operator delete(void* memory) noexcept
+{
+	std::free(memory);
+}
+
+void operator delete(void* memory, std::size_t) noexcept
+{
+	std::free(memory);
+}
+#endif
+
+namespace Utilities::Allocations
+{
+	Counters getCounters()
+	{
+		Counters counters;
+#ifdef _DEBUG
+		counters.count = allocationCount.load(std::memory_order_relaxed);
+		counters.bytes = allocationBytes.load(std::memory_order_relaxed);
+#endif
+		return counters;
+	}
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+// Heap allocation counters to keep the frame loop allocation free.
+// Debug builds replace the global operator new/delete to count every allocation made through them (any thread),
+// C allocations (malloc from the driver, GLFW, stb) aren't seen. Release builds count nothing.
+namespace Utilities::Allocations
+{
+	struct Counters {
+		uint64_t count = 0; // Allocations made
+		uint64_t bytes = 0; // Bytes requested by them
+	};
+
+	// Totals since startup, diff two snapshots to get what happened in between
+	Counters getCounters();
+
+	inline bool isTracking()
+	{
+#ifdef _DEBUG
+		return true;
+#else
+		return false;
+#endif
+	}
+}
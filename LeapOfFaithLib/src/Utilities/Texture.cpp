@@ -4,31 +4,72 @@
 #include "../Globals.h"
 #include "Texture.h"
 
+#include <algorithm>
+#include <chrono>
+#include <iostream>
 #include <string>
 
 
+#include "ThreadPool.h"
 #include "Vulkan.h"
 
 namespace Utilities::Texture
 {
-	int createTexture(const char* fileName, std::vector<VkImage>& textureImages, std::vector<VkDeviceMemory>& textureImageMemory, std::vector<VkImageView>& textureImageViews,
-		VkDescriptorPool& samplerDescriptorPool, VkDescriptorSetLayout& samplerSetLayout, VkSampler& textureSampler, std::vector<VkDescriptorSet>& samplerDescriptorSets)
+	TextureHandle createTexture(const char* fileName, TextureManager& textureManager)
 	{
-		// Create Texture Image and get its location in array
-		int textureImageLoc = createTextureImage(fileName, textureImages, textureImageMemory);
+		// Load image file
+		int width, height;
+		VkDeviceSize imageSize;
+		stbi_uc* imageData = loadTextureFile(fileName, &width, &height, &imageSize);
 
-		// Create image view and add to list
-		VkImageView imageView = createImageView(textureImages[textureImageLoc], VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_ASPECT_COLOR_BIT);
-		textureImageViews.push_back(imageView);
+		// Only the low mips get uploaded, higher ones are streamed in once a draw needs them
+		uint32_t baseMip = getStreamingBaseMip(width, height);
+		int baseWidth = width, baseHeight = height;
+		downsampleTexture(imageData, &baseWidth, &baseHeight, &imageSize, baseMip);
 
-		// Create texture descriptor
-		int descriptorLoc = createTextureDescriptor(imageView, samplerDescriptorPool, Globals::vkContext->logicalDevice, samplerSetLayout, textureSampler, samplerDescriptorSets);
+		return textureManager.addTexture(fileName, imageData, width, height, baseMip);
+	}
 
-		// Return location of set with texture
-		return descriptorLoc;
+	std::vector<TextureHandle> createTextures(const std::vector<std::string>& fileNames, TextureManager& textureManager)
+	{
+		uint32_t textureCount = static_cast<uint32_t>(fileNames.size());
+
+		std::vector<stbi_uc*> imageData(textureCount);
+		std::vector<int> widths(textureCount);
+		std::vector<int> heights(textureCount);
+		std::vector<uint32_t> baseMips(textureCount);
+
+		// Decoding is pure CPU work, fan it out across the worker threads (one file per chunk)
+		auto decodeStart = std::chrono::high_resolution_clock::now();
+		Globals::threadPool->parallelFor(textureCount, 1, [&](uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				VkDeviceSize imageSize;
+				imageData[i] = loadTextureFile(fileNames[i].c_str(), &widths[i], &heights[i], &imageSize);
+
+				// Only the low mips get uploaded, higher ones are streamed in once a draw needs them
+				baseMips[i] = getStreamingBaseMip(widths[i], heights[i]);
+				int baseWidth = widths[i], baseHeight = heights[i];
+				downsampleTexture(imageData[i], &baseWidth, &baseHeight, &imageSize, baseMips[i]);
+			}
+		});
+		auto decodeTime = std::chrono::high_resolution_clock::now() - decodeStart;
+
+		std::cout << "Decoded " << textureCount << " textures in " << std::chrono::duration<double, std::milli>(decodeTime).count()
+			<< " ms using " << Globals::threadPool->getThreadCount() + 1 << " threads" << std::endl;
+
+		// Uploads go through the graphics queue, which is only used from this thread
+		std::vector<TextureHandle> textures(textureCount);
+		for (uint32_t i = 0; i < textureCount; i++)
+		{
+			textures[i] = textureManager.addTexture(fileNames[i], imageData[i], widths[i], heights[i], baseMips[i]);
+		}
+
+		return textures;
 	}
 
-	VkImage createImage(uint32_t width, uint32_t height, VkFormat format,
+	VkImage createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format,
 		VkImageTiling tiling, VkImageUsageFlags usageFlags, VkMemoryPropertyFlags propFlags,
 		VkDeviceMemory* imageMemory)
 	{
@@ -40,10 +81,10 @@ namespace Utilities::Texture
 		imageCreateInfo.extent.width = width; // w of image extent
 		imageCreateInfo.extent.height = height; // h of image extent
 		imageCreateInfo.extent.depth = 1; // Dep`th of image (just 1, no 3D aspect)
-		imageCreateInfo.mipLevels = 1; // Number of mipmap levels
+		imageCreateInfo.mipLevels = mipLevels; // Number of mipmap levels
 		imageCreateInfo.arrayLayers = 1; // Number of levels in image array
 		imageCreateInfo.format = format; // Format type of image
-		imageCreateInfo.tiling; // how image data should be tiled (arranged)
+		imageCreateInfo.tiling = tiling; // how image data should be tiled (arranged)
 		imageCreateInfo.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; // Layout of image data on creation
 		imageCreateInfo.usage = usageFlags; // Bit flags defining what image will be used for
 		imageCreateInfo.samples = VK_SAMPLE_COUNT_1_BIT; // Number of samples for multi-sampling
@@ -73,7 +114,7 @@ namespace Utilities::Texture
 		return image;
 	}
 
-	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags)
+	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels, uint32_t baseMipLevel)
 	{
 		VkImageViewCreateInfo viewCreateInfo = {};
 		viewCreateInfo.sType = VK_STRUCTURE_TYPE_IMAGE_VIEW_CREATE_INFO;
@@ -87,8 +128,8 @@ namespace Utilities::Texture
 
 		// Subresources allow the view to view only a part of an image
 		viewCreateInfo.subresourceRange.aspectMask = aspectFlags; // which aspect of the image to view, (COLOR_BIT etc)
-		viewCreateInfo.subresourceRange.baseMipLevel = 0; // start mipmap level to view from
-		viewCreateInfo.subresourceRange.levelCount = 1; // Number of mipmap levels to view
+		viewCreateInfo.subresourceRange.baseMipLevel = baseMipLevel; // start mipmap level to view from
+		viewCreateInfo.subresourceRange.levelCount = mipLevels; // Number of mipmap levels to view
 		viewCreateInfo.subresourceRange.baseArrayLayer = 0; // Start array level to view from
 		viewCreateInfo.subresourceRange.layerCount = 1; // Number of array levels to view
 
@@ -100,13 +141,29 @@ namespace Utilities::Texture
 		return imageView;
 	}
 
-	int createTextureImage(const char* fileName, std::vector<VkImage>& textureImages, std::vector<VkDeviceMemory>& textureImageMemory)
+	VkImage createTextureImage(stbi_uc* imageData, int width, int height, VkDeviceSize imageSize,
+		uint32_t* mipLevels, VkDeviceMemory* imageMemory)
 	{
-		// Load image file
-		int width, height;
-		VkDeviceSize imageSize;
-		stbi_uc* imageData = loadTextureFile(fileName, &width, &height, &imageSize);
+		// Record the whole upload in a single command buffer and wait for it, the staging buffer can go right after
+		VkCommandBuffer commandBuffer = Vulkan::beginCommandBuffer(Globals::vkContext->logicalDevice, Globals::vkContext->graphicsCommandPool);
+
+		VkBuffer imageStagingBuffer;
+		VkDeviceMemory imageStagingBufferMemory;
+		VkImage texImage = recordTextureUpload(commandBuffer, imageData, width, height, imageSize, mipLevels, imageMemory,
+		                                       &imageStagingBuffer, &imageStagingBufferMemory);
+
+		Vulkan::endAndSubmitCommandBuffer(Globals::vkContext->logicalDevice, Globals::vkContext->graphicsCommandPool, Globals::vkContext->graphicsQueue, commandBuffer);
+
+		// Destroy staging buffer
+		vkDestroyBuffer(Globals::vkContext->logicalDevice, imageStagingBuffer, nullptr);
+		vkFreeMemory(Globals::vkContext->logicalDevice, imageStagingBufferMemory, nullptr);
+
+		return texImage;
+	}
 
+	VkImage recordTextureUpload(VkCommandBuffer commandBuffer, stbi_uc* imageData, int width, int height, VkDeviceSize imageSize,
+		uint32_t* mipLevels, VkDeviceMemory* imageMemory, VkBuffer* stagingBuffer, VkDeviceMemory* stagingBufferMemory)
+	{
 		// Create staging buffer to hold loaded data, ready to copy to device
 		VkBuffer imageStagingBuffer;
 		VkDeviceMemory imageStagingBufferMemory;
@@ -123,35 +180,157 @@ namespace Utilities::Texture
 		// Free original image data
 		stbi_image_free(imageData);
 
-		// Create image to hold final texture
+		// Full mip chain, unless the device can't linearly blit our format
+		*mipLevels = getMipLevelCount(width, height);
+
+		// Create image to hold final texture (also a transfer source, lower mips are blitted from upper ones)
 		VkImage texImage;
-		VkDeviceMemory texImageMemory;
-		texImage = createImage(width, height, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
-			VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &texImageMemory);
+		texImage = createImage(width, height, *mipLevels, VK_FORMAT_R8G8B8A8_UNORM, VK_IMAGE_TILING_OPTIMAL,
+			VK_IMAGE_USAGE_TRANSFER_SRC_BIT | VK_IMAGE_USAGE_TRANSFER_DST_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, imageMemory);
 
-		// Copy data to image
+		// Transition every mip level to be DST for copy/blit operations
+		Vulkan::recordImageBarrier(commandBuffer, texImage, 0, *mipLevels,
+		                           VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+		                           0, VK_ACCESS_TRANSFER_WRITE_BIT,
+		                           VK_PIPELINE_STAGE_TOP_OF_PIPE_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
 
-		// Transition image to be DST for copy operation
-		Vulkan::transitionImageLayout(Globals::vkContext->logicalDevice, Globals::vkContext->graphicsQueue, Globals::vkContext->graphicsCommandPool,
-		                              texImage, VK_IMAGE_LAYOUT_UNDEFINED, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL);
+		// Copy image data to the top mip level
+		Vulkan::recordCopyImageBuffer(commandBuffer, imageStagingBuffer, texImage, width, height);
 
-		// Copy image data
-		Vulkan::copyImageBuffer(Globals::vkContext->logicalDevice, Globals::vkContext->graphicsQueue, Globals::vkContext->graphicsCommandPool, imageStagingBuffer, texImage, width, height);
+		// Fill the rest of the chain and leave every level shader readable
+		recordMipmapGeneration(commandBuffer, texImage, width, height, *mipLevels);
 
-		// Transition image to be shader readable for shader usage
-		Vulkan::transitionImageLayout(Globals::vkContext->logicalDevice, Globals::vkContext->graphicsQueue, Globals::vkContext->graphicsCommandPool,
-		                              texImage, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL);
+		// The copy reads the staging buffer once the command buffer runs, the caller frees it after that
+		*stagingBuffer = imageStagingBuffer;
+		*stagingBufferMemory = imageStagingBufferMemory;
 
-		// Add texture data to vector for reference
-		textureImages.push_back(texImage);
-		textureImageMemory.push_back(texImageMemory);
+		return texImage;
+	}
 
-		// Destroy staging buffer
-		vkDestroyBuffer(Globals::vkContext->logicalDevice, imageStagingBuffer, nullptr);
-		vkFreeMemory(Globals::vkContext->logicalDevice, imageStagingBufferMemory, nullptr);
+	uint32_t getMipLevelCount(uint32_t width, uint32_t height)
+	{
+		// Blitting between mip levels needs linear filtering support for the texture format
+		VkFormatProperties formatProperties;
+		vkGetPhysicalDeviceFormatProperties(Globals::vkContext->physicalDevice, VK_FORMAT_R8G8B8A8_UNORM, &formatProperties);
+		if (!(formatProperties.optimalTilingFeatures & VK_FORMAT_FEATURE_SAMPLED_IMAGE_FILTER_LINEAR_BIT))
+		{
+			return 1;
+		}
+
+		// One level per halving of the largest side, down to 1x1
+		uint32_t mipLevels = 1;
+		uint32_t size = std::max(width, height);
+		while (size > 1)
+		{
+			size >>= 1;
+			mipLevels++;
+		}
+
+		return mipLevels;
+	}
 
-		// Return index to the new image
-		return textureImages.size() - 1;
+	uint32_t getStreamingBaseMip(uint32_t width, uint32_t height)
+	{
+		// Skip the levels bigger than the minimum resident size (never past the last level of the chain)
+		uint32_t lastMip = getMipLevelCount(width, height) - 1;
+		uint32_t baseMip = 0;
+		while (baseMip < lastMip && std::max(width >> baseMip, height >> baseMip) > MIN_RESIDENT_MIP_SIZE)
+		{
+			baseMip++;
+		}
+
+		return baseMip;
+	}
+
+	void downsampleTexture(stbi_uc* imageData, int* width, int* height, VkDeviceSize* imageSize, uint32_t levels)
+	{
+		// 2x2 box filter per level, done in place: every output pixel sits at or before the first pixel it reads
+		for (uint32_t level = 0; level < levels; level++)
+		{
+			int srcWidth = *width;
+			int srcHeight = *height;
+			int dstWidth = std::max(1, srcWidth / 2);
+			int dstHeight = std::max(1, srcHeight / 2);
+
+			for (int y = 0; y < dstHeight; y++)
+			{
+				// Odd sizes (or a side already at 1) reuse the last row/column
+				int y0 = std::min(y * 2, srcHeight - 1);
+				int y1 = std::min(y * 2 + 1, srcHeight - 1);
+
+				for (int x = 0; x < dstWidth; x++)
+				{
+					int x0 = std::min(x * 2, srcWidth - 1);
+					int x1 = std::min(x * 2 + 1, srcWidth - 1);
+
+					for (int channel = 0; channel < 4; channel++)
+					{
+						uint32_t sum = imageData[(y0 * srcWidth + x0) * 4 + channel] + imageData[(y0 * srcWidth + x1) * 4 + channel]
+							+ imageData[(y1 * srcWidth + x0) * 4 + channel] + imageData[(y1 * srcWidth + x1) * 4 + channel];
+						imageData[(y * dstWidth + x) * 4 + channel] = static_cast<stbi_uc>((sum + 2) / 4);
+					}
+				}
+			}
+
+			*width = dstWidth;
+			*height = dstHeight;
+		}
+
+		*imageSize = static_cast<VkDeviceSize>(*width) * (*height) * 4;
+	}
+
+	void recordMipmapGeneration(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels)
+	{
+		// Expects every level in TRANSFER_DST with level 0 already filled, leaves every level in SHADER_READ_ONLY
+		int32_t mipWidth = static_cast<int32_t>(width);
+		int32_t mipHeight = static_cast<int32_t>(height);
+
+		for (uint32_t level = 1; level < mipLevels; level++)
+		{
+			// Previous level has been written, make it the source of the blit
+			Vulkan::recordImageBarrier(commandBuffer, image, level - 1, 1,
+			                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+			                           VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_TRANSFER_READ_BIT,
+			                           VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_TRANSFER_BIT);
+
+			int32_t nextWidth = mipWidth > 1 ? mipWidth / 2 : 1;
+			int32_t nextHeight = mipHeight > 1 ? mipHeight / 2 : 1;
+
+			// Downsample previous level into this one
+			VkImageBlit blit = {};
+			blit.srcOffsets[0] = { 0, 0, 0 };
+			blit.srcOffsets[1] = { mipWidth, mipHeight, 1 };
+			blit.srcSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.srcSubresource.mipLevel = level - 1;
+			blit.srcSubresource.baseArrayLayer = 0;
+			blit.srcSubresource.layerCount = 1;
+			blit.dstOffsets[0] = { 0, 0, 0 };
+			blit.dstOffsets[1] = { nextWidth, nextHeight, 1 };
+			blit.dstSubresource.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+			blit.dstSubresource.mipLevel = level;
+			blit.dstSubresource.baseArrayLayer = 0;
+			blit.dstSubresource.layerCount = 1;
+
+			vkCmdBlitImage(commandBuffer,
+				image, VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL,
+				image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL,
+				1, &blit, VK_FILTER_LINEAR);
+
+			// Previous level is final, hand it to the fragment shader
+			Vulkan::recordImageBarrier(commandBuffer, image, level - 1, 1,
+			                           VK_IMAGE_LAYOUT_TRANSFER_SRC_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+			                           VK_ACCESS_TRANSFER_READ_BIT, VK_ACCESS_SHADER_READ_BIT,
+			                           VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
+
+			mipWidth = nextWidth;
+			mipHeight = nextHeight;
+		}
+
+		// Last level was only ever written to
+		Vulkan::recordImageBarrier(commandBuffer, image, mipLevels - 1, 1,
+		                           VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL,
+		                           VK_ACCESS_TRANSFER_WRITE_BIT, VK_ACCESS_SHADER_READ_BIT,
+		                           VK_PIPELINE_STAGE_TRANSFER_BIT, VK_PIPELINE_STAGE_FRAGMENT_SHADER_BIT);
 	}
 
 	stbi_uc* loadTextureFile(const char* fileName, int* width, int* height, VkDeviceSize* imageSize)
@@ -169,21 +348,10 @@ namespace Utilities::Texture
 		return image;
 	}
 
-	int createTextureDescriptor(VkImageView textureImage, VkDescriptorPool& samplerDescriptorPool, VkDevice& logicalDevice,
-		VkDescriptorSetLayout& samplerSetLayout, VkSampler& textureSampler, std::vector<VkDescriptorSet>& samplerDescriptorSets)
+	void writeTextureDescriptor(uint32_t textureId, VkImageView textureImage, VkDevice& logicalDevice,
+		VkSampler& textureSampler, VkDescriptorSet& textureDescriptorSet)
 	{
-		VkDescriptorSet descriptorSet;
-
-		// Descriptor set allocation info
-		VkDescriptorSetAllocateInfo setAllocInfo = {};
-		setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
-		setAllocInfo.descriptorPool = samplerDescriptorPool;
-		setAllocInfo.descriptorSetCount = 1;
-		setAllocInfo.pSetLayouts = &samplerSetLayout;
-
-		// Allocate Descriptor Sets
-		VkResult result = vkAllocateDescriptorSets(logicalDevice, &setAllocInfo, &descriptorSet);
-		assert(result == VK_SUCCESS && "Failed to allocate Texture Descriptor Sets!");
+		assert(textureId < MAX_TEXTURES && "Texture table is full!");
 
 		// Texture Image info
 		VkDescriptorImageInfo imageInfo = {};
@@ -191,23 +359,17 @@ namespace Utilities::Texture
 		imageInfo.imageView = textureImage; // Image to bind to set
 		imageInfo.sampler = textureSampler; // Sampler to use for set
 
-		// Descriptor write info
+		// Descriptor write info, the texture id is the element of the texture array
 		VkWriteDescriptorSet descriptorWrite = {};
 		descriptorWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		descriptorWrite.dstSet = descriptorSet;
+		descriptorWrite.dstSet = textureDescriptorSet;
 		descriptorWrite.dstBinding = 0;
-		descriptorWrite.dstArrayElement = 0;
+		descriptorWrite.dstArrayElement = textureId;
 		descriptorWrite.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
 		descriptorWrite.descriptorCount = 1;
 		descriptorWrite.pImageInfo = &imageInfo;
 
-		// Update new descriptor set
+		// Update the element, allowed while the set is bound (UPDATE_AFTER_BIND) as long as pending draws don't use it
 		vkUpdateDescriptorSets(logicalDevice, 1, &descriptorWrite, 0, nullptr);
-
-		// Add descriptor set to list
-		samplerDescriptorSets.push_back(descriptorSet);
-
-		// Return descriptor set location
-		return samplerDescriptorSets.size() - 1;
 	}
-}
+}
\ No newline at end of file
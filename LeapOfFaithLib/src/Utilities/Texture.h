@@ -1,26 +1,44 @@
 #pragma once
+#include <string>
 #include <vector>
 
 #include <vulkan/vulkan_core.h>
 
-typedef unsigned char stbi_uc;
+#include "../TextureManager.h"
 
 namespace Utilities::Texture
 {
-	int createTexture(const char* fileName,
-		std::vector<VkImage>& textureImages, std::vector<VkDeviceMemory>& textureImageMemory, std::vector<VkImageView>& textureImageViews,
-		VkDescriptorPool& samplerDescriptorPool, VkDescriptorSetLayout& samplerSetLayout, VkSampler& textureSampler, std::vector<VkDescriptorSet>& samplerDescriptorSets);
+	TextureHandle createTexture(const char* fileName, TextureManager& textureManager);
 
-	VkImage createImage(uint32_t width, uint32_t height, VkFormat format,
+	std::vector<TextureHandle> createTextures(const std::vector<std::string>& fileNames, TextureManager& textureManager);
+
+	VkImage createImage(uint32_t width, uint32_t height, uint32_t mipLevels, VkFormat format,
 		VkImageTiling tiling, VkImageUsageFlags usageFlags, VkMemoryPropertyFlags propFlags,
 		VkDeviceMemory* imageMemory);
 
-	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags);
+	// View of mipLevels levels starting at baseMipLevel
+	VkImageView createImageView(VkImage image, VkFormat format, VkImageAspectFlags aspectFlags, uint32_t mipLevels, uint32_t baseMipLevel = 0);
+
+	VkImage createTextureImage(stbi_uc* imageData, int width, int height, VkDeviceSize imageSize,
+		uint32_t* mipLevels, VkDeviceMemory* imageMemory);
+
+	// Records the upload of createTextureImage (transition, copy, mip generation) into commandBuffer without submitting it,
+	// the staging buffer it returns must outlive the command buffer's execution
+	VkImage recordTextureUpload(VkCommandBuffer commandBuffer, stbi_uc* imageData, int width, int height, VkDeviceSize imageSize,
+		uint32_t* mipLevels, VkDeviceMemory* imageMemory, VkBuffer* stagingBuffer, VkDeviceMemory* stagingBufferMemory);
+
+	uint32_t getMipLevelCount(uint32_t width, uint32_t height);
+
+	// First mip level uploaded for a texture, the rest of the chain above it is streamed on demand
+	uint32_t getStreamingBaseMip(uint32_t width, uint32_t height);
+
+	// Shrink RGBA pixels by the given number of mip levels in place, updating size and dimensions
+	void downsampleTexture(stbi_uc* imageData, int* width, int* height, VkDeviceSize* imageSize, uint32_t levels);
 
-	int createTextureImage(const char* fileName, std::vector<VkImage>& textureImages, std::vector<VkDeviceMemory>& textureImageMemory);
+	void recordMipmapGeneration(VkCommandBuffer commandBuffer, VkImage image, uint32_t width, uint32_t height, uint32_t mipLevels);
 
 	stbi_uc* loadTextureFile(const char* fileName, int* width, int* height, VkDeviceSize* imageSize);
 
-	int createTextureDescriptor(VkImageView textureImage, VkDescriptorPool& samplerDescriptorPool, VkDevice& logicalDevice,
-		VkDescriptorSetLayout& samplerSetLayout, VkSampler& textureSampler, std::vector<VkDescriptorSet>& samplerDescriptorSets);
+	void writeTextureDescriptor(uint32_t textureId, VkImageView textureImage, VkDevice& logicalDevice,
+		VkSampler& textureSampler, VkDescriptorSet& textureDescriptorSet);
 };
\ No newline at end of file
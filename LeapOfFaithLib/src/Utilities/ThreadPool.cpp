@@ -0,0 +1,125 @@
+#include "ThreadPool.h"
+
+#include <algorithm>
+
+namespace Utilities
+{
+	ThreadPool::ThreadPool(uint32_t threadCount)
+	{
+		// Submitted tasks only ever run on a worker, without one their futures would never become ready
+		for (uint32_t i = 0; i < std::max(threadCount, 1u); i++)
+		{
+			workers.emplace_back(&ThreadPool::workerLoop, this);
+		}
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			stopping = true;
+		}
+		queueCondition.notify_all();
+
+		for (auto& worker : workers)
+		{
+			worker.join();
+		}
+	}
+
+	void ThreadPool::parallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& body)
+	{
+		if (count == 0)
+		{
+			return;
+		}
+
+		// One chunk per worker plus one for the calling thread, but never smaller than the grain
+		uint32_t chunkCount = std::min(getThreadCount() + 1, (count + grainSize - 1) / std::max(grainSize, 1u));
+		uint32_t chunkSize = (count + chunkCount - 1) / chunkCount;
+
+		// Work that fits in one chunk runs right here without waking the workers
+		if (chunkCount == 1)
+		{
+			body(0, count);
+			return;
+		}
+
+		std::lock_guard<std::mutex> jobLock(jobMutex);
+
+		{
+			std::lock_guard<std::mutex> lock(queueMutex);
+			job.body = &body;
+			job.count = count;
+			job.chunkSize = chunkSize;
+			job.chunkCount = chunkCount;
+			job.nextChunk = 0;
+			job.finishedChunks = 0;
+			job.workersInside = 0;
+			job.active = true;
+		}
+		queueCondition.notify_all();
+
+		// Chunks run here too instead of idling, a worker busy with a queued task simply never joins
+		runChunks();
+
+		// Chunks claimed by workers may still be running
+		std::unique_lock<std::mutex> lock(queueMutex);
+		jobCondition.wait(lock, [this]() { return job.finishedChunks == job.chunkCount && job.workersInside == 0; });
+		job.active = false;
+		job.body = nullptr;
+	}
+
+	bool ThreadPool::hasUnclaimedChunks() const
+	{
+		return job.active && job.nextChunk < job.chunkCount;
+	}
+
+	void ThreadPool::runChunks()
+	{
+		uint32_t chunk;
+		while ((chunk = job.nextChunk.fetch_add(1)) < job.chunkCount)
+		{
+			uint32_t begin = chunk * job.chunkSize;
+			(*job.body)(begin, std::min(begin + job.chunkSize, job.count));
+			job.finishedChunks.fetch_add(1);
+		}
+	}
+
+	void ThreadPool::workerLoop()
+	{
+		while (true)
+		{
+			std::function<void()> task;
+			{
+				std::unique_lock<std::mutex> lock(queueMutex);
+				queueCondition.wait(lock, [this]() { return stopping || !tasks.empty() || hasUnclaimedChunks(); });
+
+				// Frame work waiting in parallelFor goes before queued tasks
+				if (hasUnclaimedChunks())
+				{
+					job.workersInside++;
+					lock.unlock();
+
+					runChunks();
+
+					lock.lock();
+					job.workersInside--;
+					lock.unlock();
+					jobCondition.notify_one();
+					continue;
+				}
+
+				if (stopping && tasks.empty())
+				{
+					return;
+				}
+
+				task = std::move(tasks.front());
+				tasks.pop();
+			}
+
+			task();
+		}
+	}
+}
@@ -0,0 +1,70 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <thread>
+#include <vector>
+
+namespace Utilities
+{
+	// Fixed set of worker threads consuming a shared task queue, always at least one
+	class ThreadPool
+	{
+	public:
+		explicit ThreadPool(uint32_t threadCount);
+		~ThreadPool();
+
+		// Queue a task, the returned future becomes ready once a worker has run it
+		template<typename Task>
+		auto submit(Task&& task) -> std::future<decltype(task())>
+		{
+			auto packagedTask = std::make_shared<std::packaged_task<decltype(task())()>>(std::forward<Task>(task));
+			std::future<decltype(task())> result = packagedTask->get_future();
+			{
+				std::lock_guard<std::mutex> lock(queueMutex);
+				tasks.emplace([packagedTask]() { (*packagedTask)(); });
+			}
+			queueCondition.notify_one();
+			return result;
+		}
+
+		// Split [0, count) in chunks of at least grainSize and run body(begin, end) on the workers and the calling thread.
+		// Returns once every chunk has run, a single chunk runs on the calling thread without touching the pool.
+		// Never allocates: chunks are claimed from a single job slot, the caller takes whatever the workers haven't picked up
+		// (queued tasks don't hold it back). Must not be called from inside a pool task.
+		void parallelFor(uint32_t count, uint32_t grainSize, const std::function<void(uint32_t, uint32_t)>& body);
+
+		inline uint32_t getThreadCount() const { return static_cast<uint32_t>(workers.size()); }
+	private:
+		std::vector<std::thread> workers;
+		std::queue<std::function<void()>> tasks;
+		std::mutex queueMutex;
+		std::condition_variable queueCondition;
+		bool stopping = false;
+
+		// The parallelFor being run, one at a time. Workers join it under queueMutex while it's active,
+		// the caller only lets it go once every chunk has run and no worker is left inside
+		struct ParallelJob {
+			const std::function<void(uint32_t, uint32_t)>* body = nullptr;
+			uint32_t count = 0;
+			uint32_t chunkSize = 0;
+			uint32_t chunkCount = 0;
+			std::atomic<uint32_t> nextChunk{ 0 };
+			std::atomic<uint32_t> finishedChunks{ 0 };
+			uint32_t workersInside = 0;
+			bool active = false;
+		};
+		ParallelJob job;
+		std::mutex jobMutex; // Serializes parallelFor callers
+		std::condition_variable jobCondition; // Signalled when a worker leaves the job
+
+		void workerLoop();
+		bool hasUnclaimedChunks() const;
+		void runChunks();
+	};
+}
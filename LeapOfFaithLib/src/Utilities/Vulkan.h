@@ -6,7 +6,14 @@
 #include "../DataStructures.h"
 
 const int MAX_FRAME_DRAWS = 2;
-const int MAX_OBJECTS = 20;
+const uint32_t MAX_OBJECTS = 1 << 16; // Transforms the per-frame object buffer holds (one per node of every renderable entity's hierarchy)
+const uint32_t MAX_DRAWS = 1 << 16; // Mesh draws the indirect buffers hold per frame (one per model and mesh, drawing every instance)
+const uint32_t MAX_DRAW_INSTANCES = 1 << 16; // Instances of all the mesh draws together, what culling tests one by one
+const uint32_t MAX_DRAW_BUCKETS = 64; // Pipeline/geometry buffer combinations drawn per frame (one indirect call each)
+const uint32_t MAX_TEXTURES = 4096; // Size of the bindless texture array
+const uint32_t MIN_RESIDENT_MIP_SIZE = 64; // Textures start streaming from this size, and over budget lose top mips down to it before being evicted
+const uint32_t MAX_GEOMETRY_VERTICES = 1 << 20; // Capacity of the shared vertex buffer (32 MB)
+const uint32_t MAX_GEOMETRY_INDICES = 1 << 22; // Capacity of the shared index buffer (16 MB)
 
 const std::vector<const char*> deviceExtensions = {
 	VK_KHR_SWAPCHAIN_EXTENSION_NAME
@@ -62,7 +69,7 @@ namespace Utilities::Vulkan
 	// Information to create a buffer (doesn't include assigning memory)
 		VkBufferCreateInfo bufferInfo = {};
 		bufferInfo.sType = VK_STRUCTURE_TYPE_BUFFER_CREATE_INFO;
-		bufferInfo.size = sizeof(Vertex) * bufferSize;		// Size of buffer (size of 1 vertex * number of vertices)
+		bufferInfo.size = bufferSize;		// Size of buffer in bytes
 		bufferInfo.usage = bufferUsage;		// Multiple types of buffer possible
 		bufferInfo.sharingMode = VK_SHARING_MODE_EXCLUSIVE;			// Similar to Swap Chain images, can share vertex buffers
 
@@ -134,6 +141,23 @@ namespace Utilities::Vulkan
 		vkFreeCommandBuffers(device, commandPool, 1, &commandBuffer);
 	}
 
+	// Same as endAndSubmitCommandBuffer without waiting: later submissions to the queue see its results (through its barriers),
+	// the caller frees the command buffer and whatever it reads once a fence signalled after it has been waited on
+	static void endAndSubmitCommandBufferNoWait(VkQueue queue, VkCommandBuffer commandBuffer)
+	{
+		// End commands
+		vkEndCommandBuffer(commandBuffer);
+
+		// Queue submission information
+		VkSubmitInfo submitInfo = {};
+		submitInfo.sType = VK_STRUCTURE_TYPE_SUBMIT_INFO;
+		submitInfo.commandBufferCount = 1;
+		submitInfo.pCommandBuffers = &commandBuffer;
+
+		VkResult result = vkQueueSubmit(queue, 1, &submitInfo, VK_NULL_HANDLE);
+		assert(result == VK_SUCCESS && "Failed to submit command buffer to queue!");
+	}
+
 	static void copyBuffer(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool,
 		VkBuffer srcBuffer, VkBuffer dstBuffer, VkDeviceSize bufferSize)
 	{
@@ -152,12 +176,8 @@ namespace Utilities::Vulkan
 		endAndSubmitCommandBuffer(device, transferCommandPool, transferQueue, transferCommandBuffer);
 	}
 
-	static void copyImageBuffer(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool,
-		VkBuffer srcBuffer, VkImage image, uint32_t width, uint32_t height)
+	static void recordCopyImageBuffer(VkCommandBuffer transferCommandBuffer, VkBuffer srcBuffer, VkImage image, uint32_t width, uint32_t height)
 	{
-		// Create the buffer
-		VkCommandBuffer transferCommandBuffer = beginCommandBuffer(device, transferCommandPool);
-
 		VkBufferImageCopy imageRegion = {};
 		imageRegion.bufferOffset = 0; // Offset into data
 		imageRegion.bufferRowLength = 0; // Row length of data to calculate data spacing
@@ -171,10 +191,41 @@ namespace Utilities::Vulkan
 
 		// Copy buffer to given image
 		vkCmdCopyBufferToImage(transferCommandBuffer, srcBuffer, image, VK_IMAGE_LAYOUT_TRANSFER_DST_OPTIMAL, 1, &imageRegion);
+	}
+
+	static void copyImageBuffer(VkDevice device, VkQueue transferQueue, VkCommandPool transferCommandPool,
+		VkBuffer srcBuffer, VkImage image, uint32_t width, uint32_t height)
+	{
+		// Create the buffer
+		VkCommandBuffer transferCommandBuffer = beginCommandBuffer(device, transferCommandPool);
+
+		recordCopyImageBuffer(transferCommandBuffer, srcBuffer, image, width, height);
 
 		endAndSubmitCommandBuffer(device, transferCommandPool, transferQueue, transferCommandBuffer);
 	}
 
+	static void recordImageBarrier(VkCommandBuffer commandBuffer, VkImage image, uint32_t baseMipLevel, uint32_t levelCount,
+		VkImageLayout oldLayout, VkImageLayout newLayout, VkAccessFlags srcAccessMask, VkAccessFlags dstAccessMask,
+		VkPipelineStageFlags srcStage, VkPipelineStageFlags dstStage)
+	{
+		VkImageMemoryBarrier imageMemoryBarrier = {};
+		imageMemoryBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+		imageMemoryBarrier.oldLayout = oldLayout; // Layout to transition from
+		imageMemoryBarrier.newLayout = newLayout; // Layout to transition to
+		imageMemoryBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageMemoryBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+		imageMemoryBarrier.image = image;
+		imageMemoryBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+		imageMemoryBarrier.subresourceRange.baseMipLevel = baseMipLevel; // First mip level to start alterations on
+		imageMemoryBarrier.subresourceRange.levelCount = levelCount; // Number of mip levels to alter starting from baseMipLevel
+		imageMemoryBarrier.subresourceRange.baseArrayLayer = 0;
+		imageMemoryBarrier.subresourceRange.layerCount = 1;
+		imageMemoryBarrier.srcAccessMask = srcAccessMask; // Memory access stage transition must after...
+		imageMemoryBarrier.dstAccessMask = dstAccessMask; // Memory access stage transition must before...
+
+		vkCmdPipelineBarrier(commandBuffer, srcStage, dstStage, 0, 0, nullptr, 0, nullptr, 1, &imageMemoryBarrier);
+	}
+
 	static void transitionImageLayout(VkDevice device, VkQueue queue, VkCommandPool commandPool, VkImage image, VkImageLayout oldLayout, VkImageLayout newLayout)
 	{
 		// Create the buffer
@@ -1,5 +1,9 @@
+#include <algorithm>
 #include <array>
 #include <assert.h>
+#include <cfloat>
+#include <chrono>
+#include <iostream>
 #include <set>
 #include <glm/gtc/matrix_transform.hpp>
 
@@ -7,13 +11,28 @@
 #include <GLFW/glfw3.h>
 
 #include "VulkanRenderer.h"
+#include "BufferPool.h"
 #include "Globals.h"
 #include "Utilities/Texture.h"
 #include "Utilities/IO.h"
+#include "Utilities/ThreadPool.h"
 
-int VulkanRenderer::init(GLFWwindow* newWindow)
+int VulkanRenderer::init(GLFWwindow* newWindow, const RendererSettings& newSettings)
 {
 	window = newWindow;
+	settings = newSettings;
+
+	// Occlusion culling is a pass of the GPU culling shader, the CPU modes decide visibility before the depth exists
+	if (settings.culling != CullingMode::Gpu)
+	{
+		settings.occlusionCulling = false;
+	}
+
+	// Keep one core for the main thread, the pool's owner helps out in parallelFor (a single core machine still gets one worker)
+	Globals::threadPool = new Utilities::ThreadPool(std::max(1u, std::thread::hardware_concurrency()) - 1);
+	// Two so a pipeline compile and a texture decode don't wait on each other
+	Globals::backgroundPool = new Utilities::ThreadPool(2);
+	Globals::bufferPool = new BufferPool();
 
 	createInstance();
 	createSurface();
@@ -22,51 +41,140 @@ int VulkanRenderer::init(GLFWwindow* newWindow)
 	createSwapChain();
 	createRenderPass();
 	createDescriptorSetLayout();
-	createPushConstantRange();
+	pipelineCache.create(settings.pipelineCacheFile);
 	createGraphicsPipeline();
+	createCullPipeline();
 	createDepthBufferImage();
 	createFramebuffers();
 	createCommandPool();
 	createCommandBuffers();
+	createRecordingCommandPools();
+	geometryBuffer.create(MAX_GEOMETRY_VERTICES, MAX_GEOMETRY_INDICES);
 	createTextureSampler();
 	//allocateDynamicBufferTransferSpace();
 	createUniformBuffers();
+	createDepthPyramid();
+	createDepthPyramidImage();
 	createDescriptorPool();
 	createDescriptorSets();
 	createSynchronization();
 
-	uboViewProjection.projection = glm::perspective(glm::radians(45.0f), (float)swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 100.0f);
+	std::cout << "Created pipelines in " << pipelineMilliseconds << " ms (" << (pipelineCache.isWarm() ? "warm" : "cold") << " pipeline cache)" << std::endl;
+
+	textureManager.init(textureSampler, textureDescriptorSets, &deletionQueue, memoryBudgetSupported, settings.textureBudget);
+
+	updateProjection();
 	uboViewProjection.view = glm::lookAt(glm::vec3(10.0f, 0.0f, 20.0f), glm::vec3(0.0f, 0.0f, -2.0f), glm::vec3(0.0f, 1.0f, 0.0f));
 
-	uboViewProjection.projection[1][1] *= -1;
+	// Resizing the window recreates the swapchain on the next frame
+	glfwSetWindowUserPointer(window, this);
+	glfwSetFramebufferSizeCallback(window, onFramebufferResized);
 
 	// Create our default "no texture" texture
-	Utilities::Texture::createTexture("plain.png",textureImages, textureImageMemory, textureImageViews, 
-	                                  samplerDescriptorPool, samplerSetLayout, textureSampler, samplerDescriptorSets);
+	Utilities::Texture::createTexture("plain.png", textureManager);
 	
 	return 0;
 }
 
-void VulkanRenderer::updateModel(int modelId, glm::mat4 newModel)
+Entity VulkanRenderer::createInstance(int modelId, const glm::mat4& transform)
 {
-	if (modelId >= modelList.size())return;
+	// Unloaded models have no meshes left, there's nothing to draw
+	if (modelId < 0 || static_cast<size_t>(modelId) >= modelList.size() || modelList[modelId].getMeshCount() == 0) return Entity();
 
-	modelList[modelId].setModel(newModel);
+	// Every entity takes one element of the object buffer for its own node plus one per node of its model
+	uint32_t instanceNodeCount = 1 + static_cast<uint32_t>(modelList[modelId].getNodeCount());
+	if (sceneNodeCount + instanceNodeCount > MAX_OBJECTS) return Entity();
+	sceneNodeCount += instanceNodeCount;
+
+	// The scene's structure version tells the renderer to rebuild its draws
+	Entity entity = scene.createEntity(COMPONENT_TRANSFORM | COMPONENT_RENDERABLE | COMPONENT_BOUNDS);
+	scene.setTransform(entity, transform);
+	scene.setRenderable(entity, { static_cast<uint32_t>(modelId) });
+
+	return entity;
+}
+
+void VulkanRenderer::setNodeTransform(Entity entity, uint32_t node, const glm::mat4& local)
+{
+	if (!scene.isValid(entity) || !scene.hasComponents(entity, COMPONENT_RENDERABLE)) return;
+
+	const Renderable& renderable = scene.getRenderable(entity);
+	if (renderable.firstNode == TransformHierarchy::NO_PARENT || node >= modelList[renderable.modelId].getNodeCount()) return;
+
+	nodeHierarchy.setLocal(renderable.firstNode + 1 + node, local);
 }
 
 void VulkanRenderer::draw()
 {
 	// Wait for given fence to signal open from last draw before continuing
 	vkWaitForFences(Globals::vkContext->logicalDevice, 1, &drawFences[currentFrame], VK_TRUE, std::numeric_limits<uint64_t>::max());
-	// Manually reset those fences
-	vkResetFences(Globals::vkContext->logicalDevice, 1, &drawFences[currentFrame]);
 
-	// 1) Get the next available image to draw and set something to singal when we're finished with the image (semaphore)
+	// 1) Get the next available image to draw and set something to singal when we're finished with the image (semaphore).
+	// A swapchain that no longer matches the window is replaced first, then the acquire tried again
 	uint32_t imageIndex;
-	vkAcquireNextImageKHR(Globals::vkContext->logicalDevice, swapchain, std::numeric_limits<uint64_t>::max(), imageAvailable[currentFrame], VK_NULL_HANDLE, &imageIndex);
-	
-	recordCommands(imageIndex);
-	updateUniformBuffers(imageIndex);
+	while (true)
+	{
+		// Minimized: the fence stays signalled, the next call starts over from here.
+		// A recreated swapchain queues the old one before this frame's flush, so it waits for the previous frame too
+		if (swapChainOutOfDate && !recreateSwapChain())
+		{
+			return;
+		}
+
+		VkResult acquireResult = vkAcquireNextImageKHR(Globals::vkContext->logicalDevice, swapchain, std::numeric_limits<uint64_t>::max(), imageAvailable[currentFrame], VK_NULL_HANDLE, &imageIndex);
+		if (acquireResult != VK_ERROR_OUT_OF_DATE_KHR)
+		{
+			// Suboptimal still presents, it gets replaced after this frame
+			assert((acquireResult == VK_SUCCESS || acquireResult == VK_SUBOPTIMAL_KHR) && "Failed to acquire a Swapchain Image!");
+			break;
+		}
+		swapChainOutOfDate = true;
+	}
+
+	// Only reset once something is going to be submitted with it
+	vkResetFences(Globals::vkContext->logicalDevice, 1, &drawFences[currentFrame]);
+
+	// This frame's previous work is done, release what was waiting on it
+	deletionQueue.flush(currentFrame);
+
+	// This frame's previous work is done, textures can be swapped, evicted or reloaded
+	textureManager.update(frameNumber, currentFrame);
+
+	// Variants done compiling replace the fallback in their draws
+	finishPipelineCompiles();
+
+	// Entities added, removed or moved between archetypes change what gets drawn and where their transforms go
+	if (sceneStructureVersion != scene.getStructureVersion())
+	{
+		sceneStructureVersion = scene.getStructureVersion();
+		sceneVersion++;
+	}
+
+	if (renderQueueVersion != sceneVersion)
+	{
+		buildNodeHierarchy();
+		buildRenderQueue();
+	}
+	updateNodeTransforms();
+	updateUniformBuffers();
+	updateDrawCommands();
+	if (settings.culling != CullingMode::Gpu)
+	{
+		cullDraws();
+	}
+
+	// Transforms live in the object buffer and draws in the indirect buffer, so the commands only need recording again when the scene itself changed
+	if (secondarySceneVersions[currentFrame] != sceneVersion)
+	{
+		recordDraws();
+	}
+
+	uint32_t commandBufferIndex = currentFrame * static_cast<uint32_t>(swapChainImages.size()) + imageIndex;
+	if (recordedSceneVersions[commandBufferIndex] != sceneVersion)
+	{
+		recordCommands(commandBufferIndex, imageIndex);
+		recordedSceneVersions[commandBufferIndex] = sceneVersion;
+	}
 
 	// 2) Submit command buffer to queue for execution, making sure it waits for the image to be signalled as available before drawing
 	// and signals when it has finished rendering
@@ -79,7 +187,7 @@ void VulkanRenderer::draw()
 	};
 	submitInfo.pWaitDstStageMask = waitStages; // Stages to check semaphores at
 	submitInfo.commandBufferCount = 1; // Number of command buffers to submit
-	submitInfo.pCommandBuffers = &commandBuffers[imageIndex]; // Command buffer to submit
+	submitInfo.pCommandBuffers = &commandBuffers[commandBufferIndex]; // Command buffer to submit
 	submitInfo.signalSemaphoreCount = 1; // Numbers of semaphores to signal
 	submitInfo.pSignalSemaphores = &renderFinished[currentFrame]; // Semaphores to signal when command buffer finishes
 
@@ -97,10 +205,18 @@ void VulkanRenderer::draw()
 	presentInfo.pImageIndices = &imageIndex; // Index of images in swapchains to present
 
 	result = vkQueuePresentKHR(presentationQueue, &presentInfo);
-	assert(result == VK_SUCCESS && "Failed to present Image");
+	if (result == VK_ERROR_OUT_OF_DATE_KHR || result == VK_SUBOPTIMAL_KHR)
+	{
+		swapChainOutOfDate = true;
+	}
+	else
+	{
+		assert(result == VK_SUCCESS && "Failed to present Image");
+	}
 
 	// Get next frame to keep value clamped
 	currentFrame = (currentFrame + 1) % MAX_FRAME_DRAWS;
+	frameNumber++;
 }
 
 void VulkanRenderer::cleanup()
@@ -109,51 +225,99 @@ void VulkanRenderer::cleanup()
 	// Wait until all commands execute before destroying
 	vkDeviceWaitIdle(Globals::vkContext->logicalDevice);
 
+	// Compiles still running use the shader modules and the pipeline layout, let them finish
+	for (PendingPipeline& pending : pendingPipelines)
+	{
+		graphicsPipelines.push_back(pending.compiled.get().pipeline);
+	}
+	pendingPipelines.clear();
+
 	//_aligned_free(modelTransferSpace);
 
 	for (size_t i = 0; i < modelList.size(); i++)
 	{
-		modelList[i].destroyMeshModel();
+		modelList[i].destroyMeshModel(meshPool, geometryBuffer, textureManager);
 	}
 
+	// Nothing is in flight anymore, release everything that was waiting (models unloaded earlier and the textures above)
+	deletionQueue.flushAll();
+	geometryBuffer.destroy();
+
 	vkDestroyDescriptorPool(Globals::vkContext->logicalDevice, samplerDescriptorPool, nullptr);
 	vkDestroyDescriptorSetLayout(Globals::vkContext->logicalDevice, samplerSetLayout, nullptr);
 
 	vkDestroySampler(Globals::vkContext->logicalDevice, textureSampler, nullptr);
 
-	for (size_t i = 0; i < textureImages.size(); i++)
-	{
-		vkDestroyImageView(Globals::vkContext->logicalDevice, textureImageViews[i], nullptr);
-		vkDestroyImage(Globals::vkContext->logicalDevice, textureImages[i], nullptr);
-		vkFreeMemory(Globals::vkContext->logicalDevice, textureImageMemory[i], nullptr);
-	}
+	textureManager.destroy();
 
 	vkDestroyImageView(Globals::vkContext->logicalDevice, depthBufferImageView, nullptr);
 	vkDestroyImage(Globals::vkContext->logicalDevice, depthBufferImage, nullptr);
 	vkFreeMemory(Globals::vkContext->logicalDevice, depthBufferImageMemory, nullptr);
 
-	vkDestroyDescriptorPool(Globals::vkContext->logicalDevice, descriptorPool, nullptr);
-	vkDestroyDescriptorSetLayout(Globals::vkContext->logicalDevice, descriptorSetLayout, nullptr);
-	for (size_t i = 0; i < swapChainImages.size(); i++)
+	vkDestroySampler(Globals::vkContext->logicalDevice, depthPyramidSampler, nullptr);
+	for (VkImageView mipView : depthPyramidMipViews)
 	{
-		vkDestroyBuffer(Globals::vkContext->logicalDevice, vpUniformBuffer[i], nullptr);
-		vkFreeMemory(Globals::vkContext->logicalDevice, vpUniformBufferMemory[i], nullptr);
-		//vkDestroyBuffer(Globals::mainDevice->logicalDevice, modelDUniformBuffer[i], nullptr);
-		//vkFreeMemory(Globals::mainDevice->logicalDevice, modelDUniformBufferMemory[i], nullptr);
+		vkDestroyImageView(Globals::vkContext->logicalDevice, mipView, nullptr);
 	}
+	vkDestroyImageView(Globals::vkContext->logicalDevice, depthPyramidImageView, nullptr);
+	vkDestroyImage(Globals::vkContext->logicalDevice, depthPyramidImage, nullptr);
+	vkFreeMemory(Globals::vkContext->logicalDevice, depthPyramidImageMemory, nullptr);
+	Globals::bufferPool->destroy(visibilityBuffer);
+
+	vkDestroyDescriptorPool(Globals::vkContext->logicalDevice, depthReduceDescriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(Globals::vkContext->logicalDevice, depthReduceSetLayout, nullptr);
+	vkDestroyDescriptorPool(Globals::vkContext->logicalDevice, descriptorPool, nullptr);
+	vkDestroyDescriptorSetLayout(Globals::vkContext->logicalDevice, descriptorSetLayout, nullptr);
+	vkDestroyDescriptorSetLayout(Globals::vkContext->logicalDevice, cullSetLayout, nullptr);
+	vpUniformBuffer.destroy();
+	objectBuffer.destroy();
+	indirectBuffer.destroy();
+	drawCountBuffer.destroy();
+	instanceDataBuffer.destroy();
+	cullDataBuffer.destroy();
+
+	// Anything still in the pool was leaked by its owner, release it before the device goes
+	Globals::bufferPool->destroyAll();
+	delete Globals::bufferPool;
+	Globals::bufferPool = nullptr;
+
 	for (size_t i = 0; i < MAX_FRAME_DRAWS; i++)
 	{
 		vkDestroySemaphore(Globals::vkContext->logicalDevice, renderFinished[i], nullptr);
 		vkDestroySemaphore(Globals::vkContext->logicalDevice, imageAvailable[i], nullptr);
 		vkDestroyFence(Globals::vkContext->logicalDevice, drawFences[i], nullptr);
 	}
+	for (size_t i = 0; i < MAX_FRAME_DRAWS; i++)
+	{
+		// Destroying a pool frees the command buffers allocated from it
+		for (VkCommandPool recordingCommandPool : recordingCommandPools[i])
+		{
+			vkDestroyCommandPool(Globals::vkContext->logicalDevice, recordingCommandPool, nullptr);
+		}
+	}
 	vkDestroyCommandPool(Globals::vkContext->logicalDevice, Globals::vkContext->graphicsCommandPool, nullptr);
 	for (auto framebuffer : swapChainFramebuffers)
 	{
 		vkDestroyFramebuffer(Globals::vkContext->logicalDevice, framebuffer, nullptr);
 	}
-	vkDestroyPipeline(Globals::vkContext->logicalDevice, graphicsPipeline, nullptr);
+	// Everything compiled this run goes back to disk for the next start
+	pipelineCache.save();
+	pipelineCache.destroy();
+	vkDestroyPipeline(Globals::vkContext->logicalDevice, depthReducePipeline, nullptr);
+	vkDestroyPipelineLayout(Globals::vkContext->logicalDevice, depthReducePipelineLayout, nullptr);
+	vkDestroyPipeline(Globals::vkContext->logicalDevice, cullPipeline, nullptr);
+	vkDestroyPipelineLayout(Globals::vkContext->logicalDevice, cullPipelineLayout, nullptr);
+	for (VkPipeline graphicsPipeline : graphicsPipelines)
+	{
+		vkDestroyPipeline(Globals::vkContext->logicalDevice, graphicsPipeline, nullptr);
+	}
+	vkDestroyShaderModule(Globals::vkContext->logicalDevice, fragmentShaderModule, nullptr);
+	vkDestroyShaderModule(Globals::vkContext->logicalDevice, vertexShaderModule, nullptr);
 	vkDestroyPipelineLayout(Globals::vkContext->logicalDevice, pipelineLayout, nullptr);
+	if (settings.occlusionCulling)
+	{
+		vkDestroyRenderPass(Globals::vkContext->logicalDevice, lateRenderPass, nullptr);
+	}
 	vkDestroyRenderPass(Globals::vkContext->logicalDevice, renderPass, nullptr);
 	for (auto image : swapChainImages)
 	{
@@ -163,6 +327,11 @@ void VulkanRenderer::cleanup()
 	vkDestroySurfaceKHR(instance, surface, nullptr);
 	vkDestroyDevice(Globals::vkContext->logicalDevice, nullptr);
 	vkDestroyInstance(instance, nullptr);
+
+	delete Globals::backgroundPool;
+	Globals::backgroundPool = nullptr;
+	delete Globals::threadPool;
+	Globals::threadPool = nullptr;
 }
 
 void VulkanRenderer::createInstance()
@@ -177,7 +346,7 @@ void VulkanRenderer::createInstance()
 	appInfo.applicationVersion = VK_MAKE_VERSION(1, 0, 0); // Custom version of the application
 	appInfo.pEngineName = "No Engine"; // Custom engine name
 	appInfo.engineVersion = VK_MAKE_VERSION(1, 0, 0); // Custom engine version
-	appInfo.apiVersion = VK_API_VERSION_1_0; // MARCO: What do we do here?
+	appInfo.apiVersion = VK_API_VERSION_1_2; // 1.2 for core descriptor indexing
 
 	// Creation information for a VkInstance
 	VkInstanceCreateInfo createInfo = {};
@@ -249,14 +418,49 @@ void VulkanRenderer::createLogicalDevice()
 	deviceCreateInfo.sType = VK_STRUCTURE_TYPE_DEVICE_CREATE_INFO;
 	deviceCreateInfo.queueCreateInfoCount = static_cast<uint32_t>(queueCreateInfos.size()); // Number of Queue Create Infos
 	deviceCreateInfo.pQueueCreateInfos = queueCreateInfos.data(); // List of queue create infos so device can create required queues
-	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(deviceExtensions.size()); // Number of enabled logical device extensions
-	deviceCreateInfo.ppEnabledExtensionNames = deviceExtensions.data(); // List of enabled logical device extensions
+
+	// Required extensions plus the optional ones the device happens to have
+	std::vector<const char*> enabledExtensions = deviceExtensions;
+	memoryBudgetSupported = checkOptionalDeviceExtensionSupport(Globals::vkContext->physicalDevice, VK_EXT_MEMORY_BUDGET_EXTENSION_NAME);
+	if (memoryBudgetSupported)
+	{
+		enabledExtensions.push_back(VK_EXT_MEMORY_BUDGET_EXTENSION_NAME); // Live VRAM budget for texture residency
+	}
+
+	deviceCreateInfo.enabledExtensionCount = static_cast<uint32_t>(enabledExtensions.size()); // Number of enabled logical device extensions
+	deviceCreateInfo.ppEnabledExtensionNames = enabledExtensions.data(); // List of enabled logical device extensions
 	
+	// Vulkan 1.2 features the Logical Device will be using (descriptor indexing for the bindless texture table)
+	VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+	vulkan12Features.runtimeDescriptorArray = VK_TRUE;
+	vulkan12Features.descriptorBindingPartiallyBound = VK_TRUE;
+	vulkan12Features.descriptorBindingSampledImageUpdateAfterBind = VK_TRUE;
+	vulkan12Features.descriptorBindingUpdateUnusedWhilePending = VK_TRUE;
+	vulkan12Features.shaderSampledImageArrayNonUniformIndexing = VK_TRUE;
+
+	// GPU-side draw counts are optional, without them every bucket draws its full range
+	VkPhysicalDeviceVulkan12Features supportedVulkan12Features = {};
+	supportedVulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+	VkPhysicalDeviceFeatures2 supportedFeatures = {};
+	supportedFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	supportedFeatures.pNext = &supportedVulkan12Features;
+	vkGetPhysicalDeviceFeatures2(Globals::vkContext->physicalDevice, &supportedFeatures);
+
+	drawIndirectCountSupported = supportedVulkan12Features.drawIndirectCount == VK_TRUE;
+	vulkan12Features.drawIndirectCount = supportedVulkan12Features.drawIndirectCount;
+
 	// Physical Device Features the Logical Device will be using
-	VkPhysicalDeviceFeatures deviceFeatures = {}; 
-	deviceFeatures.samplerAnisotropy = VK_TRUE; // Enable anisotropy
+	VkPhysicalDeviceFeatures2 deviceFeatures = {};
+	deviceFeatures.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	deviceFeatures.pNext = &vulkan12Features;
+	deviceFeatures.features.samplerAnisotropy = VK_TRUE; // Enable anisotropy
+	deviceFeatures.features.multiDrawIndirect = VK_TRUE; // Many draws per indirect call
+	deviceFeatures.features.drawIndirectFirstInstance = VK_TRUE; // firstInstance selects the draw data
 
-	deviceCreateInfo.pEnabledFeatures = &deviceFeatures; // Physical device features Logical Device will use
+	deviceCreateInfo.pNext = &deviceFeatures; // Physical device features Logical Device will use
+	deviceCreateInfo.pEnabledFeatures = nullptr; // Given through pNext instead
 
 	// MARCO: Any suggestions on allocation
 	// Create the logical device for the given physical device
@@ -338,7 +542,7 @@ void VulkanRenderer::createSwapChain()
 	}
 
 	// If old swap chain been destroyed and this one replaces it, then link old one to quicly hand over responsibilities
-	swapChainCreateInfo.oldSwapchain = VK_NULL_HANDLE;
+	swapChainCreateInfo.oldSwapchain = swapchain; // VK_NULL_HANDLE for the first one
 
 	// Create Swapchain
 	VkResult result = vkCreateSwapchainKHR(Globals::vkContext->logicalDevice, &swapChainCreateInfo, nullptr, &swapchain);
@@ -358,13 +562,102 @@ void VulkanRenderer::createSwapChain()
 		// Store image handle
 		SwapchainImage swapChainImage = {};
 		swapChainImage.image = image;
-		swapChainImage.imageView = Utilities::Texture::createImageView(image, swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT);
+		swapChainImage.imageView = Utilities::Texture::createImageView(image, swapChainImageFormat, VK_IMAGE_ASPECT_COLOR_BIT, 1);
 
 		// Add to swapchain image list
 		swapChainImages.push_back(swapChainImage);
 	}
 }
 
+bool VulkanRenderer::recreateSwapChain()
+{
+	// A minimized window has a zero sized framebuffer, no swapchain can be made for it
+	int width, height;
+	glfwGetFramebufferSize(window, &width, &height);
+	if (width == 0 || height == 0)
+	{
+		return false;
+	}
+
+	// The frame in flight may still be using everything sized after the old swapchain, it goes once that frame is done instead of waiting for the device
+	VkSwapchainKHR oldSwapchain = swapchain;
+	std::vector<SwapchainImage> oldImages = std::move(swapChainImages);
+	std::vector<VkFramebuffer> oldFramebuffers = std::move(swapChainFramebuffers);
+	std::vector<VkCommandBuffer> oldCommandBuffers = std::move(commandBuffers);
+	VkImage oldDepthImage = depthBufferImage;
+	VkImageView oldDepthImageView = depthBufferImageView;
+	VkDeviceMemory oldDepthImageMemory = depthBufferImageMemory;
+	VkImage oldPyramidImage = depthPyramidImage;
+	VkImageView oldPyramidImageView = depthPyramidImageView;
+	std::vector<VkImageView> oldPyramidMipViews = std::move(depthPyramidMipViews);
+	VkDeviceMemory oldPyramidImageMemory = depthPyramidImageMemory;
+	VkDescriptorPool oldReducePool = depthReduceDescriptorPool;
+	VkDescriptorSet oldCullSet = cullDescriptorSet;
+	VkDescriptorPool cullSetPool = descriptorPool;
+	deletionQueue.push([=]()
+	{
+		VkDevice device = Globals::vkContext->logicalDevice;
+
+		vkFreeDescriptorSets(device, cullSetPool, 1, &oldCullSet);
+		vkDestroyDescriptorPool(device, oldReducePool, nullptr);
+		for (VkImageView mipView : oldPyramidMipViews)
+		{
+			vkDestroyImageView(device, mipView, nullptr);
+		}
+		vkDestroyImageView(device, oldPyramidImageView, nullptr);
+		vkDestroyImage(device, oldPyramidImage, nullptr);
+		vkFreeMemory(device, oldPyramidImageMemory, nullptr);
+
+		vkDestroyImageView(device, oldDepthImageView, nullptr);
+		vkDestroyImage(device, oldDepthImage, nullptr);
+		vkFreeMemory(device, oldDepthImageMemory, nullptr);
+
+		vkFreeCommandBuffers(device, Globals::vkContext->graphicsCommandPool, static_cast<uint32_t>(oldCommandBuffers.size()), oldCommandBuffers.data());
+		for (VkFramebuffer framebuffer : oldFramebuffers)
+		{
+			vkDestroyFramebuffer(device, framebuffer, nullptr);
+		}
+		for (const SwapchainImage& image : oldImages)
+		{
+			vkDestroyImageView(device, image.imageView, nullptr);
+		}
+		vkDestroySwapchainKHR(device, oldSwapchain, nullptr);
+	});
+	swapChainImages.clear();
+	swapChainFramebuffers.clear();
+	commandBuffers.clear();
+	depthPyramidMipViews.clear();
+
+	// Hands the old swapchain over (its images being presented stay valid), the render passes and pipelines keep working as they are
+	createSwapChain();
+	createDepthBufferImage();
+	createDepthPyramidImage();
+	createFramebuffers();
+	createCommandBuffers();
+	createCullDescriptorSet();
+	updateProjection();
+
+	// Draw batches set the old viewport, every frame records them again
+	secondarySceneVersions.fill(0);
+
+	swapChainOutOfDate = false;
+	return true;
+}
+
+void VulkanRenderer::updateProjection()
+{
+	uboViewProjection.projection = glm::perspective(glm::radians(45.0f), (float)swapChainExtent.width / (float)swapChainExtent.height, 0.1f, 100.0f);
+
+	// Vulkan's y axis points down
+	uboViewProjection.projection[1][1] *= -1;
+}
+
+void VulkanRenderer::onFramebufferResized(GLFWwindow* resizedWindow, int /*width*/, int /*height*/)
+{
+	VulkanRenderer* renderer = static_cast<VulkanRenderer*>(glfwGetWindowUserPointer(resizedWindow));
+	renderer->swapChainOutOfDate = true;
+}
+
 void VulkanRenderer::createRenderPass()
 {
 	// Attachments
@@ -381,17 +674,26 @@ void VulkanRenderer::createRenderPass()
 	// Framebuffer will be stored as an image, but images can ber given different data layouts
 	// to give optional use for certain operations
 	colorAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED; // Image data layout before render pass starts
-	colorAttachment.finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; // Image data layout after render pass (to change to)
+	// With occlusion culling a second pass finishes the image, so it stays an attachment until then
+	colorAttachment.finalLayout = settings.occlusionCulling ? VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL : VK_IMAGE_LAYOUT_PRESENT_SRC_KHR; // Image data layout after render pass (to change to)
 
-	// Depth attachment of render pass
-	VkAttachmentDescription depthAttachment = {};
-	depthAttachment.format = chooseSupportedFormat(
+	// Occlusion culling reads the depth buffer back to build the depth pyramid, so the format has to be sampleable too
+	VkFormatFeatureFlags depthFeatures = VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	if (settings.occlusionCulling)
+	{
+		depthFeatures |= VK_FORMAT_FEATURE_SAMPLED_IMAGE_BIT;
+	}
+	depthBufferFormat = chooseSupportedFormat(
 		{ VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT },
 		VK_IMAGE_TILING_OPTIMAL,
-		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT);
+		depthFeatures);
+
+	// Depth attachment of render pass
+	VkAttachmentDescription depthAttachment = {};
+	depthAttachment.format = depthBufferFormat;
 	depthAttachment.samples = VK_SAMPLE_COUNT_1_BIT;
 	depthAttachment.loadOp = VK_ATTACHMENT_LOAD_OP_CLEAR;
-	depthAttachment.storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	depthAttachment.storeOp = settings.occlusionCulling ? VK_ATTACHMENT_STORE_OP_STORE : VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.stencilLoadOp = VK_ATTACHMENT_LOAD_OP_DONT_CARE;
 	depthAttachment.stencilStoreOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
 	depthAttachment.initialLayout = VK_IMAGE_LAYOUT_UNDEFINED;
@@ -422,12 +724,13 @@ void VulkanRenderer::createRenderPass()
 	// Conversion from VK_IMAGE_LAYOUT_UNDEFINED TO VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL
 	// Transition must happen after...
 	subpassDependencies[0].srcSubpass = VK_SUBPASS_EXTERNAL; // Subpass index
-	subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_BOTTOM_OF_PIPE_BIT; // Pipeline state
-	subpassDependencies[0].srcAccessMask = VK_ACCESS_MEMORY_READ_BIT;
+	subpassDependencies[0].srcStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT; // Pipeline state
+	subpassDependencies[0].srcAccessMask = VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 	// But must happen before...
 	subpassDependencies[0].dstSubpass = 0;
-	subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT;
-	subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT;
+	subpassDependencies[0].dstStageMask = VK_PIPELINE_STAGE_COLOR_ATTACHMENT_OUTPUT_BIT | VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT;
+	subpassDependencies[0].dstAccessMask = VK_ACCESS_COLOR_ATTACHMENT_READ_BIT | VK_ACCESS_COLOR_ATTACHMENT_WRITE_BIT |
+		VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
 	subpassDependencies[0].dependencyFlags = 0;
 
 	// Conversion from VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL TO VK_IMAGE_LAYOUT_PRESENT_SRC_KHR
@@ -455,6 +758,23 @@ void VulkanRenderer::createRenderPass()
 
 	VkResult result = vkCreateRenderPass(Globals::vkContext->logicalDevice, &renderPassCreateInfo, nullptr, &renderPass);
 	assert(result == VK_SUCCESS && "Failed to create a Render Pass!");
+
+	if (!settings.occlusionCulling)
+	{
+		return;
+	}
+
+	// Late pass of occlusion culling: keeps what the early pass drew and hands the image over to presentation.
+	// Only load/store ops and layouts differ, so pipelines and framebuffers made for renderPass work with it too
+	renderPassAttachments[0].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	renderPassAttachments[0].initialLayout = VK_IMAGE_LAYOUT_COLOR_ATTACHMENT_OPTIMAL;
+	renderPassAttachments[0].finalLayout = VK_IMAGE_LAYOUT_PRESENT_SRC_KHR;
+	renderPassAttachments[1].loadOp = VK_ATTACHMENT_LOAD_OP_LOAD;
+	renderPassAttachments[1].storeOp = VK_ATTACHMENT_STORE_OP_DONT_CARE;
+	renderPassAttachments[1].initialLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+
+	result = vkCreateRenderPass(Globals::vkContext->logicalDevice, &renderPassCreateInfo, nullptr, &lateRenderPass);
+	assert(result == VK_SUCCESS && "Failed to create a Render Pass!");
 }
 
 void VulkanRenderer::createDescriptorSetLayout()
@@ -463,20 +783,28 @@ void VulkanRenderer::createDescriptorSetLayout()
 	// UboViewProjection Binding Info
 	VkDescriptorSetLayoutBinding vpLayoutBinding = {};
 	vpLayoutBinding.binding = 0;											// Binding point in shader (designated by binding number in shader)
-	vpLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;	// Type of descriptor (uniform, dynamic uniform, image sampler, etc)
+	vpLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;	// Type of descriptor (uniform, dynamic uniform, image sampler, etc)
 	vpLayoutBinding.descriptorCount = 1;									// Number of descriptors for binding
 	vpLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;				// Shader stage to bind to
 	vpLayoutBinding.pImmutableSamplers = nullptr;							// For Texture: Can make sampler data unchangeable (immutable) by specifying in layout
 
-	// Model Binding Info
-	/*VkDescriptorSetLayoutBinding modelLayoutBinding = {};
-	modelLayoutBinding.binding = 1;
-	modelLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-	modelLayoutBinding.descriptorCount = 1;
-	modelLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
-	modelLayoutBinding.pImmutableSamplers = nullptr;*/
+	// Object Buffer Binding Info (storage buffer, so it can hold every transform of the scene)
+	VkDescriptorSetLayoutBinding objectLayoutBinding = {};
+	objectLayoutBinding.binding = 1;
+	objectLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	objectLayoutBinding.descriptorCount = 1;
+	objectLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	objectLayoutBinding.pImmutableSamplers = nullptr;
 
-	std::vector<VkDescriptorSetLayoutBinding> layoutBindings = { vpLayoutBinding };
+	// Instance Data Binding Info (one element per visible instance, indexed by gl_InstanceIndex)
+	VkDescriptorSetLayoutBinding instanceDataLayoutBinding = {};
+	instanceDataLayoutBinding.binding = 2;
+	instanceDataLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	instanceDataLayoutBinding.descriptorCount = 1;
+	instanceDataLayoutBinding.stageFlags = VK_SHADER_STAGE_VERTEX_BIT;
+	instanceDataLayoutBinding.pImmutableSamplers = nullptr;
+
+	std::vector<VkDescriptorSetLayoutBinding> layoutBindings = { vpLayoutBinding, objectLayoutBinding, instanceDataLayoutBinding };
 
 	// Create Descriptor Set Layout with given bindings
 	VkDescriptorSetLayoutCreateInfo layoutCreateInfo = {};
@@ -490,31 +818,78 @@ void VulkanRenderer::createDescriptorSetLayout()
 
 	// Create texture sampler descriptor set layout
 
-	// Texture binding info
+	// Texture binding info: one big array holding every texture, indexed by texture id in the shader
 	VkDescriptorSetLayoutBinding samplerLayoutBinding = {};
 	samplerLayoutBinding.binding = 0;
 	samplerLayoutBinding.descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	samplerLayoutBinding.descriptorCount = 1;
+	samplerLayoutBinding.descriptorCount = MAX_TEXTURES;
 	samplerLayoutBinding.stageFlags = VK_SHADER_STAGE_FRAGMENT_BIT;
 	samplerLayoutBinding.pImmutableSamplers = nullptr;
 
+	// Descriptor indexing flags:
+	// PARTIALLY_BOUND: elements not written yet are fine as long as they aren't used
+	// UPDATE_AFTER_BIND + UPDATE_UNUSED_WHILE_PENDING: new textures can be written while the set is bound/in flight
+	VkDescriptorBindingFlags samplerBindingFlags = VK_DESCRIPTOR_BINDING_PARTIALLY_BOUND_BIT |
+		VK_DESCRIPTOR_BINDING_UPDATE_AFTER_BIND_BIT | VK_DESCRIPTOR_BINDING_UPDATE_UNUSED_WHILE_PENDING_BIT;
+
+	VkDescriptorSetLayoutBindingFlagsCreateInfo bindingFlagsCreateInfo = {};
+	bindingFlagsCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_BINDING_FLAGS_CREATE_INFO;
+	bindingFlagsCreateInfo.bindingCount = 1;
+	bindingFlagsCreateInfo.pBindingFlags = &samplerBindingFlags;
+
 	// Create a descriptor set layout with given binding for texture
 	VkDescriptorSetLayoutCreateInfo textureLayoutCreateInfo = {};
 	textureLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	textureLayoutCreateInfo.pNext = &bindingFlagsCreateInfo;
+	textureLayoutCreateInfo.flags = VK_DESCRIPTOR_SET_LAYOUT_CREATE_UPDATE_AFTER_BIND_POOL_BIT;
 	textureLayoutCreateInfo.bindingCount = 1;
 	textureLayoutCreateInfo.pBindings = &samplerLayoutBinding;
 
 	// Create descriptor set layout
 	result = vkCreateDescriptorSetLayout(Globals::vkContext->logicalDevice, &textureLayoutCreateInfo, nullptr, &samplerSetLayout);
 	assert(result == VK_SUCCESS && "Failed to create a Descriptor Set Layout!");
-}
 
-void VulkanRenderer::createPushConstantRange()
-{
-	// Define push constant values (no 'create' needed)
-	pushConstantRange.stageFlags = VK_SHADER_STAGE_VERTEX_BIT; // Shader stage push constant constant will go to
-	pushConstantRange.offset = 0; // Offset into given data to pass to push constant
-	pushConstantRange.size = sizeof(Model); // Size of data being passed
+	// Culling pass layout: camera and transforms (same buffers as the vertex shader), cull data in, indirect commands and instance data out,
+	// then the occlusion culling inputs: visibility of the last frame (shared by every frame, so not dynamic) and the depth pyramid
+	std::array<VkDescriptorType, 7> cullDescriptorTypes = { VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC, VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC,
+		VK_DESCRIPTOR_TYPE_STORAGE_BUFFER, VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER };
+
+	std::array<VkDescriptorSetLayoutBinding, 7> cullLayoutBindings = {};
+	for (uint32_t i = 0; i < cullLayoutBindings.size(); i++)
+	{
+		cullLayoutBindings[i].binding = i;
+		cullLayoutBindings[i].descriptorType = cullDescriptorTypes[i];
+		cullLayoutBindings[i].descriptorCount = 1;
+		cullLayoutBindings[i].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+		cullLayoutBindings[i].pImmutableSamplers = nullptr;
+	}
+
+	VkDescriptorSetLayoutCreateInfo cullLayoutCreateInfo = {};
+	cullLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	cullLayoutCreateInfo.bindingCount = static_cast<uint32_t>(cullLayoutBindings.size());
+	cullLayoutCreateInfo.pBindings = cullLayoutBindings.data();
+
+	result = vkCreateDescriptorSetLayout(Globals::vkContext->logicalDevice, &cullLayoutCreateInfo, nullptr, &cullSetLayout);
+	assert(result == VK_SUCCESS && "Failed to create a Descriptor Set Layout!");
+
+	// Depth reduction layout: the level below (or the depth buffer) sampled, the level being built as a storage image
+	std::array<VkDescriptorSetLayoutBinding, 2> depthReduceLayoutBindings = {};
+	depthReduceLayoutBindings[0].binding = 0;
+	depthReduceLayoutBindings[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	depthReduceLayoutBindings[0].descriptorCount = 1;
+	depthReduceLayoutBindings[0].stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	depthReduceLayoutBindings[1] = depthReduceLayoutBindings[0];
+	depthReduceLayoutBindings[1].binding = 1;
+	depthReduceLayoutBindings[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+
+	VkDescriptorSetLayoutCreateInfo depthReduceLayoutCreateInfo = {};
+	depthReduceLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_LAYOUT_CREATE_INFO;
+	depthReduceLayoutCreateInfo.bindingCount = static_cast<uint32_t>(depthReduceLayoutBindings.size());
+	depthReduceLayoutCreateInfo.pBindings = depthReduceLayoutBindings.data();
+
+	result = vkCreateDescriptorSetLayout(Globals::vkContext->logicalDevice, &depthReduceLayoutCreateInfo, nullptr, &depthReduceSetLayout);
+	assert(result == VK_SUCCESS && "Failed to create a Descriptor Set Layout!");
 }
 
 void VulkanRenderer::createGraphicsPipeline()
@@ -523,9 +898,118 @@ void VulkanRenderer::createGraphicsPipeline()
 	auto vertexShaderCode = Utilities::IO::readFile("shaders/vert.spv");
 	auto fragmentShaderCode = Utilities::IO::readFile("shaders/frag.spv");
 
-	// Build Shader Modules to link to Graphics Pipeline
-	VkShaderModule vertexShaderModule = createShaderModule(vertexShaderCode);
-	VkShaderModule fragmentShaderModule = createShaderModule(fragmentShaderCode);
+	// Build Shader Modules to link to Graphics Pipelines, every variant is specialized from the same modules so they stay around
+	variantPipelineIds.fill(NO_PIPELINE);
+	vertexShaderModule = createShaderModule(vertexShaderCode);
+	fragmentShaderModule = createShaderModule(fragmentShaderCode);
+
+	// Pipeline layout
+	std::array<VkDescriptorSetLayout, 2> descriptorSetLayouts = { descriptorSetLayout, samplerSetLayout };
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
+	pipelineLayoutCreateInfo.pSetLayouts = descriptorSetLayouts.data();
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 0; // Per-draw data comes from the draw data buffer
+	pipelineLayoutCreateInfo.pPushConstantRanges = nullptr;
+
+	// Create pipeline layout
+	VkResult result = vkCreatePipelineLayout(Globals::vkContext->logicalDevice, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout);
+	assert(result == VK_SUCCESS && "Failed to create Pipeline Layout!");
+
+	// The fallback has to exist before anything is drawn, build it right here
+	auto pipelineStart = std::chrono::high_resolution_clock::now();
+	variantPipelineIds[FALLBACK_FEATURES] = 0;
+	graphicsPipelines.push_back(createGraphicsPipelineVariant(FALLBACK_FEATURES));
+	pipelineMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - pipelineStart).count();
+
+	// Textured opaque meshes are the common case, start on it while the models load
+	getVariantPipeline(SHADER_FEATURE_TEXTURED);
+}
+
+uint32_t VulkanRenderer::getVariantPipeline(uint32_t features)
+{
+	// Every combination gets compiled once, then the draws needing it share it
+	if (variantPipelineIds[features] != NO_PIPELINE)
+	{
+		return variantPipelineIds[features];
+	}
+
+	bool compiling = std::any_of(pendingPipelines.begin(), pendingPipelines.end(), [features](const PendingPipeline& pending) { return pending.features == features; });
+	if (!compiling)
+	{
+		PendingPipeline pending;
+		pending.features = features;
+		// Off the frame's workers, a compile takes far longer than anything parallelFor waits for
+		pending.compiled = Globals::backgroundPool->submit([this, features]()
+		{
+			auto pipelineStart = std::chrono::high_resolution_clock::now();
+
+			CompiledPipeline compiled;
+			compiled.pipeline = createGraphicsPipelineVariant(features);
+			compiled.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - pipelineStart).count();
+			return compiled;
+		});
+		pendingPipelines.push_back(std::move(pending));
+	}
+
+	return variantPipelineIds[FALLBACK_FEATURES];
+}
+
+void VulkanRenderer::finishPipelineCompiles()
+{
+	bool finished = false;
+	for (size_t i = 0; i < pendingPipelines.size();)
+	{
+		if (pendingPipelines[i].compiled.wait_for(std::chrono::seconds(0)) != std::future_status::ready)
+		{
+			i++;
+			continue;
+		}
+
+		assert(graphicsPipelines.size() < MAX_GRAPHICS_PIPELINES && "Too many pipeline variants for the sort key!");
+
+		uint32_t features = pendingPipelines[i].features;
+		CompiledPipeline compiled = pendingPipelines[i].compiled.get();
+		pendingPipelines[i] = std::move(pendingPipelines.back());
+		pendingPipelines.pop_back();
+
+		variantPipelineIds[features] = static_cast<uint32_t>(graphicsPipelines.size());
+		graphicsPipelines.push_back(compiled.pipeline);
+		pipelineMilliseconds += compiled.milliseconds;
+		finished = true;
+	}
+
+	if (finished)
+	{
+		// Draws sort by pipeline id, the queue has to be rebuilt (and recorded) for them to pick up the new ones
+		sceneVersion++;
+
+		if (pendingPipelines.empty())
+		{
+			std::cout << "Pipeline variants ready, " << graphicsPipelines.size() << " pipelines created in " << pipelineMilliseconds << " ms" << std::endl;
+		}
+	}
+}
+
+VkPipeline VulkanRenderer::createGraphicsPipelineVariant(uint32_t features)
+{
+	// Feature bits become the specialization constants of the fragment shader, constant id i is bit i
+	std::array<VkBool32, SHADER_FEATURE_COUNT> featureValues;
+	std::array<VkSpecializationMapEntry, SHADER_FEATURE_COUNT> featureEntries;
+	for (uint32_t i = 0; i < SHADER_FEATURE_COUNT; i++)
+	{
+		featureValues[i] = (features >> i) & 1 ? VK_TRUE : VK_FALSE;
+		featureEntries[i].constantID = i;
+		featureEntries[i].offset = sizeof(VkBool32) * i;
+		featureEntries[i].size = sizeof(VkBool32);
+	}
+
+	VkSpecializationInfo specializationInfo = {};
+	specializationInfo.mapEntryCount = static_cast<uint32_t>(featureEntries.size());
+	specializationInfo.pMapEntries = featureEntries.data();
+	specializationInfo.dataSize = sizeof(featureValues);
+	specializationInfo.pData = featureValues.data();
 
 	// Shader stage shader info
 	// Vertex stage creation information
@@ -541,6 +1025,7 @@ void VulkanRenderer::createGraphicsPipeline()
 	fragmentShaderCreateInfo.stage = VK_SHADER_STAGE_FRAGMENT_BIT; // Shader stage name
 	fragmentShaderCreateInfo.module = fragmentShaderModule; // Shader module to be used by stage
 	fragmentShaderCreateInfo.pName = "main"; // Entry point into the shader
+	fragmentShaderCreateInfo.pSpecializationInfo = &specializationInfo; // Features of the variant, dead branches get compiled out
 
 	// Put shader stage creation info in to array
 	// Graphics pipeline creation info requires array of shader stage creates
@@ -589,37 +1074,25 @@ void VulkanRenderer::createGraphicsPipeline()
 	inputAssembly.primitiveRestartEnable = VK_FALSE; // Allow overriding of "strip" topology to start new primitives
 
 	// Viewport & scissor
-	// Create viewport info struct
-	VkViewport viewport = {};
-	viewport.x = 0; // x start coord
-	viewport.y = 0; // y start coordinate
-	viewport.width = (float)swapChainExtent.width; // width of viewport
-	viewport.height = (float)swapChainExtent.height; // height of viewport
-	viewport.minDepth = 0.0f; // min framebuffer depth
-	viewport.maxDepth = 1.0f; // max framebuffer depth
-
-	// Create a scissor info struct
-	VkRect2D scissor = {};
-	scissor.offset = { 0,0 }; // offset to use region from
-	scissor.extent = swapChainExtent; // extent to describe region to use, starting at offset
-
+	// One of each, their values are set while recording so the pipeline doesn't depend on the swapchain size
 	VkPipelineViewportStateCreateInfo viewPortStateCreateInfo = {};
 	viewPortStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_VIEWPORT_STATE_CREATE_INFO;
 	viewPortStateCreateInfo.viewportCount = 1;
-	viewPortStateCreateInfo.pViewports = &viewport;
+	viewPortStateCreateInfo.pViewports = nullptr;
 	viewPortStateCreateInfo.scissorCount = 1;
-	viewPortStateCreateInfo.pScissors = &scissor;
+	viewPortStateCreateInfo.pScissors = nullptr;
 
 	// Dynamic state (something extra to do when resizing screen, scissor...)
-	//std::vector<VkDynamicState> dynamicStateEnables;
-	//dynamicStateEnables.push_back(VK_DYNAMIC_STATE_VIEWPORT); // vkcmdsetviewport
-	//dynamicStateEnables.push_back(VK_DYNAMIC_STATE_SCISSOR); // vkcmdsetscissor
+	std::array<VkDynamicState, 2> dynamicStateEnables = {
+		VK_DYNAMIC_STATE_VIEWPORT, // vkCmdSetViewport
+		VK_DYNAMIC_STATE_SCISSOR // vkCmdSetScissor
+	};
 
-	//// Dynamic state creation info
-	//VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo;
-	//dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
-	//dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
-	//dynamicStateCreateInfo.pDynamicStates = dynamicStateEnables.data();
+	// Dynamic state creation info
+	VkPipelineDynamicStateCreateInfo dynamicStateCreateInfo = {};
+	dynamicStateCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_DYNAMIC_STATE_CREATE_INFO;
+	dynamicStateCreateInfo.dynamicStateCount = static_cast<uint32_t>(dynamicStateEnables.size());
+	dynamicStateCreateInfo.pDynamicStates = dynamicStateEnables.data();
 
 	// Rasterizer
 	VkPipelineRasterizationStateCreateInfo rasterizerCreateInfo = {};
@@ -664,20 +1137,6 @@ void VulkanRenderer::createGraphicsPipeline()
 	colorBlendingCreateInfo.attachmentCount = 1;
 	colorBlendingCreateInfo.pAttachments = &colorState;
 
-	// Pipeline layout
-	std::array<VkDescriptorSetLayout, 2> descriptorSetLayouts = { descriptorSetLayout, samplerSetLayout };
-
-	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
-	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
-	pipelineLayoutCreateInfo.setLayoutCount = static_cast<uint32_t>(descriptorSetLayouts.size());
-	pipelineLayoutCreateInfo.pSetLayouts = descriptorSetLayouts.data();
-	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
-	pipelineLayoutCreateInfo.pPushConstantRanges = &pushConstantRange;
-
-	// Create pipeline layout
-	VkResult result = vkCreatePipelineLayout(Globals::vkContext->logicalDevice, &pipelineLayoutCreateInfo, nullptr, &pipelineLayout);
-	assert(result == VK_SUCCESS && "Failed to create Pipeline Layout!");
-
 	// Depth stencil testing
 	// TODO: Set up depth stencil testing
 	VkPipelineDepthStencilStateCreateInfo depthStencilCreateInfo = {};
@@ -696,7 +1155,7 @@ void VulkanRenderer::createGraphicsPipeline()
 	pipelineCreateInfo.pVertexInputState = &vertexInputCreateInfo; // All the fixed function pipeline states
 	pipelineCreateInfo.pInputAssemblyState = &inputAssembly;
 	pipelineCreateInfo.pViewportState = &viewPortStateCreateInfo;
-	pipelineCreateInfo.pDynamicState = nullptr;
+	pipelineCreateInfo.pDynamicState = &dynamicStateCreateInfo;
 	pipelineCreateInfo.pRasterizationState = &rasterizerCreateInfo;
 	pipelineCreateInfo.pMultisampleState = &multisamplingCreateInfo;
 	pipelineCreateInfo.pColorBlendState = &colorBlendingCreateInfo;
@@ -709,81 +1168,275 @@ void VulkanRenderer::createGraphicsPipeline()
 	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE; // Existing pipeline to derive from
 	pipelineCreateInfo.basePipelineIndex = -1; // or inde of pipeline bgeing created to derive from (in case creating multiple at once)
 
-	// Create graphics pipeline
-	result = vkCreateGraphicsPipelines(Globals::vkContext->logicalDevice, VK_NULL_HANDLE, 1, &pipelineCreateInfo, nullptr, &graphicsPipeline);
+	// Create graphics pipeline (the pipeline cache is internally synchronized, worker threads can share it)
+	VkPipeline pipeline;
+	VkResult result = vkCreateGraphicsPipelines(Globals::vkContext->logicalDevice, pipelineCache.get(), 1, &pipelineCreateInfo, nullptr, &pipeline);
 	assert(result == VK_SUCCESS && "Failed to create Graphics Pipeline!");
 
-	// Destroy shader modules after pipeline creation (in the oposite order of creation)
-	vkDestroyShaderModule(Globals::vkContext->logicalDevice, fragmentShaderModule, nullptr);
-	vkDestroyShaderModule(Globals::vkContext->logicalDevice, vertexShaderModule, nullptr);
+	return pipeline;
 }
 
-void VulkanRenderer::createDepthBufferImage()
+void VulkanRenderer::createCullPipeline()
 {
-	// Get supported format for depth buffer
-	VkFormat depthFormat = chooseSupportedFormat(
-		{ VK_FORMAT_D32_SFLOAT_S8_UINT, VK_FORMAT_D32_SFLOAT, VK_FORMAT_D24_UNORM_S8_UINT },
-		VK_IMAGE_TILING_OPTIMAL,
-		VK_FORMAT_FEATURE_DEPTH_STENCIL_ATTACHMENT_BIT
-	);
+	auto computeShaderCode = Utilities::IO::readFile("shaders/cull.spv");
+	VkShaderModule computeShaderModule = createShaderModule(computeShaderCode);
 
-	// Create depth buffer image
-	depthBufferImage = Utilities::Texture::createImage(swapChainExtent.width, swapChainExtent.height, depthFormat, VK_IMAGE_TILING_OPTIMAL,
-	                                                   VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depthBufferImageMemory);
+	VkPipelineShaderStageCreateInfo computeShaderCreateInfo = {};
+	computeShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	computeShaderCreateInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	computeShaderCreateInfo.module = computeShaderModule;
+	computeShaderCreateInfo.pName = "main";
+
+	// Instance count and the phase's buffer slots go in push constants, they are fixed for as long as the commands stay recorded
+	VkPushConstantRange cullPushConstantRange = {};
+	cullPushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	cullPushConstantRange.offset = 0;
+	cullPushConstantRange.size = sizeof(CullParams);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.setLayoutCount = 1;
+	pipelineLayoutCreateInfo.pSetLayouts = &cullSetLayout;
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &cullPushConstantRange;
+
+	VkResult result = vkCreatePipelineLayout(Globals::vkContext->logicalDevice, &pipelineLayoutCreateInfo, nullptr, &cullPipelineLayout);
+	assert(result == VK_SUCCESS && "Failed to create Pipeline Layout!");
 
-	// Create depth buffer image view
-	depthBufferImageView = Utilities::Texture::createImageView(depthBufferImage, depthFormat, VK_IMAGE_ASPECT_DEPTH_BIT);
+	VkComputePipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stage = computeShaderCreateInfo;
+	pipelineCreateInfo.layout = cullPipelineLayout;
+	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineCreateInfo.basePipelineIndex = -1;
+
+	auto pipelineStart = std::chrono::high_resolution_clock::now();
+	result = vkCreateComputePipelines(Globals::vkContext->logicalDevice, pipelineCache.get(), 1, &pipelineCreateInfo, nullptr, &cullPipeline);
+	pipelineMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - pipelineStart).count();
+	assert(result == VK_SUCCESS && "Failed to create Compute Pipeline!");
+
+	vkDestroyShaderModule(Globals::vkContext->logicalDevice, computeShaderModule, nullptr);
 }
 
-void VulkanRenderer::createFramebuffers()
+void VulkanRenderer::createDepthBufferImage()
 {
-	// Resize framebuffer count to equal swap chain image count
-	swapChainFramebuffers.resize(swapChainImages.size());
-	// Create a framebuffer for each swap chain image
-	for (size_t i = 0; i < swapChainFramebuffers.size(); i++)
+	// Format was picked along with the render pass, sampled as well when the depth pyramid reads it
+	VkImageUsageFlags depthUsage = VK_IMAGE_USAGE_DEPTH_STENCIL_ATTACHMENT_BIT;
+	if (settings.occlusionCulling)
 	{
-		std::array<VkImageView, 2> attachments = {
-			swapChainImages[i].imageView,
-			depthBufferImageView
-		};
+		depthUsage |= VK_IMAGE_USAGE_SAMPLED_BIT;
+	}
 
-		VkFramebufferCreateInfo framebufferCreateInfo = {};
-		framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
-		framebufferCreateInfo.renderPass = renderPass; // Render Pass layout the Framebuffer will be used with
-		framebufferCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
-		framebufferCreateInfo.pAttachments = attachments.data(); // List of attachments (1:1 with the Render pass)
-		framebufferCreateInfo.width = swapChainExtent.width; // Framebuffer width
-		framebufferCreateInfo.height = swapChainExtent.height; // Framebuffer height
-		framebufferCreateInfo.layers = 1; // Framebuffer layers
+	// Create depth buffer image
+	depthBufferImage = Utilities::Texture::createImage(swapChainExtent.width, swapChainExtent.height, 1, depthBufferFormat, VK_IMAGE_TILING_OPTIMAL,
+	                                                   depthUsage, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depthBufferImageMemory);
 
-		VkResult result = vkCreateFramebuffer(Globals::vkContext->logicalDevice, &framebufferCreateInfo, nullptr, &swapChainFramebuffers[i]);
-		assert(result == VK_SUCCESS && "Failed to create a Framebuffer!");
-	}
+	// Create depth buffer image view (depth aspect only, which is also what sampling it needs)
+	depthBufferImageView = Utilities::Texture::createImageView(depthBufferImage, depthBufferFormat, VK_IMAGE_ASPECT_DEPTH_BIT, 1);
 }
 
-void VulkanRenderer::createCommandPool()
+void VulkanRenderer::createDepthPyramid()
 {
-	// Get indices of queue families from device
-	QueueFamilyIndices queueFamilyIndices = getQueueFamilies(Globals::vkContext->physicalDevice);
+	// Exact texels only, a filtered depth would be neither the nearest nor the farthest one
+	VkSamplerCreateInfo samplerCreateInfo = {};
+	samplerCreateInfo.sType = VK_STRUCTURE_TYPE_SAMPLER_CREATE_INFO;
+	samplerCreateInfo.magFilter = VK_FILTER_NEAREST;
+	samplerCreateInfo.minFilter = VK_FILTER_NEAREST;
+	samplerCreateInfo.addressModeU = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeV = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.addressModeW = VK_SAMPLER_ADDRESS_MODE_CLAMP_TO_EDGE;
+	samplerCreateInfo.unnormalizedCoordinates = VK_FALSE;
+	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_NEAREST;
+	samplerCreateInfo.minLod = 0.0f;
+	samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE;
+	samplerCreateInfo.anisotropyEnable = VK_FALSE;
+
+	VkResult result = vkCreateSampler(Globals::vkContext->logicalDevice, &samplerCreateInfo, nullptr, &depthPyramidSampler);
+	assert(result == VK_SUCCESS && "Failed to create a Texture Sampler!");
 
-	VkCommandPoolCreateInfo poolInfo = {};
-	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
-	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
-	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily; // Queue Family type buffers from this command pool will use
+	// Zero never matches a visibility key, so nothing counts as visible last frame before the first late phase ran
+	visibilityBuffer = Globals::bufferPool->create(sizeof(uint32_t) * MAX_DRAW_INSTANCES, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT,
+	                                               VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT);
 
-	// Create a Graphics queue family command pool
-	VkResult result = vkCreateCommandPool(Globals::vkContext->logicalDevice, &poolInfo, nullptr, &Globals::vkContext->graphicsCommandPool);
-	assert(result == VK_SUCCESS && "Failed to create a Command Pool!");
-}
+	VkCommandBuffer commandBuffer = Utilities::Vulkan::beginCommandBuffer(Globals::vkContext->logicalDevice, Globals::vkContext->graphicsCommandPool);
+	vkCmdFillBuffer(commandBuffer, Globals::bufferPool->getBuffer(visibilityBuffer), 0, VK_WHOLE_SIZE, 0);
+	Utilities::Vulkan::endAndSubmitCommandBuffer(Globals::vkContext->logicalDevice, Globals::vkContext->graphicsCommandPool, Globals::vkContext->graphicsQueue, commandBuffer);
 
-void VulkanRenderer::createCommandBuffers()
-{
-	// Resize command buffer count to have one for each framebuffer
-	commandBuffers.resize(swapChainFramebuffers.size());
+	// Reduction pipeline, input and output sizes change per level so they go in push constants
+	auto computeShaderCode = Utilities::IO::readFile("shaders/depthreduce.spv");
+	VkShaderModule computeShaderModule = createShaderModule(computeShaderCode);
 
-	VkCommandBufferAllocateInfo cbAllocInfo = {};
-	cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
-	cbAllocInfo.commandPool = Globals::vkContext->graphicsCommandPool;
+	VkPipelineShaderStageCreateInfo computeShaderCreateInfo = {};
+	computeShaderCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_SHADER_STAGE_CREATE_INFO;
+	computeShaderCreateInfo.stage = VK_SHADER_STAGE_COMPUTE_BIT;
+	computeShaderCreateInfo.module = computeShaderModule;
+	computeShaderCreateInfo.pName = "main";
+
+	VkPushConstantRange reducePushConstantRange = {};
+	reducePushConstantRange.stageFlags = VK_SHADER_STAGE_COMPUTE_BIT;
+	reducePushConstantRange.offset = 0;
+	reducePushConstantRange.size = sizeof(DepthReduceParams);
+
+	VkPipelineLayoutCreateInfo pipelineLayoutCreateInfo = {};
+	pipelineLayoutCreateInfo.sType = VK_STRUCTURE_TYPE_PIPELINE_LAYOUT_CREATE_INFO;
+	pipelineLayoutCreateInfo.setLayoutCount = 1;
+	pipelineLayoutCreateInfo.pSetLayouts = &depthReduceSetLayout;
+	pipelineLayoutCreateInfo.pushConstantRangeCount = 1;
+	pipelineLayoutCreateInfo.pPushConstantRanges = &reducePushConstantRange;
+
+	result = vkCreatePipelineLayout(Globals::vkContext->logicalDevice, &pipelineLayoutCreateInfo, nullptr, &depthReducePipelineLayout);
+	assert(result == VK_SUCCESS && "Failed to create Pipeline Layout!");
+
+	VkComputePipelineCreateInfo pipelineCreateInfo = {};
+	pipelineCreateInfo.sType = VK_STRUCTURE_TYPE_COMPUTE_PIPELINE_CREATE_INFO;
+	pipelineCreateInfo.stage = computeShaderCreateInfo;
+	pipelineCreateInfo.layout = depthReducePipelineLayout;
+	pipelineCreateInfo.basePipelineHandle = VK_NULL_HANDLE;
+	pipelineCreateInfo.basePipelineIndex = -1;
+
+	auto pipelineStart = std::chrono::high_resolution_clock::now();
+	result = vkCreateComputePipelines(Globals::vkContext->logicalDevice, pipelineCache.get(), 1, &pipelineCreateInfo, nullptr, &depthReducePipeline);
+	pipelineMilliseconds += std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - pipelineStart).count();
+	assert(result == VK_SUCCESS && "Failed to create Compute Pipeline!");
+
+	vkDestroyShaderModule(Globals::vkContext->logicalDevice, computeShaderModule, nullptr);
+}
+
+void VulkanRenderer::createDepthPyramidImage()
+{
+	// Largest power of two that fits the swapchain, so each level is exactly half the one before it.
+	// Level 0 covers a bit more than one depth texel per texel, the reduction takes the farthest of all of them
+	depthPyramidWidth = 1;
+	while (depthPyramidWidth * 2 <= swapChainExtent.width)
+	{
+		depthPyramidWidth *= 2;
+	}
+	depthPyramidHeight = 1;
+	while (depthPyramidHeight * 2 <= swapChainExtent.height)
+	{
+		depthPyramidHeight *= 2;
+	}
+	// Halving down to a single texel
+	depthPyramidLevels = 1;
+	while ((std::max(depthPyramidWidth, depthPyramidHeight) >> depthPyramidLevels) > 0)
+	{
+		depthPyramidLevels++;
+	}
+
+	// Culling samples it, the reduction writes it, it never leaves the general layout
+	depthPyramidImage = Utilities::Texture::createImage(depthPyramidWidth, depthPyramidHeight, depthPyramidLevels, VK_FORMAT_R32_SFLOAT, VK_IMAGE_TILING_OPTIMAL,
+	                                                    VK_IMAGE_USAGE_STORAGE_BIT | VK_IMAGE_USAGE_SAMPLED_BIT, VK_MEMORY_PROPERTY_DEVICE_LOCAL_BIT, &depthPyramidImageMemory);
+	depthPyramidImageView = Utilities::Texture::createImageView(depthPyramidImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, depthPyramidLevels);
+
+	depthPyramidMipViews.resize(depthPyramidLevels);
+	for (uint32_t i = 0; i < depthPyramidLevels; i++)
+	{
+		depthPyramidMipViews[i] = Utilities::Texture::createImageView(depthPyramidImage, VK_FORMAT_R32_SFLOAT, VK_IMAGE_ASPECT_COLOR_BIT, 1, i);
+	}
+
+	// One set per level, written once per pyramid: level i reads level i - 1 (the depth buffer for level 0) and writes level i
+	std::array<VkDescriptorPoolSize, 2> reducePoolSizes = {};
+	reducePoolSizes[0].type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	reducePoolSizes[0].descriptorCount = depthPyramidLevels;
+	reducePoolSizes[1].type = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+	reducePoolSizes[1].descriptorCount = depthPyramidLevels;
+
+	VkDescriptorPoolCreateInfo poolCreateInfo = {};
+	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
+	poolCreateInfo.maxSets = depthPyramidLevels;
+	poolCreateInfo.poolSizeCount = static_cast<uint32_t>(reducePoolSizes.size());
+	poolCreateInfo.pPoolSizes = reducePoolSizes.data();
+
+	VkResult result = vkCreateDescriptorPool(Globals::vkContext->logicalDevice, &poolCreateInfo, nullptr, &depthReduceDescriptorPool);
+	assert(result == VK_SUCCESS && "Failed to create a Descriptor Pool!");
+
+	std::vector<VkDescriptorSetLayout> reduceSetLayouts(depthPyramidLevels, depthReduceSetLayout);
+	VkDescriptorSetAllocateInfo setAllocInfo = {};
+	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocInfo.descriptorPool = depthReduceDescriptorPool;
+	setAllocInfo.descriptorSetCount = depthPyramidLevels;
+	setAllocInfo.pSetLayouts = reduceSetLayouts.data();
+
+	depthReduceDescriptorSets.resize(depthPyramidLevels);
+	result = vkAllocateDescriptorSets(Globals::vkContext->logicalDevice, &setAllocInfo, depthReduceDescriptorSets.data());
+	assert(result == VK_SUCCESS && "Failed to allocate Descriptor Sets!");
+
+	for (uint32_t i = 0; i < depthPyramidLevels; i++)
+	{
+		VkDescriptorImageInfo inputImageInfo = {};
+		inputImageInfo.sampler = depthPyramidSampler;
+		inputImageInfo.imageView = i == 0 ? depthBufferImageView : depthPyramidMipViews[i - 1];
+		inputImageInfo.imageLayout = i == 0 ? VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL : VK_IMAGE_LAYOUT_GENERAL;
+
+		VkDescriptorImageInfo outputImageInfo = {};
+		outputImageInfo.imageView = depthPyramidMipViews[i];
+		outputImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+		std::array<VkWriteDescriptorSet, 2> reduceSetWrites = {};
+		reduceSetWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		reduceSetWrites[0].dstSet = depthReduceDescriptorSets[i];
+		reduceSetWrites[0].dstBinding = 0;
+		reduceSetWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+		reduceSetWrites[0].descriptorCount = 1;
+		reduceSetWrites[0].pImageInfo = &inputImageInfo;
+		reduceSetWrites[1] = reduceSetWrites[0];
+		reduceSetWrites[1].dstBinding = 1;
+		reduceSetWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_IMAGE;
+		reduceSetWrites[1].pImageInfo = &outputImageInfo;
+		vkUpdateDescriptorSets(Globals::vkContext->logicalDevice, static_cast<uint32_t>(reduceSetWrites.size()), reduceSetWrites.data(), 0, nullptr);
+	}
+}
+
+void VulkanRenderer::createFramebuffers()
+{
+	// Resize framebuffer count to equal swap chain image count
+	swapChainFramebuffers.resize(swapChainImages.size());
+	// Create a framebuffer for each swap chain image
+	for (size_t i = 0; i < swapChainFramebuffers.size(); i++)
+	{
+		std::array<VkImageView, 2> attachments = {
+			swapChainImages[i].imageView,
+			depthBufferImageView
+		};
+
+		VkFramebufferCreateInfo framebufferCreateInfo = {};
+		framebufferCreateInfo.sType = VK_STRUCTURE_TYPE_FRAMEBUFFER_CREATE_INFO;
+		framebufferCreateInfo.renderPass = renderPass; // Render Pass layout the Framebuffer will be used with
+		framebufferCreateInfo.attachmentCount = static_cast<uint32_t>(attachments.size());
+		framebufferCreateInfo.pAttachments = attachments.data(); // List of attachments (1:1 with the Render pass)
+		framebufferCreateInfo.width = swapChainExtent.width; // Framebuffer width
+		framebufferCreateInfo.height = swapChainExtent.height; // Framebuffer height
+		framebufferCreateInfo.layers = 1; // Framebuffer layers
+
+		VkResult result = vkCreateFramebuffer(Globals::vkContext->logicalDevice, &framebufferCreateInfo, nullptr, &swapChainFramebuffers[i]);
+		assert(result == VK_SUCCESS && "Failed to create a Framebuffer!");
+	}
+}
+
+void VulkanRenderer::createCommandPool()
+{
+	// Get indices of queue families from device
+	QueueFamilyIndices queueFamilyIndices = getQueueFamilies(Globals::vkContext->physicalDevice);
+
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = VK_COMMAND_POOL_CREATE_RESET_COMMAND_BUFFER_BIT;
+	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily; // Queue Family type buffers from this command pool will use
+
+	// Create a Graphics queue family command pool
+	VkResult result = vkCreateCommandPool(Globals::vkContext->logicalDevice, &poolInfo, nullptr, &Globals::vkContext->graphicsCommandPool);
+	assert(result == VK_SUCCESS && "Failed to create a Command Pool!");
+}
+
+void VulkanRenderer::createCommandBuffers()
+{
+	// One command buffer for each framebuffer and frame in flight, as each frame binds its own regions and texture table
+	commandBuffers.resize(swapChainFramebuffers.size() * MAX_FRAME_DRAWS);
+	recordedSceneVersions.assign(commandBuffers.size(), 0);
+
+	VkCommandBufferAllocateInfo cbAllocInfo = {};
+	cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+	cbAllocInfo.commandPool = Globals::vkContext->graphicsCommandPool;
 	cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_PRIMARY; // Buffer you submit directly to queue, cant be called by other buffers
 	cbAllocInfo.commandBufferCount = static_cast<uint32_t>(commandBuffers.size());
 
@@ -792,6 +1445,48 @@ void VulkanRenderer::createCommandBuffers()
 	assert(result == VK_SUCCESS && "Failed to allocate Command Buffers!");
 }
 
+void VulkanRenderer::createRecordingCommandPools()
+{
+	QueueFamilyIndices queueFamilyIndices = getQueueFamilies(Globals::vkContext->physicalDevice);
+
+	// As many recording tasks as parallelFor can run at once: every worker plus the main thread
+	uint32_t recordingTaskCount = Globals::threadPool->getThreadCount() + 1;
+
+	// Pools are reset as a whole before re-recording, so buffers don't need resetting one by one
+	VkCommandPoolCreateInfo poolInfo = {};
+	poolInfo.sType = VK_STRUCTURE_TYPE_COMMAND_POOL_CREATE_INFO;
+	poolInfo.flags = 0;
+	poolInfo.queueFamilyIndex = queueFamilyIndices.graphicsFamily;
+
+	batchStats.resize(recordingTaskCount);
+
+	for (size_t i = 0; i < MAX_FRAME_DRAWS; i++)
+	{
+		recordingCommandPools[i].resize(recordingTaskCount);
+		secondaryCommandBuffers[i].resize(recordingTaskCount * getDrawPhaseCount());
+
+		for (uint32_t j = 0; j < recordingTaskCount; j++)
+		{
+			VkResult result = vkCreateCommandPool(Globals::vkContext->logicalDevice, &poolInfo, nullptr, &recordingCommandPools[i][j]);
+			assert(result == VK_SUCCESS && "Failed to create a Command Pool!");
+
+			// Secondary buffers can't be submitted, the primary buffers execute them inside their render pass
+			VkCommandBufferAllocateInfo cbAllocInfo = {};
+			cbAllocInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_ALLOCATE_INFO;
+			cbAllocInfo.commandPool = recordingCommandPools[i][j];
+			cbAllocInfo.level = VK_COMMAND_BUFFER_LEVEL_SECONDARY;
+			cbAllocInfo.commandBufferCount = 1;
+
+			// Each pool records its batch once per draw phase
+			for (uint32_t phase = 0; phase < getDrawPhaseCount(); phase++)
+			{
+				result = vkAllocateCommandBuffers(Globals::vkContext->logicalDevice, &cbAllocInfo, &secondaryCommandBuffers[i][phase * recordingTaskCount + j]);
+				assert(result == VK_SUCCESS && "Failed to allocate Command Buffers!");
+			}
+		}
+	}
+}
+
 void VulkanRenderer::createSynchronization()
 {
 	imageAvailable.resize(MAX_FRAME_DRAWS);
@@ -833,7 +1528,7 @@ void VulkanRenderer::createTextureSampler()
 	samplerCreateInfo.mipmapMode = VK_SAMPLER_MIPMAP_MODE_LINEAR; // Mipmap interpolation mode
 	samplerCreateInfo.mipLodBias = 0.0f; // Level of details bias for mip level
 	samplerCreateInfo.minLod = 0.0f; // Minimum level of details to pick mip level
-	samplerCreateInfo.maxLod = 0.0f; // Maximum level of details to pick mip level
+	samplerCreateInfo.maxLod = VK_LOD_CLAMP_NONE; // Maximum level of details to pick mip level (each texture view limits it to its real level count)
 	samplerCreateInfo.anisotropyEnable = VK_TRUE; // Enable anisotropy (makes less aliasing when looking things further away)
 	samplerCreateInfo.maxAnisotropy = 16; // Anisotropy sample level
 
@@ -843,27 +1538,21 @@ void VulkanRenderer::createTextureSampler()
 
 void VulkanRenderer::createUniformBuffers()
 {
-	// ViewProjection buffer size
-	VkDeviceSize vpBufferSize = sizeof(UboViewProjection);
-
-	// Model buffer size
-	//VkDeviceSize modelBufferSize = modelUniformAlignment * MAX_OBJECTS;
-
-	// One uniform buffer for each image (and by extension, command buffer)
-	vpUniformBuffer.resize(swapChainImages.size());
-	vpUniformBufferMemory.resize(swapChainImages.size());
-	//modelDUniformBuffer.resize(swapChainImages.size());
-	//modelDUniformBufferMemory.resize(swapChainImages.size());
-
-	// Create Uniform buffers
-	for (size_t i = 0; i < swapChainImages.size(); i++)
-	{
-		Utilities::Vulkan::createBuffer(Globals::vkContext->physicalDevice, Globals::vkContext->logicalDevice, vpBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-		                                VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &vpUniformBuffer[i], &vpUniformBufferMemory[i]);
-
-		/*createBuffer(Globals::mainDevice->physicalDevice, Globals::mainDevice->logicalDevice, modelBufferSize, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT,
-			VK_MEMORY_PROPERTY_HOST_VISIBLE_BIT | VK_MEMORY_PROPERTY_HOST_COHERENT_BIT, &modelDUniformBuffer[i], &modelDUniformBufferMemory[i]);*/
-	}
+	// One ViewProjection region for each frame in flight, the fence of a frame guarantees the GPU is done with its region
+	vpUniformBuffer.create(sizeof(UboViewProjection), MAX_FRAME_DRAWS, VK_BUFFER_USAGE_UNIFORM_BUFFER_BIT);
+
+	// Same for the transforms, each frame writes every object's transform into its own region
+	objectBuffer.create(sizeof(ObjectData) * MAX_OBJECTS, MAX_FRAME_DRAWS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+
+	// Indirect commands, their counts and per-instance data, also one region per frame.
+	// The culling pass writes the commands and instances as storage buffers, commands are cleared with a fill before it runs.
+	// Room for two sets of commands and instances: occlusion culling's late phase writes its own after the early phase's
+	indirectBuffer.create(sizeof(VkDrawIndexedIndirectCommand) * MAX_DRAWS * 2, MAX_FRAME_DRAWS,
+	                      VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT | VK_BUFFER_USAGE_STORAGE_BUFFER_BIT | VK_BUFFER_USAGE_TRANSFER_DST_BIT);
+	instanceDataBuffer.create(sizeof(InstanceData) * MAX_DRAW_INSTANCES * 2, MAX_FRAME_DRAWS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
+	// Only the CPU culling modes write counts
+	drawCountBuffer.create(sizeof(uint32_t) * MAX_DRAW_BUCKETS, MAX_FRAME_DRAWS, VK_BUFFER_USAGE_INDIRECT_BUFFER_BIT);
+	cullDataBuffer.create(sizeof(CullData) * MAX_DRAW_INSTANCES, MAX_FRAME_DRAWS, VK_BUFFER_USAGE_STORAGE_BUFFER_BIT);
 }
 
 void VulkanRenderer::createDescriptorPool()
@@ -872,22 +1561,35 @@ void VulkanRenderer::createDescriptorPool()
 
 	// Type of descriptors + how many DESCRIPTORS, not Descriptor Sets (combined makes the pool size)
 	// ViewProjection Pool
+	// The culling set is replaced when the swapchain is, the old one lives on until the frames in flight are done with it
+	const uint32_t cullSetCount = 2;
+
 	VkDescriptorPoolSize vpPoolSize = {};
-	vpPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;
-	vpPoolSize.descriptorCount = static_cast<uint32_t>(vpUniformBuffer.size());
+	vpPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
+	vpPoolSize.descriptorCount = 1 + cullSetCount; // Drawing and culling sets
+
+	// Object and Draw Data Pool (DYNAMIC), plus the four storage buffers of the culling set
+	VkDescriptorPoolSize storagePoolSize = {};
+	storagePoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	storagePoolSize.descriptorCount = 2 + 4 * cullSetCount;
+
+	// Visibility buffer and depth pyramid of the culling set
+	VkDescriptorPoolSize visibilityPoolSize = {};
+	visibilityPoolSize.type = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	visibilityPoolSize.descriptorCount = cullSetCount;
 
-	// Model Pool (DYNAMIC)
-	/*VkDescriptorPoolSize modelPoolSize = {};
-	modelPoolSize.type = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-	modelPoolSize.descriptorCount = static_cast<uint32_t>(modelDUniformBuffer.size());*/
+	VkDescriptorPoolSize pyramidPoolSize = {};
+	pyramidPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	pyramidPoolSize.descriptorCount = cullSetCount;
 
 	// List of pool sizes
-	std::vector<VkDescriptorPoolSize> descriptorPoolSizes = { vpPoolSize };
+	std::vector<VkDescriptorPoolSize> descriptorPoolSizes = { vpPoolSize, storagePoolSize, visibilityPoolSize, pyramidPoolSize };
 
 	// Data to create Descriptor Pool
 	VkDescriptorPoolCreateInfo poolCreateInfo = {};
 	poolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	poolCreateInfo.maxSets = static_cast<uint32_t>(swapChainImages.size());					// Maximum number of Descriptor Sets that can be created from pool
+	poolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_FREE_DESCRIPTOR_SET_BIT;				// Replaced culling sets are given back one by one
+	poolCreateInfo.maxSets = 1 + cullSetCount;												// Maximum number of Descriptor Sets that can be created from pool
 	poolCreateInfo.poolSizeCount = static_cast<uint32_t>(descriptorPoolSizes.size());		// Amount of Pool Sizes being passed
 	poolCreateInfo.pPoolSizes = descriptorPoolSizes.data();									// Pool Sizes to create pool with
 
@@ -898,11 +1600,13 @@ void VulkanRenderer::createDescriptorPool()
 	// Create sampler descriptor pool
 	VkDescriptorPoolSize samplerPoolSize = {};
 	samplerPoolSize.type = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
-	samplerPoolSize.descriptorCount = MAX_OBJECTS;
+	samplerPoolSize.descriptorCount = MAX_TEXTURES * MAX_FRAME_DRAWS;
 
+	// One texture table per frame in flight, so slots still used by the other frame can be replaced safely
 	VkDescriptorPoolCreateInfo samplerPoolCreateInfo = {};
 	samplerPoolCreateInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_POOL_CREATE_INFO;
-	samplerPoolCreateInfo.maxSets = MAX_OBJECTS;
+	samplerPoolCreateInfo.flags = VK_DESCRIPTOR_POOL_CREATE_UPDATE_AFTER_BIND_BIT;
+	samplerPoolCreateInfo.maxSets = MAX_FRAME_DRAWS;
 	samplerPoolCreateInfo.poolSizeCount = 1;
 	samplerPoolCreateInfo.pPoolSizes = &samplerPoolSize;
 
@@ -912,93 +1616,220 @@ void VulkanRenderer::createDescriptorPool()
 
 void VulkanRenderer::createDescriptorSets()
 {
-	// Resize Descriptor Set list so one for every buffer
-	descriptorSets.resize(swapChainImages.size());
-
-	std::vector<VkDescriptorSetLayout> setLayouts(swapChainImages.size(), descriptorSetLayout);
-
 	// Descriptor Set Allocation Info
 	VkDescriptorSetAllocateInfo setAllocInfo = {};
 	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
 	setAllocInfo.descriptorPool = descriptorPool;									// Pool to allocate Descriptor Set from
-	setAllocInfo.descriptorSetCount = static_cast<uint32_t>(swapChainImages.size());// Number of sets to allocate
-	setAllocInfo.pSetLayouts = setLayouts.data();									// Layouts to use to allocate sets (1:1 relationship)
+	setAllocInfo.descriptorSetCount = 1;											// Number of sets to allocate
+	setAllocInfo.pSetLayouts = &descriptorSetLayout;								// Layouts to use to allocate sets (1:1 relationship)
+
+	// Allocate a single descriptor set, frames select their region through the dynamic offset
+	VkResult result = vkAllocateDescriptorSets(Globals::vkContext->logicalDevice, &setAllocInfo, &descriptorSet);
+	assert(result == VK_SUCCESS && "Failed to allocate Descriptor Sets!");
+
+	// VIEW PROJECTION DESCRIPTOR
+	// Buffer info and data offset info
+	VkDescriptorBufferInfo vpBufferInfo = {};
+	vpBufferInfo.buffer = vpUniformBuffer.getBuffer();		// Buffer to get data from
+	vpBufferInfo.offset = 0;								// Position of start of data (dynamic offset is added on bind)
+	vpBufferInfo.range = sizeof(UboViewProjection);			// Size of data
+
+	// Data about connection between binding and buffer
+	VkWriteDescriptorSet vpSetWrite = {};
+	vpSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	vpSetWrite.dstSet = descriptorSet;									// Descriptor Set to update
+	vpSetWrite.dstBinding = 0;											// Binding to update (matches with binding on layout/shader)
+	vpSetWrite.dstArrayElement = 0;										// Index in array to update
+	vpSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;	// Type of descriptor
+	vpSetWrite.descriptorCount = 1;										// Amount to update
+	vpSetWrite.pBufferInfo = &vpBufferInfo;								// Information about buffer data to bind
+
+	// OBJECT DESCRIPTOR
+	VkDescriptorBufferInfo objectBufferInfo = {};
+	objectBufferInfo.buffer = objectBuffer.getBuffer();
+	objectBufferInfo.offset = 0;
+	objectBufferInfo.range = objectBuffer.getRegionSize();
+
+	VkWriteDescriptorSet objectSetWrite = {};
+	objectSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	objectSetWrite.dstSet = descriptorSet;
+	objectSetWrite.dstBinding = 1;
+	objectSetWrite.dstArrayElement = 0;
+	objectSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+	objectSetWrite.descriptorCount = 1;
+	objectSetWrite.pBufferInfo = &objectBufferInfo;
+
+	// INSTANCE DATA DESCRIPTOR
+	VkDescriptorBufferInfo instanceDataBufferInfo = {};
+	instanceDataBufferInfo.buffer = instanceDataBuffer.getBuffer();
+	instanceDataBufferInfo.offset = 0;
+	instanceDataBufferInfo.range = instanceDataBuffer.getRegionSize();
+
+	VkWriteDescriptorSet instanceDataSetWrite = objectSetWrite;
+	instanceDataSetWrite.dstBinding = 2;
+	instanceDataSetWrite.pBufferInfo = &instanceDataBufferInfo;
+
+	// Update the descriptor set with new buffer/binding info
+	std::array<VkWriteDescriptorSet, 3> setWrites = { vpSetWrite, objectSetWrite, instanceDataSetWrite };
+	vkUpdateDescriptorSets(Globals::vkContext->logicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(), 0, nullptr);
+
+	// Culling set, replaced whenever the depth pyramid is
+	createCullDescriptorSet();
+
+	// Texture tables, elements are written by the texture manager as textures get created or replaced
+	std::array<VkDescriptorSetLayout, MAX_FRAME_DRAWS> textureSetLayouts;
+	textureSetLayouts.fill(samplerSetLayout);
+
+	VkDescriptorSetAllocateInfo textureSetAllocInfo = {};
+	textureSetAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	textureSetAllocInfo.descriptorPool = samplerDescriptorPool;
+	textureSetAllocInfo.descriptorSetCount = MAX_FRAME_DRAWS;
+	textureSetAllocInfo.pSetLayouts = textureSetLayouts.data();
+
+	result = vkAllocateDescriptorSets(Globals::vkContext->logicalDevice, &textureSetAllocInfo, textureDescriptorSets.data());
+	assert(result == VK_SUCCESS && "Failed to allocate Texture Descriptor Sets!");
+}
+
+void VulkanRenderer::createCullDescriptorSet()
+{
+	// Culling set, also one set for every frame (dynamic offsets pick the regions)
+	VkDescriptorSetAllocateInfo setAllocInfo = {};
+	setAllocInfo.sType = VK_STRUCTURE_TYPE_DESCRIPTOR_SET_ALLOCATE_INFO;
+	setAllocInfo.descriptorPool = descriptorPool;
+	setAllocInfo.descriptorSetCount = 1;
+	setAllocInfo.pSetLayouts = &cullSetLayout;
 
-	// Allocate descriptor sets (multiple)
-	VkResult result = vkAllocateDescriptorSets(Globals::vkContext->logicalDevice, &setAllocInfo, descriptorSets.data());
+	VkResult result = vkAllocateDescriptorSets(Globals::vkContext->logicalDevice, &setAllocInfo, &cullDescriptorSet);
 	assert(result == VK_SUCCESS && "Failed to allocate Descriptor Sets!");
 
-	// Update all of descriptor set buffer bindings
-	for (size_t i = 0; i < swapChainImages.size(); i++)
-	{
-		// VIEW PROJECTION DESCRIPTOR
-		// Buffer info and data offset info
-		VkDescriptorBufferInfo vpBufferInfo = {};
-		vpBufferInfo.buffer = vpUniformBuffer[i];		// Buffer to get data from
-		vpBufferInfo.offset = 0;						// Position of start of data
-		vpBufferInfo.range = sizeof(UboViewProjection);				// Size of data
-
-		// Data about connection between binding and buffer
-		VkWriteDescriptorSet vpSetWrite = {};
-		vpSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		vpSetWrite.dstSet = descriptorSets[i];								// Descriptor Set to update
-		vpSetWrite.dstBinding = 0;											// Binding to update (matches with binding on layout/shader)
-		vpSetWrite.dstArrayElement = 0;									// Index in array to update
-		vpSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER;		// Type of descriptor
-		vpSetWrite.descriptorCount = 1;									// Amount to update
-		vpSetWrite.pBufferInfo = &vpBufferInfo;							// Information about buffer data to bind
-
-		// MODEL DESCRIPTOR
-		// Model Buffer Binding Info
-		/*VkDescriptorBufferInfo modelBufferInfo = {};
-		modelBufferInfo.buffer = modelDUniformBuffer[i];
-		modelBufferInfo.offset = 0;
-		modelBufferInfo.range = modelUniformAlignment;
-
-		VkWriteDescriptorSet modelSetWrite = {};
-		modelSetWrite.sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
-		modelSetWrite.dstSet = descriptorSets[i];
-		modelSetWrite.dstBinding = 1;
-		modelSetWrite.dstArrayElement = 0;
-		modelSetWrite.descriptorType = VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC;
-		modelSetWrite.descriptorCount = 1;
-		modelSetWrite.pBufferInfo = &modelBufferInfo;*/
-
-		// List of Descriptor Set Writes
-		std::vector<VkWriteDescriptorSet> setWrites = { vpSetWrite };
-
-		// Update the descriptor sets with new buffer/binding info
-		vkUpdateDescriptorSets(Globals::vkContext->logicalDevice, static_cast<uint32_t>(setWrites.size()), setWrites.data(),
-			0, nullptr);
+	// Same buffers as the drawing set
+	VkDescriptorBufferInfo vpBufferInfo = {};
+	vpBufferInfo.buffer = vpUniformBuffer.getBuffer();
+	vpBufferInfo.offset = 0;
+	vpBufferInfo.range = sizeof(UboViewProjection);
+
+	VkDescriptorBufferInfo objectBufferInfo = {};
+	objectBufferInfo.buffer = objectBuffer.getBuffer();
+	objectBufferInfo.offset = 0;
+	objectBufferInfo.range = objectBuffer.getRegionSize();
+
+	VkDescriptorBufferInfo instanceDataBufferInfo = {};
+	instanceDataBufferInfo.buffer = instanceDataBuffer.getBuffer();
+	instanceDataBufferInfo.offset = 0;
+	instanceDataBufferInfo.range = instanceDataBuffer.getRegionSize();
+
+	VkDescriptorBufferInfo cullDataBufferInfo = {};
+	cullDataBufferInfo.buffer = cullDataBuffer.getBuffer();
+	cullDataBufferInfo.offset = 0;
+	cullDataBufferInfo.range = cullDataBuffer.getRegionSize();
+
+	VkDescriptorBufferInfo indirectBufferInfo = {};
+	indirectBufferInfo.buffer = indirectBuffer.getBuffer();
+	indirectBufferInfo.offset = 0;
+	indirectBufferInfo.range = indirectBuffer.getRegionSize();
+
+	// Bindings 0-1 are the same buffers as the drawing set, in the same order, binding 4 is the drawing set's instance data
+	std::array<const VkDescriptorBufferInfo*, 5> cullBufferInfos = { &vpBufferInfo, &objectBufferInfo, &cullDataBufferInfo, &indirectBufferInfo, &instanceDataBufferInfo };
+	std::array<VkWriteDescriptorSet, 5> cullSetWrites;
+	for (uint32_t i = 0; i < cullSetWrites.size(); i++)
+	{
+		cullSetWrites[i] = {};
+		cullSetWrites[i].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+		cullSetWrites[i].dstSet = cullDescriptorSet;
+		cullSetWrites[i].descriptorType = i == 0 ? VK_DESCRIPTOR_TYPE_UNIFORM_BUFFER_DYNAMIC : VK_DESCRIPTOR_TYPE_STORAGE_BUFFER_DYNAMIC;
+		cullSetWrites[i].descriptorCount = 1;
+		cullSetWrites[i].dstBinding = i;
+		cullSetWrites[i].pBufferInfo = cullBufferInfos[i];
 	}
+	vkUpdateDescriptorSets(Globals::vkContext->logicalDevice, static_cast<uint32_t>(cullSetWrites.size()), cullSetWrites.data(), 0, nullptr);
+
+	// Occlusion culling inputs, written even when it's off since the layout has them
+	VkDescriptorBufferInfo visibilityBufferInfo = {};
+	visibilityBufferInfo.buffer = Globals::bufferPool->getBuffer(visibilityBuffer);
+	visibilityBufferInfo.offset = 0;
+	visibilityBufferInfo.range = VK_WHOLE_SIZE;
+
+	VkDescriptorImageInfo depthPyramidImageInfo = {};
+	depthPyramidImageInfo.sampler = depthPyramidSampler;
+	depthPyramidImageInfo.imageView = depthPyramidImageView;
+	depthPyramidImageInfo.imageLayout = VK_IMAGE_LAYOUT_GENERAL;
+
+	std::array<VkWriteDescriptorSet, 2> occlusionSetWrites = {};
+	occlusionSetWrites[0].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	occlusionSetWrites[0].dstSet = cullDescriptorSet;
+	occlusionSetWrites[0].dstBinding = 5;
+	occlusionSetWrites[0].descriptorType = VK_DESCRIPTOR_TYPE_STORAGE_BUFFER;
+	occlusionSetWrites[0].descriptorCount = 1;
+	occlusionSetWrites[0].pBufferInfo = &visibilityBufferInfo;
+	occlusionSetWrites[1].sType = VK_STRUCTURE_TYPE_WRITE_DESCRIPTOR_SET;
+	occlusionSetWrites[1].dstSet = cullDescriptorSet;
+	occlusionSetWrites[1].dstBinding = 6;
+	occlusionSetWrites[1].descriptorType = VK_DESCRIPTOR_TYPE_COMBINED_IMAGE_SAMPLER;
+	occlusionSetWrites[1].descriptorCount = 1;
+	occlusionSetWrites[1].pImageInfo = &depthPyramidImageInfo;
+	vkUpdateDescriptorSets(Globals::vkContext->logicalDevice, static_cast<uint32_t>(occlusionSetWrites.size()), occlusionSetWrites.data(), 0, nullptr);
 }
 
-void VulkanRenderer::updateUniformBuffers(uint32_t imageIndex)
+void VulkanRenderer::updateUniformBuffers()
 {
-	// Copy VP data
-	void* data;
-	vkMapMemory(Globals::vkContext->logicalDevice, vpUniformBufferMemory[imageIndex], 0, sizeof(UboViewProjection), 0, &data);
-	memcpy(data, &uboViewProjection, sizeof(UboViewProjection));
-	vkUnmapMemory(Globals::vkContext->logicalDevice, vpUniformBufferMemory[imageIndex]);
+	// Write VP data straight into this frame's region of the mapped buffer
+	memcpy(vpUniformBuffer.getRegion(currentFrame), &uboViewProjection, sizeof(UboViewProjection));
 
-	// Copy Model data
-	/*for (size_t i = 0; i < meshList.size(); i++)
+	// Every node's world transform goes to the object buffer in one linear copy, slot for slot.
+	// Mapped memory may be write-combined, never read it back
+	const std::vector<glm::mat4>& worlds = nodeHierarchy.getWorlds();
+	if (!worlds.empty())
 	{
-		Model* thisModel = (Model*)((uint64_t)modelTransferSpace + (i * modelUniformAlignment));
-		*thisModel = meshList[i].getModel();
+		memcpy(objectBuffer.getRegion(currentFrame), worlds.data(), sizeof(glm::mat4) * worlds.size());
 	}
 
-	// Map the list of model data
-	vkMapMemory(Globals::mainDevice->logicalDevice, modelDUniformBufferMemory[imageIndex], 0, modelUniformAlignment * meshList.size(), 0, &data);
-	memcpy(data, modelTransferSpace, modelUniformAlignment * meshList.size());
-	vkUnmapMemory(Globals::mainDevice->logicalDevice, modelDUniformBufferMemory[imageIndex]);*/
+	// The closest entity of every model decides the mips its textures need, find it with one distance per entity
+	nearestModelNodes.assign(modelList.size(), TransformHierarchy::NO_PARENT);
+	nearestModelDistances.assign(modelList.size(), FLT_MAX);
+	for (const Archetype& archetype : scene.getArchetypes())
+	{
+		if (!archetype.hasComponents(COMPONENT_TRANSFORM | COMPONENT_RENDERABLE))
+		{
+			continue;
+		}
+
+		for (uint32_t i = 0; i < archetype.size(); i++)
+		{
+			const Renderable& renderable = archetype.renderables[i];
+			glm::vec3 viewPosition = glm::vec3(uboViewProjection.view * nodeHierarchy.getWorld(renderable.firstNode)[3]);
+			float distance = glm::dot(viewPosition, viewPosition);
+			if (distance < nearestModelDistances[renderable.modelId])
+			{
+				nearestModelDistances[renderable.modelId] = distance;
+				nearestModelNodes[renderable.modelId] = renderable.firstNode;
+			}
+		}
+	}
+
+	// Keeps the textures resident and streams in the mips the nearest entity needs, once per mesh (the texture manager isn't thread safe)
+	for (size_t j = 0; j < modelList.size(); j++)
+	{
+		if (nearestModelNodes[j] == TransformHierarchy::NO_PARENT)
+		{
+			continue;
+		}
+
+		const MeshModel& thisModel = modelList[j];
+		for (size_t k = 0; k < thisModel.getMeshCount(); k++)
+		{
+			MeshHandle mesh = thisModel.getMesh(k);
+			const glm::mat4& model = nodeHierarchy.getWorld(nearestModelNodes[j] + 1 + thisModel.getMeshNode(k));
+			textureManager.touch(meshPool.getTexture(mesh), estimatePixelsPerUv(mesh, model));
+		}
+	}
 }
 
-void VulkanRenderer::recordCommands(uint32_t currentImage)
+void VulkanRenderer::recordCommands(uint32_t commandBufferIndex, uint32_t currentImage)
 {
 	// Information aobut how to begin each command buffer
 	VkCommandBufferBeginInfo bufferBeginInfo = {};
 	bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+	bufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT; // Cached and resubmitted like the secondaries it executes
 
 	// Information bout how to begin a render pass (only needed for graphics applications)
 	VkRenderPassBeginInfo renderPassBeginInfo = {};
@@ -1016,60 +1847,782 @@ void VulkanRenderer::recordCommands(uint32_t currentImage)
 
 	renderPassBeginInfo.framebuffer = swapChainFramebuffers[currentImage];
 
+	// Command buffer of this frame and image, begin resets whatever it held before
+	VkCommandBuffer commandBuffer = commandBuffers[commandBufferIndex];
+
 	// Start recording commands to command buffer
-	VkResult result = vkBeginCommandBuffer(commandBuffers[currentImage], &bufferBeginInfo);
+	VkResult result = vkBeginCommandBuffer(commandBuffer, &bufferBeginInfo);
 	assert(result == VK_SUCCESS && "Failed to start recording a Command Buffer!");
 
-	// Begin Render Pass
-	vkCmdBeginRenderPass(commandBuffers[currentImage], &renderPassBeginInfo, VK_SUBPASS_CONTENTS_INLINE);
+	// Culling can't run inside a render pass, it goes first and the draws wait on its results.
+	// With occlusion culling this is the early phase: only what was visible last frame
+	if (settings.culling == CullingMode::Gpu)
+	{
+		recordCulling(commandBuffer, settings.occlusionCulling ? CULL_PHASE_EARLY : CULL_PHASE_ALL);
+	}
+
+	// Begin Render Pass, its contents come from this frame's secondary command buffers
+	vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+	if (secondaryCommandBufferCounts[currentFrame] > 0)
+	{
+		vkCmdExecuteCommands(commandBuffer, secondaryCommandBufferCounts[currentFrame], secondaryCommandBuffers[currentFrame].data());
+	}
+
+	// End Render Pass
+	vkCmdEndRenderPass(commandBuffer);
+
+	if (settings.occlusionCulling)
+	{
+		// Late phase: the depth of what was just drawn hides the rest, whatever survives the test gets drawn on top
+		recordDepthPyramid(commandBuffer);
+		recordCulling(commandBuffer, CULL_PHASE_LATE);
+
+		renderPassBeginInfo.renderPass = lateRenderPass;
+		vkCmdBeginRenderPass(commandBuffer, &renderPassBeginInfo, VK_SUBPASS_CONTENTS_SECONDARY_COMMAND_BUFFERS);
+
+		if (secondaryCommandBufferCounts[currentFrame] > 0)
+		{
+			uint32_t lateBuffersOffset = static_cast<uint32_t>(recordingCommandPools[currentFrame].size());
+			vkCmdExecuteCommands(commandBuffer, secondaryCommandBufferCounts[currentFrame], secondaryCommandBuffers[currentFrame].data() + lateBuffersOffset);
+		}
+
+		vkCmdEndRenderPass(commandBuffer);
+	}
+
+	// Stop recording to command buffer
+	result = vkEndCommandBuffer(commandBuffer);
+	assert(result == VK_SUCCESS && "Failed to stop recording a Command Buffer!");
+}
+
+void VulkanRenderer::buildNodeHierarchy()
+{
+	// Transforms set on the nodes so far survive the rebuild, their entities know where they were in the previous hierarchy
+	TransformHierarchy previousHierarchy = std::move(nodeHierarchy);
+	nodeHierarchy.clear();
+
+	for (Archetype& archetype : scene.getArchetypes())
+	{
+		if (!archetype.hasComponents(COMPONENT_TRANSFORM | COMPONENT_RENDERABLE))
+		{
+			continue;
+		}
+
+		for (uint32_t i = 0; i < archetype.size(); i++)
+		{
+			Renderable& renderable = archetype.renderables[i];
+			const MeshModel& thisModel = modelList[renderable.modelId];
+			bool placedBefore = renderable.firstNode != TransformHierarchy::NO_PARENT;
+
+			// The entity's node carries its transform, the model's root nodes hang from it
+			uint32_t entityNode = nodeHierarchy.addNode(TransformHierarchy::NO_PARENT, archetype.transforms[i]);
+			for (size_t k = 0; k < thisModel.getNodeCount(); k++)
+			{
+				const ModelNode& node = thisModel.getNode(k);
+				uint32_t parent = node.parent < 0 ? entityNode : entityNode + 1 + node.parent;
+				nodeHierarchy.addNode(parent, placedBefore ? previousHierarchy.getLocal(renderable.firstNode + 1 + k) : node.localTransform);
+			}
+
+			renderable.firstNode = entityNode;
+		}
+	}
+
+	assert(nodeHierarchy.size() <= MAX_OBJECTS && "Object buffer is out of space!");
+
+	// World transforms are needed right away to sort the draws
+	nodeHierarchy.update();
+	hierarchyTransformVersion = scene.getTransformVersion();
+}
+
+void VulkanRenderer::updateNodeTransforms()
+{
+	// Entity nodes only follow their transforms when one may have moved
+	if (hierarchyTransformVersion != scene.getTransformVersion())
+	{
+		scene.forEach(COMPONENT_TRANSFORM | COMPONENT_RENDERABLE, [this](Archetype& archetype, uint32_t begin, uint32_t end)
+		{
+			for (uint32_t i = begin; i < end; i++)
+			{
+				nodeHierarchy.setLocal(archetype.renderables[i].firstNode, archetype.transforms[i]);
+			}
+		});
+		hierarchyTransformVersion = scene.getTransformVersion();
+	}
+
+	// Also picks up nodes moved through setNodeTransform
+	nodeHierarchy.update();
+}
+
+void VulkanRenderer::buildRenderQueue()
+{
+	// Same far plane as the projection
+	const float farPlane = 100.0f;
 
-	// Bind Pipeline to be used in render pass
-	vkCmdBindPipeline(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipeline);
+	// Draw list system: count the renderable entities of every model, then list their dense indices and nodes model after model
+	std::vector<uint32_t> modelInstanceCounts(modelList.size(), 0);
+	std::vector<uint32_t> modelFirstNodes(modelList.size());
+	for (const Archetype& archetype : scene.getArchetypes())
+	{
+		if (!archetype.hasComponents(COMPONENT_TRANSFORM | COMPONENT_RENDERABLE))
+		{
+			continue;
+		}
+
+		for (uint32_t i = 0; i < archetype.size(); i++)
+		{
+			uint32_t modelId = archetype.renderables[i].modelId;
+			if (modelInstanceCounts[modelId]++ == 0)
+			{
+				modelFirstNodes[modelId] = archetype.renderables[i].firstNode;
+			}
+		}
+	}
 
+	std::vector<uint32_t> modelFirstInstances(modelList.size(), 0);
+	uint32_t instanceTotal = 0;
 	for (size_t j = 0; j < modelList.size(); j++)
 	{
-		MeshModel thisModel = modelList[j];
+		modelFirstInstances[j] = instanceTotal;
+		instanceTotal += modelInstanceCounts[j];
+	}
 
-		// Push constatns to given stage directly (no buffer)
-		vkCmdPushConstants(
-			commandBuffers[currentImage],
-			pipelineLayout,
-			VK_SHADER_STAGE_VERTEX_BIT, // Stage to push constants to
-			0,
-			sizeof(Model), // Size of data being pushed
-			&thisModel.getModel()
-		);
+	modelInstances.resize(instanceTotal);
+	modelInstanceNodes.resize(instanceTotal);
+	std::vector<uint32_t> modelNextInstances = modelFirstInstances;
+	for (const Archetype& archetype : scene.getArchetypes())
+	{
+		if (!archetype.hasComponents(COMPONENT_TRANSFORM | COMPONENT_RENDERABLE))
+		{
+			continue;
+		}
 
+		for (uint32_t i = 0; i < archetype.size(); i++)
+		{
+			uint32_t instance = modelNextInstances[archetype.renderables[i].modelId]++;
+			modelInstances[instance] = archetype.firstIndex + i;
+			modelInstanceNodes[instance] = archetype.renderables[i].firstNode;
+		}
+	}
+
+	renderQueue.clear();
+	for (size_t j = 0; j < modelList.size(); j++)
+	{
+		const MeshModel& thisModel = modelList[j];
+		if (modelInstanceCounts[j] == 0)
+		{
+			continue;
+		}
+
+		// One draw per mesh covers every instance, the first instance stands in for the others when sorting by depth
 		for (size_t k = 0; k < thisModel.getMeshCount(); k++)
 		{
-			VkBuffer vertexBuffers[] = { thisModel.getMesh(k)->getVertexBuffer() }; // Buffers to bind
-			VkDeviceSize offsets[] = { 0 }; // Offsets into buffers being bound
-			vkCmdBindVertexBuffers(commandBuffers[currentImage], 0, 1, vertexBuffers, offsets); // Command to bind vertex buffer before drawing with them
+			MeshHandle mesh = thisModel.getMesh(k);
+			uint32_t modelNode = thisModel.getMeshNode(k);
+			glm::mat4 modelView = uboViewProjection.view * nodeHierarchy.getWorld(modelFirstNodes[j] + 1 + modelNode);
+
+			// Meshes without a texture of their own draw their vertex color, textures with transparent texels need the alpha test
+			TextureHandle texture = meshPool.getTexture(mesh);
+			uint32_t features = 0;
+			if (texture != textureManager.getDefaultTexture())
+			{
+				features |= SHADER_FEATURE_TEXTURED;
+				if (textureManager.hasTransparency(texture))
+				{
+					features |= SHADER_FEATURE_ALPHA_TEST;
+				}
+			}
+			uint32_t pipelineId = getVariantPipeline(features);
+
+			// Single geometry buffer so far (id 0), depth of the bounds center sorts front to back
+			float depth = -(modelView * glm::vec4(meshPool.getBoundsCenter(mesh), 1.0f)).z;
+			uint64_t sortKey = RenderQueue::makeSortKey(pipelineId, textureManager.getTextureId(texture), 0, depth, farPlane);
+
+			renderQueue.push(sortKey, { mesh, static_cast<uint32_t>(j), modelNode, modelFirstInstances[j], modelInstanceCounts[j] });
+		}
+	}
+	renderQueue.sort();
+
+	// Whatever doesn't fit the indirect, instance or draw count buffers is left out of the frame
+	uint32_t droppedDraws = renderQueue.limit(MAX_DRAWS, MAX_DRAW_INSTANCES, MAX_DRAW_BUCKETS);
+	if (droppedDraws > 0)
+	{
+		std::cerr << "Draw buffers are out of space, " << droppedDraws << " mesh draws are not drawn" << std::endl;
+	}
+
+	// Room for every entity up front, culling itself never allocates
+	if (settings.culling == CullingMode::Cpu)
+	{
+		frustumCuller.resize(scene.getEntityCount());
+	}
+	if (settings.culling != CullingMode::Gpu)
+	{
+		entityVisibility.assign(scene.getEntityCount(), 0);
+		visibleEntities.clear();
+		visibleEntities.reserve(scene.getEntityCount());
+	}
+
+	renderQueueVersion = sceneVersion;
+}
+
+void VulkanRenderer::updateDrawCommands()
+{
+	// Visibility is decided every frame by the culling stage, what gets written here only changes with the scene.
+	// The CPU culling modes build the instance data and commands themselves, only the compute pass reads this
+	if (settings.culling != CullingMode::Gpu || drawCommandVersions[currentFrame] == sceneVersion)
+	{
+		return;
+	}
+
+	CullData* cullData = static_cast<CullData*>(cullDataBuffer.getRegion(currentFrame));
+
+	for (uint32_t i = 0; i < renderQueue.size(); i++)
+	{
+		const DrawItem& item = renderQueue.getItem(i);
+		const GeometryRange& geometry = meshPool.getGeometry(item.mesh);
+
+		// Everything the culling pass needs to test an instance and add it to its draw's command
+		CullData cull = {};
+		cull.boundingSphere = glm::vec4(meshPool.getBoundsCenter(item.mesh), meshPool.getBoundsRadius(item.mesh));
+		cull.indexCount = geometry.indexCount;
+		cull.firstIndex = geometry.firstIndex;
+		cull.vertexOffset = geometry.vertexOffset;
+		cull.drawIndex = i;
+		cull.firstInstance = renderQueue.getFirstInstance(i);
+		cull.textureId = RenderQueue::getTextureId(renderQueue.getSortKey(i));
+
+		for (uint32_t j = 0; j < item.instanceCount; j++)
+		{
+			cull.objectIndex = getObjectIndex(modelInstanceNodes[item.firstModelInstance + j], item.modelNode);
+			cullData[cull.firstInstance + j] = cull;
+		}
+	}
 
-			// Bind mesh index buffer, with 0 offset and using uint32 type
-			vkCmdBindIndexBuffer(commandBuffers[currentImage], thisModel.getMesh(k)->getIndexBuffer(), 0, VK_INDEX_TYPE_UINT32);
+	drawCommandVersions[currentFrame] = sceneVersion;
+}
 
-			// Dynamic offset amount
-			//uint32_t dynamicOffset = static_cast<uint32_t>(modelUniformAlignment) * j;
+void VulkanRenderer::cullDraws()
+{
+	auto start = std::chrono::high_resolution_clock::now();
 
-			std::array<VkDescriptorSet, 2> decriptorSetGroup = { descriptorSets[currentImage],
-				samplerDescriptorSets[thisModel.getMesh(k)->getTexId()] };
+	// Bounds only move with the transforms, static scenes skip straight to the frustum test
+	if (culledSceneVersion != sceneVersion || culledTransformVersion != scene.getTransformVersion())
+	{
+		// The trees' shape only depends on which entities exist (not on pipelines or anything else bumping the scene version),
+		// moving entities just stretch their boxes
+		bool structureChanged = culledStructureVersion != scene.getStructureVersion();
+		if (settings.culling == CullingMode::Bvh && structureChanged)
+		{
+			assignBvhPrimitives();
+		}
 
-			// Bind descriptor sets
-			vkCmdBindDescriptorSets(commandBuffers[currentImage], VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
-				0, static_cast<int32_t>(decriptorSetGroup.size()), decriptorSetGroup.data(), 0, nullptr);
+		staticBoundsMoved = false;
+		updateEntityBounds();
 
-			// Execute pipeline
-			vkCmdDrawIndexed(commandBuffers[currentImage], thisModel.getMesh(k)->getIndexCount(), 1, 0, 0, 0);
+		if (settings.culling == CullingMode::Bvh)
+		{
+			if (structureChanged)
+			{
+				staticBvh.build(staticBvhBounds);
+				dynamicBvh.build(dynamicBvhBounds);
+			}
+			else
+			{
+				dynamicBvh.refit(dynamicBvhBounds);
+				if (staticBoundsMoved)
+				{
+					staticBvh.refit(staticBvhBounds);
+				}
+			}
 		}
+
+		culledSceneVersion = sceneVersion;
+		culledTransformVersion = scene.getTransformVersion();
+		culledStructureVersion = scene.getStructureVersion();
 	}
 
-	// End Render Pass
-	vkCmdEndRenderPass(commandBuffers[currentImage]);
+	// Clear last frame's flags through its list, the flags then mark this frame's survivors
+	for (uint32_t entityIndex : visibleEntities)
+	{
+		entityVisibility[entityIndex] = 0;
+	}
 
-	// Stop recording to command buffer
-	result = vkEndCommandBuffer(commandBuffers[currentImage]);
-	assert(result == VK_SUCCESS && "Failed to stop recording a Command Buffer!");
+	visibleEntities.clear();
+	glm::mat4 viewProjection = uboViewProjection.projection * uboViewProjection.view;
+	if (settings.culling == CullingMode::Bvh)
+	{
+		// Both trees report their primitives, turned into dense indices afterwards
+		std::array<glm::vec4, 6> planes = FrustumCuller::extractPlanes(viewProjection);
+		staticBvh.cullFrustum(planes, visibleEntities);
+		size_t dynamicStart = visibleEntities.size();
+		dynamicBvh.cullFrustum(planes, visibleEntities);
+
+		for (size_t i = 0; i < visibleEntities.size(); i++)
+		{
+			visibleEntities[i] = i < dynamicStart ? staticBvhEntities[visibleEntities[i]] : dynamicBvhEntities[visibleEntities[i]];
+		}
+	}
+	else
+	{
+		frustumCuller.cull(viewProjection, visibleEntities);
+	}
+
+	for (uint32_t entityIndex : visibleEntities)
+	{
+		entityVisibility[entityIndex] = 1;
+	}
+
+	// Every instance of a draw follows its entity's flag, visible ones are packed from the draw's first instance on
+	InstanceData* instances = static_cast<InstanceData*>(instanceDataBuffer.getRegion(currentFrame));
+	VkDrawIndexedIndirectCommand* commands = static_cast<VkDrawIndexedIndirectCommand*>(indirectBuffer.getRegion(currentFrame));
+	uint32_t* drawCounts = static_cast<uint32_t*>(drawCountBuffer.getRegion(currentFrame));
+
+	for (uint32_t bucketIndex = 0; bucketIndex < renderQueue.getBucketCount(); bucketIndex++)
+	{
+		const DrawBucket& bucket = renderQueue.getBucket(bucketIndex);
+		uint32_t lastDraw = bucket.firstDraw + bucket.drawCount;
+		uint32_t commandCount = 0;
+
+		for (uint32_t i = bucket.firstDraw; i < lastDraw; i++)
+		{
+			const DrawItem& item = renderQueue.getItem(i);
+			uint32_t firstInstance = renderQueue.getFirstInstance(i);
+			uint32_t textureId = RenderQueue::getTextureId(renderQueue.getSortKey(i));
+
+			uint32_t visibleCount = 0;
+			for (uint32_t j = 0; j < item.instanceCount; j++)
+			{
+				if (entityVisibility[modelInstances[item.firstModelInstance + j]])
+				{
+					instances[firstInstance + visibleCount].objectIndex = getObjectIndex(modelInstanceNodes[item.firstModelInstance + j], item.modelNode);
+					instances[firstInstance + visibleCount].textureId = textureId;
+					visibleCount++;
+				}
+			}
+
+			// With the count variant draws without visible instances are left out and the rest packed at the start of the bucket,
+			// otherwise the whole bucket is drawn and culled draws keep their slot with no instances
+			if (usesDrawCounts())
+			{
+				if (visibleCount > 0)
+				{
+					commands[bucket.firstDraw + commandCount] = makeDrawCommand(i, visibleCount);
+					commandCount++;
+				}
+			}
+			else
+			{
+				commands[i] = makeDrawCommand(i, visibleCount);
+			}
+		}
+
+		drawCounts[bucketIndex] = commandCount;
+	}
+
+	cullingStats.visible = static_cast<uint32_t>(visibleEntities.size());
+	cullingStats.culled = scene.getEntityCount() - cullingStats.visible;
+	cullingStats.milliseconds = std::chrono::duration<double, std::milli>(std::chrono::high_resolution_clock::now() - start).count();
+}
+
+void VulkanRenderer::updateEntityBounds()
+{
+	// Entities only write their own rows and volumes, so the archetypes are split across the thread pool
+	bool useBvh = settings.culling == CullingMode::Bvh;
+	scene.forEach(COMPONENT_TRANSFORM | COMPONENT_RENDERABLE | COMPONENT_BOUNDS, [this, useBvh](Archetype& archetype, uint32_t begin, uint32_t end)
+	{
+		for (uint32_t i = begin; i < end; i++)
+		{
+			const glm::mat4& model = archetype.transforms[i];
+			const MeshModel& thisModel = modelList[archetype.renderables[i].modelId];
+
+			// Sphere grows with the largest scale, the box gets the extents of its transformed axes along each world axis
+			Bounds& bounds = archetype.bounds[i];
+			bounds.center = glm::vec3(model * glm::vec4(thisModel.getBoundsCenter(), 1.0f));
+			float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+			bounds.radius = thisModel.getBoundsRadius() * scale;
+			glm::vec3 objectExtents = thisModel.getBoundsExtents();
+			bounds.extents = glm::abs(glm::vec3(model[0])) * objectExtents.x + glm::abs(glm::vec3(model[1])) * objectExtents.y +
+				glm::abs(glm::vec3(model[2])) * objectExtents.z;
+
+			uint32_t entityIndex = archetype.firstIndex + i;
+			if (useBvh)
+			{
+				Aabb box = { bounds.center - bounds.extents, bounds.center + bounds.extents };
+				if (archetype.hasComponents(COMPONENT_SPIN))
+				{
+					dynamicBvhBounds[entityBvhPrimitives[entityIndex]] = box;
+				}
+				else
+				{
+					// Only a static entity that really moved makes its tree need a refit
+					Aabb& staticBox = staticBvhBounds[entityBvhPrimitives[entityIndex]];
+					if (staticBox.min != box.min || staticBox.max != box.max)
+					{
+						staticBox = box;
+						staticBoundsMoved = true;
+					}
+				}
+			}
+			else
+			{
+				frustumCuller.setBounds(entityIndex, bounds.center, bounds.radius, bounds.extents);
+			}
+		}
+	});
+}
+
+void VulkanRenderer::assignBvhPrimitives()
+{
+	staticBvhEntities.clear();
+	dynamicBvhEntities.clear();
+	entityBvhPrimitives.assign(scene.getEntityCount(), 0);
+
+	for (const Archetype& archetype : scene.getArchetypes())
+	{
+		if (!archetype.hasComponents(COMPONENT_TRANSFORM | COMPONENT_RENDERABLE | COMPONENT_BOUNDS))
+		{
+			continue;
+		}
+
+		// Spinning entities move every frame, anything else only when its transform is set
+		std::vector<uint32_t>& treeEntities = archetype.hasComponents(COMPONENT_SPIN) ? dynamicBvhEntities : staticBvhEntities;
+		for (uint32_t i = 0; i < archetype.size(); i++)
+		{
+			entityBvhPrimitives[archetype.firstIndex + i] = static_cast<uint32_t>(treeEntities.size());
+			treeEntities.push_back(archetype.firstIndex + i);
+		}
+	}
+
+	// Static boxes start empty so the first bounds update counts as a move
+	staticBvhBounds.assign(staticBvhEntities.size(), { glm::vec3(0.0f), glm::vec3(-1.0f) });
+	dynamicBvhBounds.assign(dynamicBvhEntities.size(), {});
+}
+
+VkDrawIndexedIndirectCommand VulkanRenderer::makeDrawCommand(uint32_t drawIndex, uint32_t instanceCount) const
+{
+	const GeometryRange& geometry = meshPool.getGeometry(renderQueue.getItem(drawIndex).mesh);
+
+	VkDrawIndexedIndirectCommand command = {};
+	command.indexCount = geometry.indexCount;
+	command.instanceCount = instanceCount;
+	command.firstIndex = geometry.firstIndex;
+	command.vertexOffset = geometry.vertexOffset;
+	command.firstInstance = renderQueue.getFirstInstance(drawIndex); // gl_InstanceIndex starts here, selecting the visible instances' data
+	return command;
+}
+
+void VulkanRenderer::recordCulling(VkCommandBuffer commandBuffer, CullPhase phase)
+{
+	// The late phase writes its commands and instances after the early phase's, so the first pass can still read those
+	uint32_t phaseSlot = phase == CULL_PHASE_LATE ? 1 : 0;
+
+	// Visible instances count up from 0 in every command, a command no instance reached stays empty and draws nothing
+	if (renderQueue.size() > 0)
+	{
+		vkCmdFillBuffer(commandBuffer, indirectBuffer.getBuffer(), indirectBuffer.getRegionOffset(currentFrame) + sizeof(VkDrawIndexedIndirectCommand) * MAX_DRAWS * phaseSlot,
+			sizeof(VkDrawIndexedIndirectCommand) * renderQueue.size(), 0);
+	}
+
+	// Clear has to land before the atomics start adding, and the visibility the previous late phase wrote before it's read again
+	VkMemoryBarrier clearBarrier = {};
+	clearBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	clearBarrier.srcAccessMask = VK_ACCESS_TRANSFER_WRITE_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	clearBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT | VK_ACCESS_SHADER_WRITE_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_TRANSFER_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		1, &clearBarrier, 0, nullptr, 0, nullptr);
+
+	// Every command keeps its slot (culled ones draw no instances), so the buckets run without draw counts
+	CullParams cullParams = {};
+	cullParams.instanceCount = renderQueue.getTotalInstanceCount();
+	cullParams.phase = phase;
+	cullParams.visibilityKey = static_cast<uint32_t>(sceneVersion) + 1; // 0 is what the visibility buffer starts with
+	cullParams.commandOffset = MAX_DRAWS * phaseSlot;
+	cullParams.instanceOffset = MAX_DRAW_INSTANCES * phaseSlot;
+	cullParams.pyramidSize = glm::vec2(depthPyramidWidth, depthPyramidHeight);
+
+	if (cullParams.instanceCount > 0)
+	{
+		vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipeline);
+
+		// Regions of the ViewProjection, object, cull data, indirect and instance data buffers owned by this frame (in binding order)
+		std::array<uint32_t, 5> dynamicOffsets = { vpUniformBuffer.getRegionOffset(currentFrame), objectBuffer.getRegionOffset(currentFrame),
+			cullDataBuffer.getRegionOffset(currentFrame), indirectBuffer.getRegionOffset(currentFrame), instanceDataBuffer.getRegionOffset(currentFrame) };
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, cullPipelineLayout, 0, 1, &cullDescriptorSet,
+			static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+		vkCmdPushConstants(commandBuffer, cullPipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(CullParams), &cullParams);
+
+		// 64 invocations per workgroup (local_size_x of the shader)
+		vkCmdDispatch(commandBuffer, (cullParams.instanceCount + 63) / 64, 1, 1);
+	}
+
+	// Indirect calls read the commands the pass wrote, the vertex shader the instances
+	VkMemoryBarrier cullBarrier = {};
+	cullBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+	cullBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	cullBarrier.dstAccessMask = VK_ACCESS_INDIRECT_COMMAND_READ_BIT | VK_ACCESS_SHADER_READ_BIT;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_DRAW_INDIRECT_BIT | VK_PIPELINE_STAGE_VERTEX_SHADER_BIT, 0,
+		1, &cullBarrier, 0, nullptr, 0, nullptr);
+}
+
+void VulkanRenderer::recordDepthPyramid(VkCommandBuffer commandBuffer)
+{
+	// Layout changes of a depth/stencil image have to name both aspects
+	VkImageAspectFlags depthAspects = VK_IMAGE_ASPECT_DEPTH_BIT;
+	if (depthBufferFormat == VK_FORMAT_D32_SFLOAT_S8_UINT || depthBufferFormat == VK_FORMAT_D24_UNORM_S8_UINT)
+	{
+		depthAspects |= VK_IMAGE_ASPECT_STENCIL_BIT;
+	}
+
+	// Depth written by the early pass becomes readable by the reduction
+	VkImageMemoryBarrier depthBarrier = {};
+	depthBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	depthBarrier.srcAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	depthBarrier.oldLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	depthBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	depthBarrier.image = depthBufferImage;
+	depthBarrier.subresourceRange.aspectMask = depthAspects;
+	depthBarrier.subresourceRange.baseMipLevel = 0;
+	depthBarrier.subresourceRange.levelCount = 1;
+	depthBarrier.subresourceRange.baseArrayLayer = 0;
+	depthBarrier.subresourceRange.layerCount = 1;
+
+	// Whole pyramid gets rewritten, its old contents can go (after the last culling pass that sampled them)
+	VkImageMemoryBarrier pyramidBarrier = {};
+	pyramidBarrier.sType = VK_STRUCTURE_TYPE_IMAGE_MEMORY_BARRIER;
+	pyramidBarrier.srcAccessMask = 0;
+	pyramidBarrier.dstAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+	pyramidBarrier.oldLayout = VK_IMAGE_LAYOUT_UNDEFINED;
+	pyramidBarrier.newLayout = VK_IMAGE_LAYOUT_GENERAL;
+	pyramidBarrier.srcQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	pyramidBarrier.dstQueueFamilyIndex = VK_QUEUE_FAMILY_IGNORED;
+	pyramidBarrier.image = depthPyramidImage;
+	pyramidBarrier.subresourceRange.aspectMask = VK_IMAGE_ASPECT_COLOR_BIT;
+	pyramidBarrier.subresourceRange.baseMipLevel = 0;
+	pyramidBarrier.subresourceRange.levelCount = depthPyramidLevels;
+	pyramidBarrier.subresourceRange.baseArrayLayer = 0;
+	pyramidBarrier.subresourceRange.layerCount = 1;
+
+	std::array<VkImageMemoryBarrier, 2> startBarriers = { depthBarrier, pyramidBarrier };
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0,
+		0, nullptr, 0, nullptr, static_cast<uint32_t>(startBarriers.size()), startBarriers.data());
+
+	vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthReducePipeline);
+
+	// One level at a time, each one reads the level written just before it
+	DepthReduceParams reduceParams = {};
+	reduceParams.inputSize = glm::uvec2(swapChainExtent.width, swapChainExtent.height);
+	for (uint32_t i = 0; i < depthPyramidLevels; i++)
+	{
+		reduceParams.outputSize = glm::uvec2(std::max(1u, depthPyramidWidth >> i), std::max(1u, depthPyramidHeight >> i));
+
+		vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_COMPUTE, depthReducePipelineLayout, 0, 1, &depthReduceDescriptorSets[i], 0, nullptr);
+		vkCmdPushConstants(commandBuffer, depthReducePipelineLayout, VK_SHADER_STAGE_COMPUTE_BIT, 0, sizeof(DepthReduceParams), &reduceParams);
+
+		// 8x8 invocations per workgroup (local size of the shader)
+		vkCmdDispatch(commandBuffer, (reduceParams.outputSize.x + 7) / 8, (reduceParams.outputSize.y + 7) / 8, 1);
+
+		// Level is complete before the next one (or the culling pass) reads it
+		VkMemoryBarrier levelBarrier = {};
+		levelBarrier.sType = VK_STRUCTURE_TYPE_MEMORY_BARRIER;
+		levelBarrier.srcAccessMask = VK_ACCESS_SHADER_WRITE_BIT;
+		levelBarrier.dstAccessMask = VK_ACCESS_SHADER_READ_BIT;
+		vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, 0, 1, &levelBarrier, 0, nullptr, 0, nullptr);
+
+		reduceParams.inputSize = reduceParams.outputSize;
+	}
+
+	// Depth goes back to being an attachment, the late pass tests against it
+	depthBarrier.srcAccessMask = VK_ACCESS_SHADER_READ_BIT;
+	depthBarrier.dstAccessMask = VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_READ_BIT | VK_ACCESS_DEPTH_STENCIL_ATTACHMENT_WRITE_BIT;
+	depthBarrier.oldLayout = VK_IMAGE_LAYOUT_SHADER_READ_ONLY_OPTIMAL;
+	depthBarrier.newLayout = VK_IMAGE_LAYOUT_DEPTH_STENCIL_ATTACHMENT_OPTIMAL;
+	vkCmdPipelineBarrier(commandBuffer, VK_PIPELINE_STAGE_COMPUTE_SHADER_BIT, VK_PIPELINE_STAGE_EARLY_FRAGMENT_TESTS_BIT | VK_PIPELINE_STAGE_LATE_FRAGMENT_TESTS_BIT, 0,
+		0, nullptr, 0, nullptr, 1, &depthBarrier);
+}
+
+void VulkanRenderer::recordDraws()
+{
+	// One batch per recording pool at most, buckets are a single call each so batches get whole buckets
+	uint32_t bucketCount = renderQueue.getBucketCount();
+	uint32_t batchCount = std::min(static_cast<uint32_t>(recordingCommandPools[currentFrame].size()), bucketCount);
+	uint32_t batchSize = batchCount > 0 ? (bucketCount + batchCount - 1) / batchCount : 0;
+
+	// Each batch records from its own pool, batch i always lands in secondary buffer i so the execution order stays the queue's
+	Globals::threadPool->parallelFor(batchCount, 1, [this, bucketCount, batchSize](uint32_t begin, uint32_t end)
+	{
+		for (uint32_t batch = begin; batch < end; batch++)
+		{
+			recordDrawBatch(batch, batch * batchSize, std::min((batch + 1) * batchSize, bucketCount));
+		}
+	});
+
+	recordingStats = RecordingStats();
+	for (uint32_t batch = 0; batch < batchCount; batch++)
+	{
+		recordingStats.add(batchStats[batch]);
+	}
+
+	if (reportedStatsVersion != sceneVersion)
+	{
+		std::cout << "Recorded " << recordingStats.draws << " draws in " << recordingStats.indirectDraws << " indirect calls ("
+		          << batchCount << " batches), binds issued/skipped:"
+		          << " pipeline " << recordingStats.pipelineBinds << "/" << recordingStats.pipelineBindsSkipped
+		          << ", descriptor sets " << recordingStats.descriptorSetBinds << "/" << recordingStats.descriptorSetBindsSkipped
+		          << ", geometry " << recordingStats.geometryBinds << "/" << recordingStats.geometryBindsSkipped << std::endl;
+		reportedStatsVersion = sceneVersion;
+	}
+
+	secondaryCommandBufferCounts[currentFrame] = batchCount;
+	secondarySceneVersions[currentFrame] = sceneVersion;
+}
+
+void VulkanRenderer::recordDrawBatch(uint32_t batch, uint32_t firstBucket, uint32_t lastBucket)
+{
+	// The frame's fence was waited on, so none of its buffers is pending and the whole pool can go back to the initial state
+	VkResult result = vkResetCommandPool(Globals::vkContext->logicalDevice, recordingCommandPools[currentFrame][batch], 0);
+	assert(result == VK_SUCCESS && "Failed to reset a Command Pool!");
+
+	// Early and late phase (occlusion culling) record the same calls, they only read different commands and counts
+	for (uint32_t phase = 0; phase < getDrawPhaseCount(); phase++)
+	{
+		VkCommandBuffer commandBuffer = secondaryCommandBuffers[currentFrame][phase * recordingCommandPools[currentFrame].size() + batch];
+
+		// Render pass the buffer will be executed in, the framebuffer is left out so any swapchain image can use it
+		VkCommandBufferInheritanceInfo inheritanceInfo = {};
+		inheritanceInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_INHERITANCE_INFO;
+		inheritanceInfo.renderPass = renderPass;
+		inheritanceInfo.subpass = 0;
+		inheritanceInfo.framebuffer = VK_NULL_HANDLE;
+
+		VkCommandBufferBeginInfo bufferBeginInfo = {};
+		bufferBeginInfo.sType = VK_STRUCTURE_TYPE_COMMAND_BUFFER_BEGIN_INFO;
+		// Whole buffer runs inside a render pass. Every swapchain image's cached primary executes it, without simultaneous use
+		// recording it into the next primary would invalidate the ones recorded before
+		bufferBeginInfo.flags = VK_COMMAND_BUFFER_USAGE_RENDER_PASS_CONTINUE_BIT | VK_COMMAND_BUFFER_USAGE_SIMULTANEOUS_USE_BIT;
+		bufferBeginInfo.pInheritanceInfo = &inheritanceInfo;
+
+		result = vkBeginCommandBuffer(commandBuffer, &bufferBeginInfo);
+		assert(result == VK_SUCCESS && "Failed to start recording a Command Buffer!");
+
+		// Dynamic state isn't inherited either, every batch sets the viewport and scissor of the current swapchain
+		VkViewport viewport = {};
+		viewport.x = 0.0f;
+		viewport.y = 0.0f;
+		viewport.width = static_cast<float>(swapChainExtent.width);
+		viewport.height = static_cast<float>(swapChainExtent.height);
+		viewport.minDepth = 0.0f;
+		viewport.maxDepth = 1.0f;
+		vkCmdSetViewport(commandBuffer, 0, 1, &viewport);
+
+		VkRect2D scissor = {};
+		scissor.offset = { 0, 0 };
+		scissor.extent = swapChainExtent;
+		vkCmdSetScissor(commandBuffer, 0, 1, &scissor);
+
+		// Secondary buffers don't inherit bound state, so every batch starts with nothing bound
+		const uint32_t NOTHING_BOUND = ~0u;
+		uint32_t boundPipelineId = NOTHING_BOUND;
+		uint32_t boundGeometryBufferId = NOTHING_BOUND;
+		bool descriptorSetsBound = false;
+
+		// Stats describe one pass, the late phase repeats the same calls
+		RecordingStats lateStats;
+		RecordingStats& stats = phase == 0 ? batchStats[batch] : lateStats;
+		stats = RecordingStats();
+
+		for (uint32_t bucketIndex = firstBucket; bucketIndex < lastBucket; bucketIndex++)
+		{
+			const DrawBucket& bucket = renderQueue.getBucket(bucketIndex);
+
+			// Buckets of the same shader variant are next to each other
+			if (bucket.pipelineId != boundPipelineId)
+			{
+				vkCmdBindPipeline(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, graphicsPipelines[bucket.pipelineId]);
+				boundPipelineId = bucket.pipelineId;
+				stats.pipelineBinds++;
+			}
+			else
+			{
+				stats.pipelineBindsSkipped++;
+			}
+
+			// Every pipeline shares the layout, so the sets stay bound across pipeline changes; textures are picked per draw through the texture id
+			if (!descriptorSetsBound)
+			{
+				std::array<VkDescriptorSet, 2> decriptorSetGroup = { descriptorSet, textureDescriptorSets[currentFrame] };
+
+				// Regions of the ViewProjection, object and draw data buffers owned by this frame (in binding order)
+				std::array<uint32_t, 3> dynamicOffsets = { vpUniformBuffer.getRegionOffset(currentFrame), objectBuffer.getRegionOffset(currentFrame),
+					instanceDataBuffer.getRegionOffset(currentFrame) };
+
+				vkCmdBindDescriptorSets(commandBuffer, VK_PIPELINE_BIND_POINT_GRAPHICS, pipelineLayout,
+					0, static_cast<int32_t>(decriptorSetGroup.size()), decriptorSetGroup.data(),
+					static_cast<uint32_t>(dynamicOffsets.size()), dynamicOffsets.data());
+				descriptorSetsBound = true;
+				stats.descriptorSetBinds++;
+			}
+			else
+			{
+				stats.descriptorSetBindsSkipped++;
+			}
+
+			// Bind the shared vertex and index buffers, every mesh in them draws using offsets
+			if (bucket.geometryBufferId != boundGeometryBufferId)
+			{
+				geometryBuffer.bind(commandBuffer);
+				boundGeometryBufferId = bucket.geometryBufferId;
+				stats.geometryBinds++;
+			}
+			else
+			{
+				stats.geometryBindsSkipped++;
+			}
+
+			// The whole bucket in one call, commands live at the bucket's draws in this frame's region (after the early phase's for the late phase)
+			VkDeviceSize commandOffset = indirectBuffer.getRegionOffset(currentFrame) + sizeof(VkDrawIndexedIndirectCommand) * (MAX_DRAWS * phase + bucket.firstDraw);
+			if (usesDrawCounts())
+			{
+				// The GPU reads how many commands to run, CPU culling changes it every frame without re-recording
+				VkDeviceSize countOffset = drawCountBuffer.getRegionOffset(currentFrame) + sizeof(uint32_t) * bucketIndex;
+				vkCmdDrawIndexedIndirectCount(commandBuffer, indirectBuffer.getBuffer(), commandOffset, drawCountBuffer.getBuffer(), countOffset,
+					bucket.drawCount, sizeof(VkDrawIndexedIndirectCommand));
+			}
+			else
+			{
+				vkCmdDrawIndexedIndirect(commandBuffer, indirectBuffer.getBuffer(), commandOffset, bucket.drawCount, sizeof(VkDrawIndexedIndirectCommand));
+			}
+
+			stats.draws += bucket.drawCount;
+			stats.indirectDraws++;
+		}
+
+		result = vkEndCommandBuffer(commandBuffer);
+		assert(result == VK_SUCCESS && "Failed to stop recording a Command Buffer!");
+	}
+}
+
+float VulkanRenderer::estimatePixelsPerUv(MeshHandle mesh, const glm::mat4& model) const
+{
+	// Meshes without UVs sample a single texel, any level does
+	if (meshPool.getUvDensity(mesh) <= 0.0f)
+	{
+		return 0.0f;
+	}
+
+	// Bounds and UV density are in object space, take the largest scale of the model matrix
+	float scale = std::max({ glm::length(glm::vec3(model[0])), glm::length(glm::vec3(model[1])), glm::length(glm::vec3(model[2])) });
+
+	// Distance from the camera to the closest point of the bounding sphere, no closer than the near plane
+	const float nearPlane = 0.1f;
+	glm::vec4 viewCenter = uboViewProjection.view * model * glm::vec4(meshPool.getBoundsCenter(mesh), 1.0f);
+	float distance = std::max(-viewCenter.z - meshPool.getBoundsRadius(mesh) * scale, nearPlane);
+
+	// Screen pixels covered by one world unit at that distance, then by one UV unit
+	float pixelsPerUnit = std::abs(uboViewProjection.projection[1][1]) * 0.5f * swapChainExtent.height / distance;
+	return pixelsPerUnit * scale / meshPool.getUvDensity(mesh);
 }
 
 void VulkanRenderer::getPhysicalDevice()
@@ -1185,19 +2738,54 @@ bool VulkanRenderer::checkDeviceExtensionSupport(VkPhysicalDevice device)
 
 }
 
+bool VulkanRenderer::checkOptionalDeviceExtensionSupport(VkPhysicalDevice device, const char* extensionName)
+{
+	// Get device extension count
+	uint32_t extensionCount = 0;
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, nullptr);
+
+	// Populate list of extensions
+	std::vector<VkExtensionProperties> extensions(extensionCount);
+	vkEnumerateDeviceExtensionProperties(device, nullptr, &extensionCount, extensions.data());
+
+	for (const auto& extension : extensions)
+	{
+		if (strcmp(extensionName, extension.extensionName) == 0)
+		{
+			return true;
+		}
+	}
+
+	return false;
+}
+
 bool VulkanRenderer::checkDeviceSuitable(VkPhysicalDevice device)
 {
 	// MARCO: Any suggestions?
 
-	/*
 	// Information about the device itself (ID, name, type, vendor, etc)
 	VkPhysicalDeviceProperties deviceProperties;
 	vkGetPhysicalDeviceProperties(device, &deviceProperties);
-	*/
+
+	// Descriptor indexing is core from 1.2
+	if (deviceProperties.apiVersion < VK_API_VERSION_1_2)
+	{
+		return false;
+	}
 
 	// Information about what the device can do (geo shader, tesselation, wide line, etc)
-	VkPhysicalDeviceFeatures deviceFeatures;
-	vkGetPhysicalDeviceFeatures(device, &deviceFeatures);
+	VkPhysicalDeviceVulkan12Features vulkan12Features = {};
+	vulkan12Features.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_VULKAN_1_2_FEATURES;
+
+	VkPhysicalDeviceFeatures2 deviceFeatures2 = {};
+	deviceFeatures2.sType = VK_STRUCTURE_TYPE_PHYSICAL_DEVICE_FEATURES_2;
+	deviceFeatures2.pNext = &vulkan12Features;
+	vkGetPhysicalDeviceFeatures2(device, &deviceFeatures2);
+	VkPhysicalDeviceFeatures& deviceFeatures = deviceFeatures2.features;
+
+	bool descriptorIndexingSupported = vulkan12Features.runtimeDescriptorArray && vulkan12Features.descriptorBindingPartiallyBound
+		&& vulkan12Features.descriptorBindingSampledImageUpdateAfterBind && vulkan12Features.descriptorBindingUpdateUnusedWhilePending
+		&& vulkan12Features.shaderSampledImageArrayNonUniformIndexing;
 
 	QueueFamilyIndices indices = getQueueFamilies(device);
 
@@ -1210,7 +2798,11 @@ bool VulkanRenderer::checkDeviceSuitable(VkPhysicalDevice device)
 		swapChainValid = !swapChainDetails.presentationModes.empty() && !swapChainDetails.formats.empty();
 	}
 
-	return indices.isValid() && extensionSupported && swapChainValid && deviceFeatures.samplerAnisotropy;
+	// Every bucket is one indirect call, and each draw finds its data through firstInstance
+	bool indirectDrawSupported = deviceFeatures.multiDrawIndirect && deviceFeatures.drawIndirectFirstInstance;
+
+	return indices.isValid() && extensionSupported && swapChainValid && deviceFeatures.samplerAnisotropy && descriptorIndexingSupported
+		&& indirectDrawSupported;
 }
 
 bool VulkanRenderer::checkValidationLayerSupport()
@@ -1256,7 +2848,8 @@ QueueFamilyIndices VulkanRenderer::getQueueFamilies(VkPhysicalDevice device)
 	{
 		// first check if queue family has at least 1 queue in that family (could have no queues)
 		// Queue can be multiple types defined through bitfield, Need to bitwise and with VK_QUEUE_*_BIT to check if has required bit
-		if (queueFamily.queueCount > 0 && queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT)
+		// The culling pass is dispatched from the graphics command buffers, so the family needs compute too
+		if (queueFamily.queueCount > 0 && (queueFamily.queueFlags & VK_QUEUE_GRAPHICS_BIT) && (queueFamily.queueFlags & VK_QUEUE_COMPUTE_BIT))
 		{
 			indices.graphicsFamily = i;
 		}
@@ -1427,11 +3020,57 @@ int VulkanRenderer::createMeshModel(const char* modelFile)
 	// Create mesh model and add to list
 	MeshModel meshModel;
 	meshModel.LoadFile(
-		modelFile,
-		textureImages, textureImageMemory, textureImageViews, 
-		samplerDescriptorPool, samplerSetLayout, textureSampler, samplerDescriptorSets
+		modelFile, geometryBuffer, meshPool, textureManager
 	);
+
+	// Reuse the id of an unloaded model if there is one
+	if (!freeModelIds.empty())
+	{
+		int modelId = freeModelIds.back();
+		freeModelIds.pop_back();
+		modelList[modelId] = meshModel;
+		return modelId;
+	}
+
 	modelList.push_back(meshModel);
 
 	return modelList.size() - 1;
 }
+
+void VulkanRenderer::unloadMeshModel(int modelId)
+{
+	if (modelId < 0 || static_cast<size_t>(modelId) >= modelList.size()) return;
+
+	// Stop drawing it right away, its meshes and textures go once the frames that drew it have finished
+	std::vector<Entity> instances;
+	for (const Archetype& archetype : scene.getArchetypes())
+	{
+		if (!archetype.hasComponents(COMPONENT_RENDERABLE))
+		{
+			continue;
+		}
+
+		for (uint32_t i = 0; i < archetype.size(); i++)
+		{
+			if (archetype.renderables[i].modelId == static_cast<uint32_t>(modelId))
+			{
+				instances.push_back(archetype.entities[i]);
+			}
+		}
+	}
+	for (Entity entity : instances)
+	{
+		scene.destroyEntity(entity);
+	}
+	sceneNodeCount -= static_cast<uint32_t>(instances.size() * (1 + modelList[modelId].getNodeCount()));
+
+	MeshModel meshModel = modelList[modelId];
+	modelList[modelId] = MeshModel();
+	freeModelIds.push_back(modelId);
+	sceneVersion++;
+
+	deletionQueue.push([this, meshModel]() mutable
+	{
+		meshModel.destroyMeshModel(meshPool, geometryBuffer, textureManager);
+	});
+}
@@ -2,30 +2,101 @@
 
 #include <glm/mat4x4.hpp>
 
+#include <array>
+#include <atomic>
+#include <future>
+#include <string>
 #include <vector>
 
+#include "Bvh.h"
+#include "DeletionQueue.h"
+#include "FrustumCuller.h"
 #include "MeshModel.h"
+#include "PipelineCache.h"
+#include "RenderQueue.h"
+#include "RingBuffer.h"
+#include "Scene.h"
+#include "TransformHierarchy.h"
+#include "TextureManager.h"
 #include "Utilities/Vulkan.h"
 
 struct GLFWwindow;
 
+// Where draws outside the camera frustum get dropped
+enum class CullingMode {
+	Gpu, // Compute pass right before the render pass, no CPU cost per frame
+	Cpu, // SIMD test over the entities' bounds on the main thread, reports stats
+	Bvh // Static and moving hierarchies over the entities' bounds on the main thread, skips whole subtrees, reports stats
+};
+
+// Features a shader variant is compiled with, each one is a specialization constant of the fragment shader (constant id = bit index)
+enum ShaderFeatureFlags : uint32_t {
+	SHADER_FEATURE_TEXTURED = 1 << 0, // Samples the mesh's texture, else draws the vertex color
+	SHADER_FEATURE_ALPHA_TEST = 1 << 1 // Discards the fragments of the texture's transparent texels
+};
+const uint32_t SHADER_FEATURE_COUNT = 2;
+
+// Tunables read from the engine configuration
+struct RendererSettings {
+	VkDeviceSize textureBudget = 0; // Bytes textures may use, 0 to follow the driver's VRAM budget
+	CullingMode culling = CullingMode::Gpu;
+	// Two-phase occlusion culling against a depth pyramid (GPU culling only): last frame's visible draws go first,
+	// the rest is tested against their depth and only drawn when not hidden
+	bool occlusionCulling = false;
+	std::string pipelineCacheFile = "pipeline_cache.bin"; // Compiled pipelines kept between runs
+};
+
 class VulkanRenderer
 {
 public:
-	int init(GLFWwindow* newWindow);
+	int init(GLFWwindow* newWindow, const RendererSettings& newSettings);
 
+	// Loads the model's meshes and textures, nothing is drawn until an entity renders it
 	int createMeshModel(const char* modelFile);
-	void updateModel(int modelId, glm::mat4 newModel);
+	// Destroys the entities rendering the model and releases it once the frames in flight are done with it, its id may be handed out again
+	void unloadMeshModel(int modelId);
+
+	// Entity drawing the model with the given transform, every entity of a model is drawn in the same instanced calls.
+	// Null entity when the model isn't loaded or its nodes don't fit the object buffer anymore
+	Entity createInstance(int modelId, const glm::mat4& transform);
+
+	// Entities of the world, transforms and components can be changed through it directly
+	inline Scene& getScene() { return scene; }
+
+	inline const MeshModel& getMeshModel(int modelId) const { return modelList[modelId]; }
+	// Transform of one node of the entity's model relative to its parent node, moves the node's whole subtree.
+	// Ignored until the entity has been drawn once (its nodes get placed in the hierarchy then)
+	void setNodeTransform(Entity entity, uint32_t node, const glm::mat4& local);
+
+	// Shader variants still compiling on the worker threads, their draws use the fallback pipeline until then
+	inline uint32_t getPendingPipelineCount() const { return static_cast<uint32_t>(pendingPipelines.size()); }
+	// Time spent creating pipelines so far, background compiles included (summed over the threads)
+	inline double getPipelineMilliseconds() const { return pipelineMilliseconds; }
 
 	void draw();
 	void cleanup();
+
+	// Binds made and skipped the last time the scene was recorded
+	inline const RecordingStats& getRecordingStats() const { return recordingStats; }
+	// Entities kept and dropped by the last frame's CPU culling and how long it took
+	inline const CullingStats& getCullingStats() const { return cullingStats; }
 private:
 	GLFWwindow* window;
+	RendererSettings settings;
 
 	int currentFrame = 0;
+	uint64_t frameNumber = 0; // Frames drawn so far
+
+	// Bumped whenever what gets drawn changes (models added/removed, materials), recorded command buffers of older versions are stale
+	uint64_t sceneVersion = 1;
+	uint64_t sceneStructureVersion = 0; // Structure version of the scene the scene version was last bumped for
 
-	// Scene objects
+	// Scene objects, renderable entities reference the models by id
+	Scene scene;
 	std::vector<MeshModel> modelList;
+	std::vector<int> freeModelIds; // Elements of modelList left by unloaded models
+	MeshPool meshPool;
+	GeometryBuffer geometryBuffer;
 
 	// Scene Settings
 	struct UboViewProjection {
@@ -38,52 +109,154 @@ private:
 	VkInstance instance;
 	VkQueue presentationQueue;
 	VkSurfaceKHR surface;
-	VkSwapchainKHR swapchain;
+	VkSwapchainKHR swapchain = VK_NULL_HANDLE;
+	bool swapChainOutOfDate = false; // Window was resized (or presenting said so), the swapchain gets recreated before the next frame
 
 	std::vector<SwapchainImage> swapChainImages;
 	std::vector<VkFramebuffer> swapChainFramebuffers;
+	// One per frame in flight and swapchain image (frame * image count + image), recorded once and replayed until the scene changes
 	std::vector<VkCommandBuffer> commandBuffers;
-
+	std::vector<uint64_t> recordedSceneVersions; // Scene version each command buffer was recorded with, 0 when never recorded
+
+	// The draws themselves go in secondary command buffers recorded in parallel, one batch of the queue's buckets each.
+	// Every recording task has its own pool per frame in flight, so threads never share a pool and a frame's pools are reset together
+	std::array<std::vector<VkCommandPool>, MAX_FRAME_DRAWS> recordingCommandPools;
+	std::array<std::vector<VkCommandBuffer>, MAX_FRAME_DRAWS> secondaryCommandBuffers; // One per recording pool and draw phase (phase * pools + pool)
+	std::array<uint32_t, MAX_FRAME_DRAWS> secondaryCommandBufferCounts = {}; // Batches the buckets were split in when recorded
+	std::array<uint64_t, MAX_FRAME_DRAWS> secondarySceneVersions = {};
+
+	// Every mesh draw of the scene sorted by the state it needs, rebuilt when the scene changes so it can be split between threads
+	RenderQueue renderQueue;
+	uint64_t renderQueueVersion = 0;
+	std::vector<uint32_t> modelInstances; // Dense index of every renderable entity grouped by model, the draws' firstModelInstance point into it
+	std::vector<uint32_t> modelInstanceNodes; // Hierarchy node of the same entities
+	std::vector<uint32_t> nearestModelNodes; // Per model, hierarchy node of its entity closest to the camera (NO_PARENT without entities)
+	std::vector<float> nearestModelDistances; // Squared view distance of that entity
+
+	// Every renderable entity's node followed by its model's nodes, the object buffer holds its world matrices (by slot)
+	TransformHierarchy nodeHierarchy;
+	uint32_t sceneNodeCount = 0; // Nodes the hierarchy holds once rebuilt for the current entities
+	uint64_t hierarchyTransformVersion = 0; // Transform version of the scene the entity nodes were last updated for
+	std::vector<RecordingStats> batchStats; // One per recording pool, added up once every batch is done
+	RecordingStats recordingStats;
+	uint64_t reportedStatsVersion = 0; // Scene version whose recording stats were printed
+
+	// CPU culling: one volume per entity (by dense index) built from its Bounds component, and the ones that passed this frame
+	FrustumCuller frustumCuller;
+	// BVH culling keeps two trees, both built with the SAH when entities are added or removed. Entities the animation system moves
+	// (Spin) go in the dynamic one, refitted whenever transforms change. The static one is only refitted when one of its entities moved
+	Bvh staticBvh;
+	Bvh dynamicBvh;
+	std::vector<Aabb> staticBvhBounds; // By primitive
+	std::vector<Aabb> dynamicBvhBounds;
+	std::vector<uint32_t> staticBvhEntities; // Dense index of every primitive
+	std::vector<uint32_t> dynamicBvhEntities;
+	std::vector<uint32_t> entityBvhPrimitives; // Primitive of every entity in its tree, by dense index
+	std::atomic<bool> staticBoundsMoved{ false };
+	uint64_t culledStructureVersion = 0; // Structure version of the scene the trees were built for
+	std::vector<uint32_t> visibleEntities;
+	std::vector<uint8_t> entityVisibility; // 1 for the entities in visibleEntities, by dense index
+	CullingStats cullingStats;
+	uint64_t culledSceneVersion = 0; // Scene version the bounds were last computed for
+	uint64_t culledTransformVersion = 0; // Transform version of the scene the bounds were last computed for
+
+	VkFormat depthBufferFormat;
 	VkImage depthBufferImage;
 	VkDeviceMemory depthBufferImageMemory;
 	VkImageView depthBufferImageView;
 
+	// Occlusion culling: farthest depth of every 2^level texel footprint of the early phase's depth, one level per halving
+	VkImage depthPyramidImage;
+	VkDeviceMemory depthPyramidImageMemory;
+	VkImageView depthPyramidImageView; // Every level, sampled by the culling pass
+	std::vector<VkImageView> depthPyramidMipViews; // One per level, written by the reduction
+	uint32_t depthPyramidWidth = 0; // Largest power of two that fits the swapchain
+	uint32_t depthPyramidHeight = 0;
+	uint32_t depthPyramidLevels = 0;
+	VkSampler depthPyramidSampler;
+	BufferHandle visibilityBuffer; // Per instance visibility key written by the late phase, read by the next frame's early phase
+
 	VkSampler textureSampler;
 
 	// Descriptors
 	VkDescriptorSetLayout descriptorSetLayout;
 	VkDescriptorSetLayout samplerSetLayout;
-	VkPushConstantRange pushConstantRange;
+	VkDescriptorSetLayout cullSetLayout;
+	VkDescriptorSetLayout depthReduceSetLayout;
 
 	VkDescriptorPool descriptorPool;
 	VkDescriptorPool samplerDescriptorPool;
-	std::vector<VkDescriptorSet> descriptorSets;
-	std::vector<VkDescriptorSet> samplerDescriptorSets;
-
-	std::vector<VkBuffer> vpUniformBuffer;
-	std::vector<VkDeviceMemory> vpUniformBufferMemory;
-
-	std::vector<VkBuffer> modelDUniformBuffer;
-	std::vector<VkDeviceMemory> modelDUniformBufferMemory;
+	VkDescriptorSet descriptorSet;
+	VkDescriptorSet cullDescriptorSet;
+	VkDescriptorPool depthReduceDescriptorPool;
+	std::vector<VkDescriptorSet> depthReduceDescriptorSets; // One per pyramid level: previous level (or depth buffer) in, level out
+	std::array<VkDescriptorSet, MAX_FRAME_DRAWS> textureDescriptorSets; // Bindless array of every texture, indexed by texture id (one per frame in flight)
+
+	// Persistently mapped, one region per frame in flight (bound with a dynamic offset)
+	RingBuffer vpUniformBuffer;
+	RingBuffer objectBuffer; // Transform of every entity, indexed by its dense index in the scene
+
+	// What the indirect calls draw, written into the frame's region by the culling stage (compute pass or CPU, see CullingMode).
+	// Commands of a bucket start at its first draw, each one draws the visible instances of its model.
+	// The CPU stage packs the commands with visible instances at the start of the bucket and counts them, the GPU stage leaves empty ones in place
+	RingBuffer indirectBuffer; // VkDrawIndexedIndirectCommand per draw
+	RingBuffer drawCountBuffer; // Draws to execute per bucket (CPU culling with the count variant)
+	RingBuffer instanceDataBuffer; // InstanceData per visible instance, each draw's from its first instance on
+	RingBuffer cullDataBuffer; // CullData per instance of every draw
+	std::array<uint64_t, MAX_FRAME_DRAWS> drawCommandVersions = {}; // Scene version each frame's cull data was written for
 
 	//VkDeviceSize minUniformBufferOffset;
 	//size_t modelUniformAlignment;
 	//Model* modelTransferSpace;
 
 	// Assets
+	TextureManager textureManager;
 
-	std::vector<VkImage> textureImages;
-	std::vector<VkDeviceMemory> textureImageMemory;
-	std::vector<VkImageView> textureImageViews;
+	// Resources waiting for the frames in flight that may use them
+	DeletionQueue deletionQueue;
 
 	// Pipeline
-	VkPipeline graphicsPipeline;
+	PipelineCache pipelineCache;
+	double pipelineMilliseconds = 0.0; // Time spent creating pipelines, cache lookups included
+	// Graphics pipelines by pipeline id (the sort key's pipeline field), one per shader variant drawn so far
+	static const uint32_t NO_PIPELINE = UINT32_MAX;
+	static const uint32_t MAX_GRAPHICS_PIPELINES = 256;
+	std::vector<VkPipeline> graphicsPipelines;
+	std::array<uint32_t, 1 << SHADER_FEATURE_COUNT> variantPipelineIds; // Pipeline id of every feature combination, NO_PIPELINE until first needed
+	VkShaderModule vertexShaderModule;
+	VkShaderModule fragmentShaderModule;
+
+	// Variant that can draw any mesh correctly (only slower than its own), compiled up front and drawn while the others compile
+	static const uint32_t FALLBACK_FEATURES = SHADER_FEATURE_TEXTURED | SHADER_FEATURE_ALPHA_TEST;
+
+	struct CompiledPipeline {
+		VkPipeline pipeline;
+		double milliseconds;
+	};
+
+	// Variant being compiled on the worker threads
+	struct PendingPipeline {
+		uint32_t features;
+		std::future<CompiledPipeline> compiled;
+	};
+	std::vector<PendingPipeline> pendingPipelines;
 	VkPipelineLayout pipelineLayout;
 	VkRenderPass renderPass;
+	VkRenderPass lateRenderPass; // Occlusion culling's second pass, loads what the first one drew (compatible with renderPass)
+
+	// Frustum culling compute pass, tests every draw's bounding sphere and writes the indirect commands of the survivors
+	VkPipeline cullPipeline;
+	VkPipelineLayout cullPipelineLayout;
+
+	// Builds the depth pyramid one level per dispatch
+	VkPipeline depthReducePipeline;
+	VkPipelineLayout depthReducePipelineLayout;
 
 	// Utility
 	VkFormat swapChainImageFormat;
 	VkExtent2D swapChainExtent;
+	bool memoryBudgetSupported = false; // VK_EXT_memory_budget enabled on the device
+	bool drawIndirectCountSupported = false; // vkCmdDrawIndexedIndirectCount usable, else buckets draw their full range
 
 	// Synchronization
 	std::vector<VkSemaphore> imageAvailable;
@@ -96,25 +269,76 @@ private:
 	void createLogicalDevice();
 	void createSurface();
 	void createSwapChain();
+	// New swapchain for the current window size plus everything sized after it, the old ones go through the deletion queue.
+	// Returns false while the window is minimized (nothing to draw into)
+	bool recreateSwapChain();
+	void updateProjection();
+	static void onFramebufferResized(GLFWwindow* resizedWindow, int width, int height);
 	void createRenderPass();
 	void createDescriptorSetLayout();
-	void createPushConstantRange();
 	void createGraphicsPipeline();
+	// Pipeline id of the variant with these ShaderFeatureFlags. The first time it starts compiling it in the background,
+	// the fallback's id is returned until it is done
+	uint32_t getVariantPipeline(uint32_t features);
+	// Only reads state that never changes after init, safe to call from the worker threads
+	VkPipeline createGraphicsPipelineVariant(uint32_t features);
+	// Gives ids to the variants done compiling, their draws switch over once the queue is rebuilt
+	void finishPipelineCompiles();
+	void createCullPipeline();
+	void createDepthPyramid();
+	// Pyramid sized after the swapchain, with the reduction sets reading the depth buffer
+	void createDepthPyramidImage();
 	void createDepthBufferImage();
 	void createFramebuffers();
 	void createCommandPool();
 	void createCommandBuffers();
+	void createRecordingCommandPools();
 	void createSynchronization();
 	void createTextureSampler();
 
 	void createUniformBuffers();
 	void createDescriptorPool();
 	void createDescriptorSets();
-
-	void updateUniformBuffers(uint32_t imageIndex);
+	void createCullDescriptorSet();
+
+	// Writes this frame's camera and transforms, and tells the texture manager what the draws need
+	void updateUniformBuffers();
+
+	// Places every renderable entity and its model's nodes in the hierarchy, nodes of entities already placed keep their transforms
+	void buildNodeHierarchy();
+	// Entity transforms into their nodes, then the dirty subtrees of the hierarchy
+	void updateNodeTransforms();
+	// Element of the object buffer holding the world transform of one node of a renderable entity
+	inline uint32_t getObjectIndex(uint32_t entityNode, uint32_t modelNode) const { return nodeHierarchy.getSlot(entityNode + 1 + modelNode); }
+
+	// Sorts every mesh draw of the scene into the render queue
+	void buildRenderQueue();
+	// Fills this frame's culling input from the render queue
+	void updateDrawCommands();
+	// Tests every entity against the camera frustum on the CPU, then writes this frame's instance data, indirect commands and counts for the visible ones
+	void cullDraws();
+	// Bounds system: world space bounds of every renderable entity from its transform and model, into the culler or the hierarchy
+	void updateEntityBounds();
+	// Splits the entities between the static and dynamic trees
+	void assignBvhPrimitives();
+	VkDrawIndexedIndirectCommand makeDrawCommand(uint32_t drawIndex, uint32_t instanceCount) const;
+	// Indirect count calls only when the CPU culls, the GPU pass leaves culled commands in place with no instances
+	inline bool usesDrawCounts() const { return drawIndirectCountSupported && settings.culling != CullingMode::Gpu; }
 
 	// Record functions
-	void recordCommands(uint32_t currentImage);
+	void recordCommands(uint32_t commandBufferIndex, uint32_t currentImage);
+	// Clears the phase's commands and dispatches the culling pass, must come before the render pass reads the indirect buffer
+	void recordCulling(VkCommandBuffer commandBuffer, CullPhase phase);
+	// Reduces the depth buffer into the depth pyramid, between the two passes of occlusion culling
+	void recordDepthPyramid(VkCommandBuffer commandBuffer);
+	// Re-records this frame's secondary command buffers, the buckets are split between the worker threads
+	void recordDraws();
+	void recordDrawBatch(uint32_t batch, uint32_t firstBucket, uint32_t lastBucket);
+	// Draw phases recorded per batch: one, or early and late with occlusion culling
+	inline uint32_t getDrawPhaseCount() const { return settings.occlusionCulling ? 2 : 1; }
+
+	// Screen pixels one UV unit of the mesh covers, from its projected bounds and UV density
+	float estimatePixelsPerUv(MeshHandle mesh, const glm::mat4& model) const;
 
 	// Get Functions
 	void getPhysicalDevice();
@@ -126,6 +350,7 @@ private:
 	// Checking
 	bool checkInstanceExtensionSupport(std::vector<const char*>* checkExtensions);
 	bool checkDeviceExtensionSupport(VkPhysicalDevice device);
+	bool checkOptionalDeviceExtensionSupport(VkPhysicalDevice device, const char* extensionName);
 	bool checkDeviceSuitable(VkPhysicalDevice device);
 
 	// Validation section added by the community at Udemy
@@ -1,5 +1,14 @@
-::TODO: Make compilerPath agnostic (probably putting the sdk tools in source control?) 
-set compilerPath=C:\VulkanSDK\1.2.141.2\Bin32
-%compilerPath%\glslangValidator.exe -V shader.vert
-%compilerPath%\glslangValidator.exe -V shader.frag
+::Same as the build does for every shader, handy when only editing shaders
+::Uses the compiler in Dependencies\vulkan\Bin when there is one, the Vulkan SDK's (installs set VULKAN_SDK) otherwise
+set compilerPath=%~dp0..\..\..\Dependencies\vulkan\Bin
+if not exist "%compilerPath%\glslangValidator.exe" set compilerPath=%VULKAN_SDK%\Bin
+if not exist "%compilerPath%\glslangValidator.exe" (
+	echo No shader compiler found: put glslangValidator.exe in Dependencies\vulkan\Bin or install the Vulkan SDK
+	pause
+	exit /b 1
+)
+"%compilerPath%\glslangValidator.exe" -V shader.vert -o vert.spv
+"%compilerPath%\glslangValidator.exe" -V shader.frag -o frag.spv
+"%compilerPath%\glslangValidator.exe" -V cull.comp -o cull.spv
+"%compilerPath%\glslangValidator.exe" -V depthreduce.comp -o depthreduce.spv
 pause
\ No newline at end of file
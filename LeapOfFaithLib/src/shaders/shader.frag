@@ -1,13 +1,35 @@
 #version 450
+#extension GL_EXT_nonuniform_qualifier : require
 
 layout(location = 0) in vec3 fragCol;
 layout(location = 1) in vec2 fragTex;
+layout(location = 2) flat in uint fragTexId;
 
-layout(set = 1, binding = 0) uniform sampler2D textureSampler;
+// Shader variant features, set per pipeline (constant id is the bit of ShaderFeatureFlags)
+layout(constant_id = 0) const bool TEXTURED = true;
+layout(constant_id = 1) const bool ALPHA_TEST = false;
+
+// Alpha below this is a hole when alpha testing
+const float ALPHA_CUTOFF = 0.5;
+
+// Bindless texture table, every texture lives at its texture id
+layout(set = 1, binding = 0) uniform sampler2D textureSampler[];
 
 layout(location = 0) out vec4 outColor; // Final output color (must also have location)
 
 void main()
 {
-	outColor = texture(textureSampler, fragTex);
-}
\ No newline at end of file
+	if (TEXTURED)
+	{
+		outColor = texture(textureSampler[nonuniformEXT(fragTexId)], fragTex);
+	}
+	else
+	{
+		outColor = vec4(fragCol, 1.0);
+	}
+
+	if (ALPHA_TEST && outColor.a < ALPHA_CUTOFF)
+	{
+		discard;
+	}
+}
@@ -9,22 +9,36 @@ layout(set = 0, binding = 0) uniform UboViewProjection {
 	mat4 view;
 } uboViewProjection;
 
-// NOT IN USE, LEFT FOR REFERENCE
-layout(set = 0, binding = 1) uniform UboModel {
+// Transform of every object, rewritten each frame
+struct ObjectData {
 	mat4 model;
-} uboModel;
+};
 
-layout(push_constant) uniform PushModel {
-	mat4 model;
-} pushModel;
+layout(std430, set = 0, binding = 1) readonly buffer ObjectBuffer {
+	ObjectData objects[];
+} objectBuffer;
+
+// Visible instances of every draw, packed from the command's firstInstance on (so gl_InstanceIndex selects one)
+struct InstanceData {
+	uint objectIndex;
+	uint textureId;
+};
+
+layout(std430, set = 0, binding = 2) readonly buffer InstanceDataBuffer {
+	InstanceData instances[];
+} instanceDataBuffer;
 
 layout(location = 0) out vec3 fragCol;
 layout(location = 1) out vec2 fragTex;
+layout(location = 2) flat out uint fragTexId;
 
 void main()
 {
-	gl_Position = uboViewProjection.projection * uboViewProjection.view * pushModel.model * vec4(pos, 1.0);
+	InstanceData instance = instanceDataBuffer.instances[gl_InstanceIndex];
+	mat4 model = objectBuffer.objects[instance.objectIndex].model;
+	gl_Position = uboViewProjection.projection * uboViewProjection.view * model * vec4(pos, 1.0);
 
 	fragCol = col;
 	fragTex = tex;
-}
\ No newline at end of file
+	fragTexId = instance.textureId;
+}
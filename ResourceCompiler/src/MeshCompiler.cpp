@@ -6,7 +6,10 @@
 #include <assimp/scene.h>
 #include <assimp/postprocess.h>
 
-void MeshCompiler::saveToBinary(const std::string& modelFile, const std::string& outputFile, std::vector<Mesh>& meshList)
+#include <glm/gtc/type_ptr.hpp>
+#include <glm/matrix.hpp>
+
+void MeshCompiler::saveToBinary(const std::string& modelFile, const std::string& outputFile, std::vector<Mesh>& meshList, std::vector<ModelNode>& nodeList)
 {
 	//Import model "scene"
 	Assimp::Importer importer;
@@ -16,7 +19,7 @@ void MeshCompiler::saveToBinary(const std::string& modelFile, const std::string&
 		throw std::runtime_error("Failed to load model! (" + modelFile + ")");
 	}
 
-	LoadNode(scene->mRootNode, scene, meshList);
+	LoadNode(scene->mRootNode, scene, -1, meshList, nodeList);
 
 	std::ofstream file(outputFile, std::ios::out | std::ios::binary);
 
@@ -50,27 +53,51 @@ void MeshCompiler::saveToBinary(const std::string& modelFile, const std::string&
 		file.write(reinterpret_cast<const char*>(&mesh.materialIndex), sizeof(unsigned int));
 	}
 
+	// Node hierarchy goes last, files written before it existed just end after the meshes
+	size_t nodeSize = nodeList.size();
+	file.write(reinterpret_cast<const char*>(&nodeSize), sizeof(size_t));
+	for (auto& node : nodeList)
+	{
+		file.write(reinterpret_cast<const char*>(&node.parent), sizeof(int32_t));
+		file.write(reinterpret_cast<const char*>(&node.localTransform), sizeof(glm::mat4));
+		file.write(reinterpret_cast<const char*>(&node.firstMesh), sizeof(uint32_t));
+		file.write(reinterpret_cast<const char*>(&node.meshCount), sizeof(uint32_t));
+		file.write(node.name.c_str(), node.name.size());
+		file.write("\0", sizeof(char));
+	}
+
 	file.close();
 }
 
-void MeshCompiler::LoadNode(aiNode* node, const aiScene* scene, std::vector<Mesh>& meshList)
+void MeshCompiler::LoadNode(aiNode* node, const aiScene* scene, int32_t parent, std::vector<Mesh>& meshList, std::vector<ModelNode>& nodeList)
 {
+	// Keep the node with its transform relative to the parent (assimp matrices are row major, glm's are column major)
+	ModelNode modelNode = {};
+	modelNode.parent = parent;
+	modelNode.localTransform = glm::transpose(glm::make_mat4(&node->mTransformation.a1));
+	modelNode.firstMesh = static_cast<uint32_t>(meshList.size());
+	modelNode.meshCount = node->mNumMeshes;
+	modelNode.name = node->mName.C_Str();
+
+	int32_t nodeIndex = static_cast<int32_t>(nodeList.size());
+	nodeList.push_back(modelNode);
+
 	// Go through each mesh at this node and create it, then add it to our meshList
 	for (size_t i = 0; i < node->mNumMeshes; i++)
 	{
 		meshList.push_back(
-			LoadMesh(scene->mMeshes[node->mMeshes[i]], scene)// , matToTex)
+			LoadMesh(scene->mMeshes[node->mMeshes[i]])// , matToTex)
 		);
 	}
 
-	// Go through each node attached to this node and load it, then append their meshes to this node's mesh list
+	// Go through each node attached to this node and load it, their meshes go after this node's
 	for (size_t i = 0; i < node->mNumChildren; i++)
 	{
-		LoadNode(node->mChildren[i], scene, meshList); //, matToTex);
+		LoadNode(node->mChildren[i], scene, nodeIndex, meshList, nodeList); //, matToTex);
 	}
 }
 
-Mesh MeshCompiler::LoadMesh(const aiMesh* mesh, const aiScene* scene)
+Mesh MeshCompiler::LoadMesh(const aiMesh* mesh)
 {
 	std::vector<Vertex> vertices;
 	std::vector<uint32_t> indices;
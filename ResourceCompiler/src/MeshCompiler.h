@@ -19,9 +19,9 @@ struct aiMesh;
 class MeshCompiler
 {
 public:
-	static void saveToBinary(const std::string& modelFile, const std::string& outputFile, std::vector<Mesh>& meshList);
+	static void saveToBinary(const std::string& modelFile, const std::string& outputFile, std::vector<Mesh>& meshList, std::vector<ModelNode>& nodeList);
 private:
-	static void LoadNode(aiNode* node, const aiScene* scene, std::vector<Mesh>& meshList);
-	static Mesh LoadMesh(const aiMesh* mesh, const aiScene* scene);
+	static void LoadNode(aiNode* node, const aiScene* scene, int32_t parent, std::vector<Mesh>& meshList, std::vector<ModelNode>& nodeList);
+	static Mesh LoadMesh(const aiMesh* mesh);
 	static std::vector<std::string> LoadMaterials(const aiScene* scene);
 };
\ No newline at end of file
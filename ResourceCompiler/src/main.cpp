@@ -7,7 +7,7 @@
 
 #include "MeshCompiler.h"
 
-void loadFromBinary(const std::string& inputFile, std::vector<Mesh>& meshList, std::vector<std::string>& materials)
+void loadFromBinary(const std::string& inputFile, std::vector<Mesh>& meshList, std::vector<ModelNode>& nodeList, std::vector<std::string>& materials)
 {
 	std::ifstream file(inputFile, std::ios::in | std::ios::binary);
 
@@ -60,6 +60,21 @@ void loadFromBinary(const std::string& inputFile, std::vector<Mesh>& meshList, s
 		meshList.push_back(Mesh{ vertices, indices, materialIndex });
 	}
 
+	size_t nodeSize;
+	file.read((char*)&nodeSize, sizeof(size_t));
+
+	for (size_t i = 0; i < nodeSize; i++)
+	{
+		ModelNode node;
+		file.read((char*)&node.parent, sizeof(int32_t));
+		file.read((char*)&node.localTransform, sizeof(glm::mat4));
+		file.read((char*)&node.firstMesh, sizeof(uint32_t));
+		file.read((char*)&node.meshCount, sizeof(uint32_t));
+		std::getline(file, node.name, '\0');
+
+		nodeList.push_back(node);
+	}
+
 	file.close();
 }
 
@@ -70,12 +85,14 @@ int main()
 
 	// TODO: Load materials
 	std::vector<Mesh> writeList;
-	MeshCompiler::saveToBinary(modelFile, outputFile, writeList);
+	std::vector<ModelNode> writeNodes;
+	MeshCompiler::saveToBinary(modelFile, outputFile, writeList, writeNodes);
 
 	// Test function to verify data is being read correctly without the need of vulkan classes
 	std::vector<Mesh> readList;
+	std::vector<ModelNode> readNodes;
 	std::vector<std::string> materials;
-	loadFromBinary(outputFile, readList, materials);
+	loadFromBinary(outputFile, readList, readNodes, materials);
 
 	std::cout << "Compiling Complete!" << std::endl;
 }
\ No newline at end of file